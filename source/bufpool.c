@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "common.h"
+#include "bufpool.h"
+
+#ifdef GEKKO
+#include <ogc/system.h>
+#include <ogc/mutex.h>
+#include <ogc/irq.h>
+#else
+#include <pthread.h>
+#endif
+
+struct bufpool_slot {
+	unsigned char *buf;
+	unsigned int   size;
+	bool           in_use;
+	bool           heap;
+};
+
+static struct bufpool_slot slots[BUFPOOL_MAX_BUFFERS];
+
+#ifdef GEKKO
+static mutex_t        lock = LWP_MUTEX_NULL;
+static unsigned char *mem2_next, *mem2_end;
+static bool           mem2_tried;
+
+// Whoever gets here first makes the mutex, with interrupts off so two threads can't both do it
+static void pool_lock(void) {
+	if (lock == LWP_MUTEX_NULL) {
+		uint32_t level = IRQ_Disable();
+		if (lock == LWP_MUTEX_NULL)
+			LWP_MutexInit(&lock, false);
+		IRQ_Restore(level);
+	}
+
+	LWP_MutexLock(lock);
+}
+
+static void pool_unlock(void) {
+	LWP_MutexUnlock(lock);
+}
+
+// Lowering the arena's top is how you keep anything else (malloc included) from handing it out
+static void* mem2_alloc(unsigned int size) {
+	if (!mem2_tried) {
+		uint32_t level = IRQ_Disable();
+		unsigned char* hi = SYS_GetArena2Hi();
+		unsigned char* lo = SYS_GetArena2Lo();
+		unsigned char* start = (unsigned char *)((uintptr_t)(hi - BUFPOOL_MEM2_SIZE) & ~(uintptr_t)(BUFPOOL_ALIGN - 1));
+
+		if (start > lo) {
+			SYS_SetArena2Hi(start);
+			mem2_next = start;
+			mem2_end  = start + BUFPOOL_MEM2_SIZE;
+		}
+		IRQ_Restore(level);
+		mem2_tried = true;
+	}
+
+	if (mem2_end - mem2_next < size)
+		return NULL;
+
+	void* buf = mem2_next;
+	mem2_next += size;
+	return buf;
+}
+#else
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void pool_lock(void) {
+	pthread_mutex_lock(&lock);
+}
+
+static void pool_unlock(void) {
+	pthread_mutex_unlock(&lock);
+}
+
+static void* mem2_alloc(unsigned int size) {
+	return NULL;
+}
+#endif
+
+void* bufpool_acquire(unsigned int size) {
+	struct bufpool_slot *best = NULL, *empty = NULL, *idle_heap = NULL;
+
+	size = align_up(size ? size : 1, BUFPOOL_ALIGN);
+
+	pool_lock();
+	for (int i = 0; i < BUFPOOL_MAX_BUFFERS; i++) {
+		struct bufpool_slot* slot = &slots[i];
+
+		if (!slot->buf) {
+			if (!empty)
+				empty = slot;
+		}
+		else if (!slot->in_use && slot->size >= size && slot->size / BUFPOOL_MAX_SLACK <= size && (!best || slot->size < best->size)) {
+			best = slot;
+		}
+		else if (!slot->in_use && slot->heap && (!idle_heap || slot->size > idle_heap->size)) {
+			idle_heap = slot;
+		}
+	}
+
+	if (best) {
+		best->in_use = true;
+		pool_unlock();
+		return best->buf;
+	}
+
+	// Full up: an idle heap buffer that didn't fit makes room. MEM2 ones can't be given back, so they keep their slots
+	if (!empty && idle_heap) {
+		free(idle_heap->buf);
+		*idle_heap = (struct bufpool_slot){};
+		empty = idle_heap;
+	}
+
+	// Only with a slot to keep track of it, release() can't free() a MEM2 buffer
+	void* buf = empty ? mem2_alloc(size) : NULL;
+	bool  heap = !buf;
+	if (heap)
+		buf = aligned_alloc(BUFPOOL_ALIGN, size);
+
+	// No slot left means it won't come back to the pool, release() just frees it
+	if (buf && empty)
+		*empty = (struct bufpool_slot){ buf, size, true, heap };
+	pool_unlock();
+
+	return buf;
+}
+
+void bufpool_release(void* buf) {
+	if (!buf)
+		return;
+
+	pool_lock();
+	for (int i = 0; i < BUFPOOL_MAX_BUFFERS; i++) {
+		if (slots[i].buf == buf) {
+			slots[i].in_use = false;
+			pool_unlock();
+			return;
+		}
+	}
+	pool_unlock();
+
+	free(buf);
+}
+
+void bufpool_trim(void) {
+	pool_lock();
+	for (int i = 0; i < BUFPOOL_MAX_BUFFERS; i++) {
+		if (slots[i].buf && slots[i].heap && !slots[i].in_use) {
+			free(slots[i].buf);
+			slots[i] = (struct bufpool_slot){};
+		}
+	}
+	pool_unlock();
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include <stdbool.h>
+
+// Buffers for anything that goes to or from IOS. 0x40 aligned and padded out to whole cache lines, so
+// flushing or invalidating one can never take a neighbour with it. Released buffers stay around for the
+// next acquire of the same size or a bit smaller, and on the console they come out of MEM2.
+#define BUFPOOL_ALIGN       0x40
+#define BUFPOOL_MAX_BUFFERS 16
+#define BUFPOOL_MAX_SLACK   4 // A released buffer only gets handed out again for requests at least 1/4 of its size
+#define BUFPOOL_MEM2_SIZE   0x400000 // Taken off the top of MEM2 the first time it's needed, the heap covers anything past that
+
+void* bufpool_acquire(unsigned int size); // NULL if there's no memory for it
+void  bufpool_release(void* buf); // NULL is fine
+void  bufpool_trim(void); // Frees the idle heap buffers. MEM2 ones stay, nothing else can use that space anyway
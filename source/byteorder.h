@@ -0,0 +1,13 @@
+#pragma once
+#include <stdint.h>
+
+// Everything the Wii keeps on disk is big-endian. On the console these do nothing.
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+static inline uint16_t be16(uint16_t x) { return __builtin_bswap16(x); }
+static inline uint32_t be32(uint32_t x) { return __builtin_bswap32(x); }
+static inline uint64_t be64(uint64_t x) { return __builtin_bswap64(x); }
+#else
+static inline uint16_t be16(uint16_t x) { return x; }
+static inline uint32_t be32(uint32_t x) { return x; }
+static inline uint64_t be64(uint64_t x) { return x; }
+#endif
@@ -1,7 +1,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#if __has_builtin(__builtin_align_up)
 #define align_up(x, align) __builtin_align_up(x, align)
+#else // GCC, for the tools/ builds
+#define align_up(x, align) (((x) + ((align) - 1)) & ~(__typeof__(x))((align) - 1))
+#endif
 
 #define print_error(func, ret, ...) do { fprintf(stderr, "%s:%i : " func " failed (ret=%i)\n", __FILE_NAME__, __LINE__, ##__VA_ARGS__, ret); } while (0);
 
@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <mbedtls/aes.h>
+
+#ifdef GEKKO
+#include <ogc/es.h>
+#include <ogc/lwp_watchdog.h>
+#else
+#include <time.h>
+#endif
+
+#include "common.h"
+#include "crypto.h"
+
+const char* const crypto_backend_names[CRYPTO_NUM_BACKENDS] = {
+	[CRYPTO_BACKEND_ES]       = "ES",
+	[CRYPTO_BACKEND_SOFTWARE] = "Software",
+};
+
+#ifdef GEKKO
+static enum crypto_backend backend = CRYPTO_BACKEND_ES;
+#else
+static enum crypto_backend backend = CRYPTO_BACKEND_SOFTWARE;
+#endif
+
+static bool                sd_key_loaded = false;
+static mbedtls_aes_context sd_enc, sd_dec;
+
+static uint64_t now_usec(void) {
+#ifdef GEKKO
+	return ticks_to_microsecs(gettime());
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+#endif
+}
+
+bool crypto_backend_available(enum crypto_backend which) {
+	switch (which) {
+#ifdef GEKKO
+		case CRYPTO_BACKEND_ES:       return true;
+#endif
+		case CRYPTO_BACKEND_SOFTWARE: return sd_key_loaded;
+		default:                      return false;
+	}
+}
+
+int crypto_set_backend(enum crypto_backend which) {
+	if (!crypto_backend_available(which))
+		return -EINVAL;
+
+	backend = which;
+	return 0;
+}
+
+enum crypto_backend crypto_get_backend(void) {
+	return backend;
+}
+
+int crypto_set_sd_key(const uint8_t key[16]) {
+	mbedtls_aes_init(&sd_enc);
+	mbedtls_aes_init(&sd_dec);
+	if (mbedtls_aes_setkey_enc(&sd_enc, key, 128) != 0 || mbedtls_aes_setkey_dec(&sd_dec, key, 128) != 0)
+		return -EINVAL;
+
+	sd_key_loaded = true;
+	return 0;
+}
+
+int crypto_load_sd_key(const char* path) {
+	uint8_t key[16];
+
+	FILE* fp = fopen(path, "rb");
+	if (!fp)
+		return -errno;
+
+	size_t read = fread(key, 1, sizeof(key), fp);
+	fclose(fp);
+	if (read != sizeof(key)) {
+		fprintf(stderr, "%s: SD key should be 16 bytes\n", path);
+		return -EINVAL;
+	}
+
+	return crypto_set_sd_key(key);
+}
+
+int sd_encrypt(uint32_t iv[4], const void* in, unsigned int len, void* out) {
+	switch (backend) {
+#ifdef GEKKO
+		case CRYPTO_BACKEND_ES:
+			return ES_Encrypt(ES_KEY_SDCARD, (u8 *)iv, (u8 *)in, len, out);
+#endif
+		case CRYPTO_BACKEND_SOFTWARE:
+			return mbedtls_aes_crypt_cbc(&sd_enc, MBEDTLS_AES_ENCRYPT, len, (unsigned char *)iv, in, out);
+
+		default:
+			return -EINVAL;
+	}
+}
+
+int sd_decrypt(uint32_t iv[4], const void* in, unsigned int len, void* out) {
+	switch (backend) {
+#ifdef GEKKO
+		case CRYPTO_BACKEND_ES:
+			return ES_Decrypt(ES_KEY_SDCARD, (u8 *)iv, (u8 *)in, len, out);
+#endif
+		case CRYPTO_BACKEND_SOFTWARE:
+			return mbedtls_aes_crypt_cbc(&sd_dec, MBEDTLS_AES_DECRYPT, len, (unsigned char *)iv, in, out);
+
+		default:
+			return -EINVAL;
+	}
+}
+
+static int aes_cbc(const uint8_t key[16], int mode, uint8_t iv[16], const void* in, unsigned int len, void* out) {
+	mbedtls_aes_context aes;
+	int ret;
+
+	mbedtls_aes_init(&aes);
+	ret = (mode == MBEDTLS_AES_ENCRYPT) ? mbedtls_aes_setkey_enc(&aes, key, 128) : mbedtls_aes_setkey_dec(&aes, key, 128);
+	if (ret == 0)
+		ret = mbedtls_aes_crypt_cbc(&aes, mode, len, iv, in, out);
+
+	mbedtls_aes_free(&aes);
+	return ret;
+}
+
+int aes_cbc_encrypt(const uint8_t key[16], uint8_t iv[16], const void* in, unsigned int len, void* out) {
+	return aes_cbc(key, MBEDTLS_AES_ENCRYPT, iv, in, len, out);
+}
+
+int aes_cbc_decrypt(const uint8_t key[16], uint8_t iv[16], const void* in, unsigned int len, void* out) {
+	return aes_cbc(key, MBEDTLS_AES_DECRYPT, iv, in, len, out);
+}
+
+// Microseconds to push total bytes through in chunk sized pieces
+static int time_backend(enum crypto_backend which, void* buf, unsigned int chunk, unsigned int total, uint64_t* elapsed) {
+	enum crypto_backend prev = backend;
+	uint32_t iv[4] __attribute__((aligned(0x20))) = {};
+	int ret = 0;
+
+	backend = which;
+	uint64_t start = now_usec();
+	for (unsigned int done = 0; done < total && ret >= 0; done += chunk)
+		ret = sd_encrypt(iv, buf, chunk, buf);
+
+	*elapsed = now_usec() - start;
+	backend = prev;
+	return ret;
+}
+
+void crypto_benchmark(void* buf, unsigned int max_chunk) {
+	const unsigned int total = 0x100000;
+
+	for (int i = 0; i < CRYPTO_NUM_BACKENDS; i++) {
+		if (!crypto_backend_available(i))
+			continue;
+
+		for (unsigned int chunk = 0x1000; chunk <= max_chunk && chunk <= total; chunk <<= 2) {
+			uint64_t elapsed;
+
+			int ret = time_backend(i, buf, chunk, total, &elapsed);
+			if (ret < 0) {
+				print_error("sd_encrypt(%s)", ret, crypto_backend_names[i]);
+				break;
+			}
+
+			printf("AES   %-9s %#8x: %8.2f MB/s\n", crypto_backend_names[i], chunk, elapsed ? total / (double)elapsed : 0.0);
+		}
+	}
+}
+
+int crypto_init(void) {
+	int ret = crypto_load_sd_key(SD_KEY_PATH);
+	if (ret < 0)
+		return (ret == -ENOENT) ? 0 : ret;
+
+#ifdef GEKKO
+	// Nothing to check the key against but ES itself. Same input, same IV, has to be the same output
+	const unsigned int size = 0x10000;
+	unsigned char* temp = aligned_alloc(0x40, size * 2);
+	if (!temp)
+		return -ENOMEM;
+
+	for (unsigned int i = 0; i < size; i++)
+		temp[i] = temp[size + i] = i * 0x9D;
+
+	uint64_t es_time, sw_time;
+	if ((ret = time_backend(CRYPTO_BACKEND_ES,       temp,        size, size, &es_time)) < 0
+	||  (ret = time_backend(CRYPTO_BACKEND_SOFTWARE, temp + size, size, size, &sw_time)) < 0) {
+		free(temp);
+		return ret;
+	}
+
+	bool same = (memcmp(temp, temp + size, size) == 0);
+	free(temp);
+	if (!same) {
+		fprintf(stderr, "%s doesn't match the console's SD key, ignoring it\n", SD_KEY_PATH);
+		sd_key_loaded = false;
+		return -EINVAL;
+	}
+
+	backend = (sw_time < es_time) ? CRYPTO_BACKEND_SOFTWARE : CRYPTO_BACKEND_ES;
+	printf("SD crypto: %s (ES %lluus, software %lluus per 64KiB)\n", crypto_backend_names[backend], es_time, sw_time);
+#endif
+
+	return 0;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// AES-128-CBC for everything that goes to/from the SD card. IVs are updated in place, just like ES_Encrypt does.
+// The buffers should be 0x20 aligned and len a multiple of 16.
+
+enum crypto_backend {
+	CRYPTO_BACKEND_ES,       // ES_Encrypt/ES_Decrypt with the SD key, one IPC call per chunk. Console only
+	CRYPTO_BACKEND_SOFTWARE, // mbedtls, with the SD key from crypto_set_sd_key()
+
+	CRYPTO_NUM_BACKENDS,
+};
+
+extern const char* const crypto_backend_names[CRYPTO_NUM_BACKENDS];
+
+#define SD_KEY_PATH "/title_manager/sd_key.bin"
+
+int  crypto_init(void); // Picks up SD_KEY_PATH if it's there, then uses whichever backend is faster
+int  crypto_set_backend(enum crypto_backend backend);
+enum crypto_backend crypto_get_backend(void);
+bool crypto_backend_available(enum crypto_backend backend);
+int  crypto_set_sd_key(const uint8_t key[16]);
+int  crypto_load_sd_key(const char* path);
+
+int  sd_encrypt(uint32_t iv[4], const void* in, unsigned int len, void* out);
+int  sd_decrypt(uint32_t iv[4], const void* in, unsigned int len, void* out);
+
+// Always software, for keys ES doesn't have
+int  aes_cbc_encrypt(const uint8_t key[16], uint8_t iv[16], const void* in, unsigned int len, void* out);
+int  aes_cbc_decrypt(const uint8_t key[16], uint8_t iv[16], const void* in, unsigned int len, void* out);
+
+// MB/s of every available backend at a few chunk sizes. buf needs to be at least max_chunk bytes
+void crypto_benchmark(void* buf, unsigned int max_chunk);
@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+
+#include "common.h"
+#include "filetable.h"
+#include "nand.h"
+
+// Paths get carved out of these. A new block goes on the front whenever the current one fills up, nothing ever moves
+struct string_block {
+	struct string_block *next;
+	unsigned int         used, size;
+	char                 data[];
+};
+
+#define STRING_BLOCK_SIZE 0x1000
+
+// Enough for nearly every save directory in one go, see read_dir()
+#define READ_DIR_GUESS 128
+
+// One directory being walked, names straight from ISFS_ReadDir
+struct walk_dir {
+	const char *relative_path; // NULL for the data directory itself
+	char       *names;
+	const char *next_name;
+	uint32_t    left;
+};
+
+// Explicit, so a deep save is a bigger allocation rather than a deeper C stack
+struct walk_stack {
+	struct walk_dir *dirs;
+	unsigned int     depth, capacity;
+};
+
+static char* alloc_string(struct file_table* table, unsigned int size) {
+	struct string_block* block = table->strings;
+
+	if (!block || block->size - block->used < size) {
+		unsigned int block_size = (size > STRING_BLOCK_SIZE) ? size : STRING_BLOCK_SIZE;
+
+		block = malloc(sizeof(struct string_block) + block_size);
+		if (!block)
+			return NULL;
+
+		block->next = table->strings;
+		block->used = 0;
+		block->size = block_size;
+		table->strings = block;
+	}
+
+	char* str = block->data + block->used;
+	block->used += size;
+	return str;
+}
+
+static struct file_entry* append_entry(struct file_table* table) {
+	if (table->num_entries == table->capacity) {
+		unsigned int capacity = table->capacity ? table->capacity * 2 : 64;
+		struct file_entry* temp = reallocarray(table->entries, capacity, sizeof(struct file_entry));
+		if (!temp)
+			return NULL;
+
+		table->entries  = temp;
+		table->capacity = capacity;
+	}
+
+	return &table->entries[table->num_entries++];
+}
+
+// Guess high and it's one IPC. Only when the guess fills up all the way does it ask how many there really are, then it's three
+static int read_dir(const char* path, struct walk_dir* dir) {
+	int      ret;
+	uint32_t capacity = READ_DIR_GUESS;
+
+	while (true) {
+		uint32_t count = capacity;
+		char*    names = memalign32(capacity * 13);
+		if (!names)
+			return -ENOMEM;
+
+		ret = nand_read_dir(path, names, &count);
+		if (ret < 0) {
+			free(names);
+			print_error("ISFS_ReadDir(%s)", ret, path);
+			return ret;
+		}
+
+		// The second time around capacity is the real count already
+		if (count == capacity && capacity == READ_DIR_GUESS) {
+			ret = nand_read_dir(path, NULL, &count);
+			if (ret < 0) {
+				free(names);
+				print_error("ISFS_ReadDir(%s)", ret, path);
+				return ret;
+			}
+		}
+
+		if (count <= capacity) {
+			dir->names     = names;
+			dir->next_name = names;
+			dir->left      = count;
+			return 0;
+		}
+
+		free(names);
+		capacity = count;
+	}
+}
+
+static int push_dir(struct walk_stack* stack, const char* path, const char* relative_path) {
+	if (stack->depth == stack->capacity) {
+		unsigned int capacity = stack->capacity ? stack->capacity * 2 : 8;
+		struct walk_dir* temp = reallocarray(stack->dirs, capacity, sizeof(struct walk_dir));
+		if (!temp)
+			return -ENOMEM;
+
+		stack->dirs     = temp;
+		stack->capacity = capacity;
+	}
+
+	struct walk_dir* dir = &stack->dirs[stack->depth];
+	*dir = (struct walk_dir){ relative_path };
+
+	int ret = read_dir(path, dir);
+	if (ret < 0)
+		return ret;
+
+	stack->depth++;
+	return 0;
+}
+
+int build_file_table(const char* data_path, struct file_table* table) {
+	int                ret;
+	char               path[NAND_MAXPATH];
+	struct walk_stack  stack = {};
+
+	*table = (struct file_table){};
+
+	ret = push_dir(&stack, data_path, NULL);
+	while (ret >= 0 && stack.depth) {
+		struct walk_dir* dir = &stack.dirs[stack.depth - 1];
+		if (!dir->left) {
+			free(dir->names);
+			stack.depth--;
+			continue;
+		}
+
+		const char* name = dir->next_name;
+		dir->next_name += strlen(name) + 1;
+		dir->left--;
+
+		unsigned int len = dir->relative_path ? strlen(dir->relative_path) + 1 + strlen(name) : strlen(name);
+		char* relative_path = alloc_string(table, len + 1);
+		struct file_entry* entry = append_entry(table);
+		if (!relative_path || !entry) {
+			ret = -ENOMEM;
+			break;
+		}
+
+		if (dir->relative_path)
+			sprintf(relative_path, "%s/%s", dir->relative_path, name);
+		else
+			strcpy(relative_path, name);
+
+		if (snprintf(path, sizeof(path), "%s/%s", data_path, relative_path) >= sizeof(path)) {
+			fprintf(stderr, "%s/%s: Path is too long\n", data_path, relative_path);
+			ret = -ENAMETOOLONG;
+			break;
+		}
+
+		*entry = (struct file_entry){ relative_path };
+		ret = nand_get_attr(path, &entry->attributes, &entry->permissions);
+		if (ret < 0) {
+			print_error("ISFS_GetAttr(%s)", ret, path);
+			break;
+		}
+
+		// Directories can't be opened, and that's the cheapest way to find out which is which
+		int fd = ret = nand_open(path, NAND_OPEN_READ);
+		if (ret == NAND_EINVAL) {
+			entry->type = 2;
+			ret = push_dir(&stack, path, relative_path);
+			continue;
+		}
+		else if (ret < 0) {
+			print_error("ISFS_Open(%s)", ret, path);
+			break;
+		}
+
+		entry->type = 1;
+		ret = nand_get_file_size(fd, &entry->file_size);
+		nand_close(fd);
+		if (ret < 0)
+			print_error("ISFS_GetFileStats(%s)", ret, path);
+	}
+
+	while (stack.depth)
+		free(stack.dirs[--stack.depth].names);
+
+	free(stack.dirs);
+	if (ret < 0) {
+		free_file_table(table);
+		return ret;
+	}
+
+	return 0;
+}
+
+struct file_entry* file_table_add(struct file_table* table, const char* relative_path) {
+	char* path = alloc_string(table, strlen(relative_path) + 1);
+	struct file_entry* entry = path ? append_entry(table) : NULL;
+	if (!entry)
+		return NULL;
+
+	*entry = (struct file_entry){ strcpy(path, relative_path) };
+	return entry;
+}
+
+void free_file_table(struct file_table* table) {
+	while (table->strings) {
+		struct string_block* next = table->strings->next;
+		free(table->strings);
+		table->strings = next;
+	}
+
+	free(table->entries);
+	*table = (struct file_table){};
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <stdint.h>
+
+// Everything under a title's data directory, parents before their children, same order as ISFS_ReadDir gives it.
+// Paths are relative to the data directory and live in the table's arena, so they stay put while the table grows.
+
+struct file_entry {
+	const char *relative_path;
+	uint8_t     permissions;
+	uint8_t     attributes;
+	uint8_t     type; // 1: File, 2: Directory
+	uint32_t    file_size;
+	uint8_t     sha1[20]; // Of the file's contents, only filled in when asked for (manifests)
+};
+
+struct file_table {
+	unsigned int          num_entries, capacity;
+	struct file_entry    *entries;
+	struct string_block  *strings;
+};
+
+int  build_file_table(const char* data_path, struct file_table* file_table);
+void free_file_table(struct file_table* file_table);
+
+// Adds an entry with a copy of relative_path, everything else zeroed. NULL when out of memory
+struct file_entry* file_table_add(struct file_table* file_table, const char* relative_path);
@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef GEKKO
+#include <ogc/lwp_watchdog.h>
+#else
+#include <time.h>
+#endif
+
+#include "common.h"
+#include "hash.h"
+
+const char* const sha1_backend_names[SHA1_NUM_BACKENDS] = {
+	[SHA1_BACKEND_SOFTWARE] = "Software",
+	[SHA1_BACKEND_STARLET]  = "Starlet",
+};
+
+#ifdef GEKKO
+static enum sha1_backend backend = SHA1_BACKEND_STARLET;
+
+// Largest piece handed to SHA_Input in one go
+#define STARLET_MAX_INPUT 0x10000
+
+// For input that isn't 0x40 aligned
+static unsigned char stage[0x1000] __attribute__((aligned(0x40)));
+#else
+static enum sha1_backend backend = SHA1_BACKEND_SOFTWARE;
+#endif
+
+static uint64_t now_usec(void) {
+#ifdef GEKKO
+	return ticks_to_microsecs(gettime());
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+#endif
+}
+
+bool sha1_backend_available(enum sha1_backend which) {
+	switch (which) {
+		case SHA1_BACKEND_SOFTWARE: return true;
+#ifdef GEKKO
+		case SHA1_BACKEND_STARLET:  return true;
+#endif
+		default:                    return false;
+	}
+}
+
+int sha1_set_backend(enum sha1_backend which) {
+	if (!sha1_backend_available(which))
+		return -EINVAL;
+
+	backend = which;
+	return 0;
+}
+
+enum sha1_backend sha1_get_backend(void) {
+	return backend;
+}
+
+int sha1_init(sha1_ctx* ctx) {
+	memset(ctx, 0, sizeof(sha1_ctx));
+	ctx->backend = backend;
+
+	switch (ctx->backend) {
+		case SHA1_BACKEND_SOFTWARE:
+			mbedtls_sha1_init(&ctx->sw);
+			return mbedtls_sha1_starts_ret(&ctx->sw);
+
+#ifdef GEKKO
+		case SHA1_BACKEND_STARLET:
+			return SHA_InitializeContext(&ctx->hw.ctx);
+#endif
+
+		default:
+			return -EINVAL;
+	}
+}
+
+#ifdef GEKKO
+static int starlet_update(sha1_ctx* ctx, const unsigned char* data, size_t len) {
+	int ret;
+
+	while (len) {
+		// Only goes out once there's more coming, so the last block always stays behind for SHA_Finalize
+		if (ctx->hw.pending_len == 64) {
+			if ((ret = SHA_Input(&ctx->hw.ctx, ctx->hw.pending, 64)) < 0)
+				return ret;
+
+			ctx->hw.pending_len = 0;
+		}
+
+		if (!ctx->hw.pending_len && len > 64) {
+			size_t count = (len - 1) & ~63;
+			const void* src = data;
+
+			if ((uintptr_t)data & 0x3F) {
+				if (count > sizeof(stage))
+					count = sizeof(stage);
+
+				memcpy(stage, data, count);
+				src = stage;
+			}
+			else if (count > STARLET_MAX_INPUT) {
+				count = STARLET_MAX_INPUT;
+			}
+
+			if ((ret = SHA_Input(&ctx->hw.ctx, src, count)) < 0)
+				return ret;
+
+			data += count;
+			len  -= count;
+			continue;
+		}
+
+		size_t count = 64 - ctx->hw.pending_len;
+		if (count > len)
+			count = len;
+
+		memcpy(ctx->hw.pending + ctx->hw.pending_len, data, count);
+		ctx->hw.pending_len += count;
+		data += count;
+		len  -= count;
+	}
+
+	return 0;
+}
+#endif
+
+int sha1_update(sha1_ctx* ctx, const void* data, size_t len) {
+	switch (ctx->backend) {
+		case SHA1_BACKEND_SOFTWARE:
+			return mbedtls_sha1_update_ret(&ctx->sw, data, len);
+
+#ifdef GEKKO
+		case SHA1_BACKEND_STARLET:
+			return starlet_update(ctx, data, len);
+#endif
+
+		default:
+			return -EINVAL;
+	}
+}
+
+int sha1_finish(sha1_ctx* ctx, uint8_t hash[20]) {
+	int ret;
+
+	switch (ctx->backend) {
+		case SHA1_BACKEND_SOFTWARE:
+			ret = mbedtls_sha1_finish_ret(&ctx->sw, hash);
+			mbedtls_sha1_free(&ctx->sw);
+			return ret;
+
+#ifdef GEKKO
+		case SHA1_BACKEND_STARLET: {
+			uint32_t digest[5] __attribute__((aligned(0x20)));
+
+			ret = SHA_Finalize(&ctx->hw.ctx, ctx->hw.pending, ctx->hw.pending_len, digest);
+			if (ret >= 0)
+				memcpy(hash, digest, sizeof(digest));
+
+			return ret;
+		}
+#endif
+
+		default:
+			return -EINVAL;
+	}
+}
+
+void sha1_benchmark(void* buf, unsigned int max_chunk) {
+	const unsigned int total = 0x100000;
+	enum sha1_backend prev = backend;
+
+	for (int i = 0; i < SHA1_NUM_BACKENDS; i++) {
+		if (!sha1_backend_available(i))
+			continue;
+
+		backend = i;
+		for (unsigned int chunk = 0x1000; chunk <= max_chunk && chunk <= total; chunk <<= 2) {
+			sha1_ctx ctx;
+			uint8_t  hash[20];
+			int      ret = sha1_init(&ctx);
+
+			uint64_t start = now_usec();
+			for (unsigned int done = 0; done < total && ret >= 0; done += chunk)
+				ret = sha1_update(&ctx, buf, chunk);
+
+			if (ret >= 0)
+				ret = sha1_finish(&ctx, hash);
+
+			uint64_t elapsed = now_usec() - start;
+			if (ret < 0) {
+				print_error("sha1(%s)", ret, sha1_backend_names[i]);
+				break;
+			}
+
+			printf("SHA-1 %-9s %#8x: %8.2f MB/s\n", sha1_backend_names[i], chunk, elapsed ? total / (double)elapsed : 0.0);
+		}
+	}
+
+	backend = prev;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <mbedtls/sha1.h>
+
+#ifdef GEKKO
+#include <ogc/sha.h>
+#endif
+
+// SHA-1 that can run on Starlet's SHA engine (/dev/sha) instead of the PPC.
+// sha1_ctx is plain data, so a half finished hash can be saved with memcpy/fwrite and picked back up later.
+
+enum sha1_backend {
+	SHA1_BACKEND_SOFTWARE, // mbedtls
+	SHA1_BACKEND_STARLET,  // /dev/sha through libogc. Console only, and needs SHA_Init()
+
+	SHA1_NUM_BACKENDS,
+};
+
+extern const char* const sha1_backend_names[SHA1_NUM_BACKENDS];
+
+typedef struct sha1_ctx {
+	enum sha1_backend backend;
+	union {
+		mbedtls_sha1_context sw;
+#ifdef GEKKO
+		struct {
+			sha_context   ctx;
+			unsigned int  pending_len; // 1-64 bytes once anything went in, there's always something left for SHA_Finalize
+			unsigned char pending[64] __attribute__((aligned(0x40)));
+		} hw;
+#endif
+	};
+} sha1_ctx;
+
+int  sha1_set_backend(enum sha1_backend backend); // For every sha1_init() after this
+enum sha1_backend sha1_get_backend(void);
+bool sha1_backend_available(enum sha1_backend backend);
+
+int  sha1_init(sha1_ctx* ctx);
+int  sha1_update(sha1_ctx* ctx, const void* data, size_t len); // 0x40 aligned data skips a copy on Starlet
+int  sha1_finish(sha1_ctx* ctx, uint8_t hash[20]);
+
+// MB/s of every available backend at a few chunk sizes. buf needs to be at least max_chunk bytes
+void sha1_benchmark(void* buf, unsigned int max_chunk);
@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <mbedtls/md5.h>
+
+#include "common.h"
+#include "journal.h"
+
+#define JOURNAL_MAGIC   0x4A524E4C // JRNL
+#define JOURNAL_VERSION 1
+
+static void journal_md5(const struct export_journal* state, uint8_t md5[16]) {
+	mbedtls_md5_ret((const unsigned char *)state, offsetof(struct export_journal, md5), md5);
+}
+
+// Has to actually be on the card, not sitting in a cache somewhere
+static int flush(FILE* fp) {
+	if (fflush(fp) != 0 || fsync(fileno(fp)) != 0)
+		return -errno;
+
+	return 0;
+}
+
+int journal_open(journal* jr, const char* path, FILE* out, uint64_t title_id, const uint8_t tmd_sha1[20]) {
+	struct export_journal* state = &jr->state;
+	uint8_t md5[16];
+	long    start = ftell(out);
+
+	memset(jr, 0, sizeof(journal));
+	jr->out = out;
+	if (!path)
+		goto fresh;
+
+	if ((jr->fp = fopen(path, "r+b"))) {
+		long size = -1;
+
+		if (fread(state, sizeof(*state), 1, jr->fp) && fseek(out, 0, SEEK_END) == 0)
+			size = ftell(out);
+
+		journal_md5(state, md5);
+		if (size >= 0 && state->magic == JOURNAL_MAGIC && state->version == JOURNAL_VERSION && !memcmp(md5, state->md5, sizeof(md5))
+		&&  state->title_id == title_id && !memcmp(state->tmd_sha1, tmd_sha1, sizeof(state->tmd_sha1))
+		&&  state->sha.backend < SHA1_NUM_BACKENDS && sha1_backend_available(state->sha.backend)
+		&&  (uint64_t)size >= state->file_offset)
+		{
+			if (fseek(out, state->file_offset, SEEK_SET) < 0)
+				return -errno;
+
+			jr->last_checkpoint = state->file_offset;
+			return 1;
+		}
+
+		fclose(jr->fp);
+	}
+
+	// Nothing (usable) there, so from the top
+	if (!(jr->fp = fopen(path, "w+b"))) {
+		perror(path);
+		return -errno;
+	}
+
+fresh:
+	// Anything past here is from some other export
+	if (fseek(out, start, SEEK_SET) < 0 || fflush(out) != 0 || ftruncate(fileno(out), start) < 0)
+		return -errno;
+
+	memset(state, 0, sizeof(*state));
+	state->magic    = JOURNAL_MAGIC;
+	state->version  = JOURNAL_VERSION;
+	state->title_id = title_id;
+	memcpy(state->tmd_sha1, tmd_sha1, sizeof(state->tmd_sha1));
+	sha1_init(&state->sha);
+
+	return 0;
+}
+
+int journal_checkpoint(journal* jr) {
+	int ret;
+
+	if (!jr->fp)
+		return 0;
+
+	if ((ret = flush(jr->out)) < 0)
+		return ret;
+
+	journal_md5(&jr->state, jr->state.md5);
+	if (fseek(jr->fp, 0, SEEK_SET) < 0 || !fwrite(&jr->state, sizeof(jr->state), 1, jr->fp))
+		return -errno;
+
+	if ((ret = flush(jr->fp)) < 0)
+		return ret;
+
+	jr->last_checkpoint = jr->state.file_offset;
+	return 0;
+}
+
+int journal_close(journal* jr, const char* path, bool done) {
+	if (!jr->fp)
+		return 0;
+
+	fclose(jr->fp);
+	jr->fp = NULL;
+	return (done && remove(path) < 0) ? -errno : 0;
+}
+
+int journal_copy(journal* jr, uint32_t index, uint32_t size, journal_read_fn read, void* user, void* buffer, unsigned int chunk_size) {
+	struct export_journal* state = &jr->state;
+	uint32_t size64 = align_up(size, 0x40);
+	int ret;
+
+	if (index != state->content) {
+		state->content        = index;
+		state->content_offset = 0;
+	}
+
+	// Already in the file, read and thrown away to get ES where it needs to be
+	for (uint32_t skipped = 0; skipped < state->content_offset; ) {
+		unsigned int len = (state->content_offset - skipped > chunk_size) ? chunk_size : state->content_offset - skipped;
+
+		if ((ret = read(user, buffer, len)) < 0)
+			return ret;
+
+		skipped += len;
+	}
+
+	while (state->content_offset < size64) {
+		unsigned int len = (size64 - state->content_offset > chunk_size) ? chunk_size : size64 - state->content_offset;
+
+		if ((ret = read(user, buffer, len)) < 0)
+			return ret;
+
+		if (!fwrite(buffer, len, 1, jr->out)) {
+			ret = -errno;
+			print_error("fwrite", ret);
+			return ret;
+		}
+
+		sha1_update(&state->sha, buffer, len);
+		state->content_offset += len;
+		state->file_offset    += len;
+
+		if (state->file_offset - jr->last_checkpoint >= JOURNAL_INTERVAL && (ret = journal_checkpoint(jr)) < 0)
+			return ret;
+	}
+
+	state->content++;
+	state->content_offset = 0;
+	return journal_checkpoint(jr);
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "hash.h"
+
+// Checkpoints for export_content(), so a content.bin that fell over halfway (SD pulled, card full) carries on from where it
+// got to instead of starting over. Everything in front of the contents is cheap and comes out the same every time, so
+// that just gets written again; the contents are where the time goes.
+//
+// ES only hands contents out front to back (CBC), so the half done one still gets read up to the checkpoint, just not written or hashed.
+
+#define JOURNAL_INTERVAL 0x400000 // Checkpoint at least this often, on top of the end of every content
+
+struct export_journal {
+	uint32_t magic, version;
+	uint64_t title_id;
+	uint8_t  tmd_sha1[20];   // An update in between would make the old half useless
+	uint32_t content;        // Index into the TMD's contents of the one being written
+	uint32_t content_offset; // How much of it is in the file
+	uint64_t file_offset;    // Everything before this is good
+	sha1_ctx sha;            // Of everything the signature covers, up to file_offset
+	uint8_t  md5[16];        // Of all of the above, a torn write doesn't count
+};
+
+typedef struct journal {
+	FILE                 *fp;  // NULL, no journal. Every call below is then a no-op
+	FILE                 *out; // What it's keeping track of
+	struct export_journal state;
+	uint64_t              last_checkpoint;
+} journal;
+
+typedef int (*journal_read_fn)(void* user, void* buf, unsigned int len); // Fills all of buf, or < 0
+
+// Picks up an existing journal at path if it goes with this title/TMD and out has everything it says it has. 1 if it did,
+// 0 if this starts from nothing (and out gets cut off where it is). path NULL runs without one
+int  journal_open(journal* jr, const char* path, FILE* out, uint64_t title_id, const uint8_t tmd_sha1[20]);
+int  journal_checkpoint(journal* jr); // Flushes out, then writes the state
+int  journal_close(journal* jr, const char* path, bool done); // done removes it
+
+// Content index (size bytes, 0x40 padded) from read() to out and through sha, carrying on from the checkpoint if it was the one in progress.
+// buffer is chunk_size bytes
+int  journal_copy(journal* jr, uint32_t index, uint32_t size, journal_read_fn read, void* user, void* buffer, unsigned int chunk_size);
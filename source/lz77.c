@@ -0,0 +1,308 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "lz77.h"
+
+#define ERROR(str, ...) fprintf(stderr, "%s:%i: \n" str "\n", __FILE__, __LINE__, ##__VA_ARGS__)
+
+// Only ever called with in_buf drained, so the reads always land on an aligned buffer
+static int LZ77Refill(LZ77Stream* stream) {
+    unsigned int len = (stream->in_left < LZ77_INPUT_SIZE) ? stream->in_left : LZ77_INPUT_SIZE;
+
+    stream->in_pos = stream->in_len = 0;
+    if (!len)
+        return 0;
+
+    int ret = stream->io->read(stream->user, stream->in_buf, len);
+    if (ret < 0) {
+        ERROR("Read of %#x bytes failed (ret=%i)", len, ret);
+        return stream->in_error = ret;
+    }
+
+    stream->in_len = ret;
+    if (stream->in_left != ~0u)
+        stream->in_left -= ret;
+
+    if (stream->has_md5 && stream->md5_status > 0) {
+        mbedtls_md5_update_ret(&stream->md5, stream->in_buf, ret);
+
+        if (!stream->in_left) {
+            uint8_t hash[16];
+
+            mbedtls_md5_finish_ret(&stream->md5, hash);
+            stream->md5_status = memcmp(hash, stream->md5_sum, sizeof(hash)) ? -1 : 0;
+            if (stream->md5_status < 0) {
+                ERROR("IMD5 checksum mismatch");
+                return stream->in_error = -5;
+            }
+        }
+    }
+
+    return ret;
+}
+
+// < 0 is the end of the input (or an error, check in_error)
+static inline int LZ77GetByte(LZ77Stream* stream) {
+    if (stream->in_pos == stream->in_len && LZ77Refill(stream) <= 0)
+        return -1;
+
+    return stream->in_buf[stream->in_pos++];
+}
+
+static int LZ77Start(LZ77Stream* stream) {
+    int ret = stream->io->seek(stream->user, stream->base);
+    if (ret < 0) {
+        ERROR("Seek to %#x failed (ret=%i)", stream->base, ret);
+        return ret;
+    }
+
+    stream->type = 0x00;
+    stream->out_size = ~0u;
+    stream->out_pos = 0;
+    stream->in_pos = stream->in_len = 0;
+    stream->in_left = ~0u;
+    stream->in_error = 0;
+    stream->flags = stream->flag_bits = 0;
+    stream->copy_len = stream->copy_disp = 0;
+    stream->has_md5 = false;
+    stream->md5_status = 1;
+
+    ret = stream->io->read(stream->user, stream->in_buf, sizeof(IMD5Header));
+    if (ret < 0) {
+        ERROR("Read of %#x bytes failed (ret=%i)", (unsigned int)sizeof(IMD5Header), ret);
+        return ret;
+    }
+
+    stream->in_len = ret;
+
+    IMD5Header* imd5 = (IMD5Header *)stream->in_buf;
+    if (ret == sizeof(IMD5Header) && be32(imd5->magic) == IMD5_MAGIC) {
+        stream->in_left = stream->out_size = be32(imd5->size);
+        stream->has_md5 = true;
+        memcpy(stream->md5_sum, imd5->md5_sum, sizeof(stream->md5_sum));
+        mbedtls_md5_starts_ret(&stream->md5);
+
+        // Header's done with, the payload is read fresh (and hashed)
+        if (LZ77Refill(stream) < 0)
+            return stream->in_error;
+    }
+
+    unsigned char* ptr = stream->in_buf + stream->in_pos;
+    unsigned int avail = stream->in_len - stream->in_pos;
+    if (avail >= 4 && be32(*(uint32_t *)ptr) == LZ77_MAGIC) {
+        stream->in_pos += 4;
+        ptr += 4;
+        avail -= 4;
+    }
+    else if (avail < 4 || (ptr[0] != 0x10 && ptr[0] != 0x11)) {
+        return 0; // Not compressed then
+    }
+
+    if (avail < 4 || (ptr[0] != 0x10 && ptr[0] != 0x11)) {
+        ERROR("Unsupported compression type %#x", (avail < 4) ? 0 : ptr[0]);
+        return -2;
+    }
+
+    stream->type = ptr[0];
+    stream->out_size = ptr[1] | ptr[2] << 8 | ptr[3] << 16;
+    stream->in_pos += 4;
+
+    // 0x11 can put a 32-bit size after a 0 one
+    if (stream->out_size == 0 && stream->type == 0x11) {
+        if (avail < 8) {
+            ERROR("LZ77 header is truncated");
+            return -2;
+        }
+
+        stream->out_size = ptr[4] | ptr[5] << 8 | ptr[6] << 16 | (unsigned int)ptr[7] << 24;
+        stream->in_pos += 4;
+    }
+
+    return 0;
+}
+
+int LZ77StreamInit(LZ77Stream* stream, const U8StreamIO* io, void* user, unsigned int base) {
+    assert(stream != NULL && io != NULL);
+
+    memset(stream, 0, sizeof(LZ77Stream));
+    stream->io   = io;
+    stream->user = user;
+    stream->base = base;
+    mbedtls_md5_init(&stream->md5);
+
+    return LZ77Start(stream);
+}
+
+void LZ77StreamFree(LZ77Stream* stream) {
+    mbedtls_md5_free(&stream->md5);
+}
+
+int LZ77StreamRead(LZ77Stream* stream, void* buf, unsigned int len) {
+    unsigned char* out = buf;
+    unsigned int produced = 0;
+    int byte;
+
+    if (stream->in_error)
+        return stream->in_error;
+
+    if (len > stream->out_size - stream->out_pos)
+        len = stream->out_size - stream->out_pos;
+
+    if (stream->type == 0x00) {
+        while (produced < len) {
+            if (stream->in_pos == stream->in_len && LZ77Refill(stream) <= 0)
+                break;
+
+            unsigned int count = stream->in_len - stream->in_pos;
+            if (count > len - produced)
+                count = len - produced;
+
+            memcpy(out + produced, stream->in_buf + stream->in_pos, count);
+            stream->in_pos += count;
+            produced += count;
+        }
+
+        stream->out_pos += produced;
+        return stream->in_error ? stream->in_error : (int)produced;
+    }
+
+    while (produced < len) {
+        // Back reference from last time (or just now)
+        if (stream->copy_len) {
+            unsigned int count = (stream->copy_len < len - produced) ? stream->copy_len : len - produced;
+            unsigned int src = stream->out_pos - stream->copy_disp;
+
+            for (unsigned int i = 0; i < count; i++) {
+                unsigned char c = stream->window[(src + i) % LZ77_WINDOW_SIZE];
+                stream->window[(stream->out_pos + i) % LZ77_WINDOW_SIZE] = c;
+                out[produced + i] = c;
+            }
+
+            stream->out_pos += count;
+            stream->copy_len -= count;
+            produced += count;
+            continue;
+        }
+
+        if (!stream->flag_bits) {
+            if ((byte = LZ77GetByte(stream)) < 0)
+                break;
+
+            stream->flags = byte;
+            stream->flag_bits = 8;
+        }
+
+        bool reference = stream->flags & 0x80;
+        stream->flags <<= 1;
+        stream->flag_bits--;
+
+        if ((byte = LZ77GetByte(stream)) < 0)
+            break;
+
+        if (!reference) {
+            stream->window[stream->out_pos++ % LZ77_WINDOW_SIZE] = byte;
+            out[produced++] = byte;
+            continue;
+        }
+
+        // Everything after the first byte, the longest being 0x11's 4 byte form
+        unsigned int b0 = byte, b[3];
+        unsigned int extra = 1;
+
+        if (stream->type == 0x11 && (b0 >> 4) <= 1)
+            extra = (b0 >> 4) ? 3 : 2;
+
+        for (unsigned int i = 0; i < extra; i++) {
+            if ((byte = LZ77GetByte(stream)) < 0)
+                break;
+
+            b[i] = byte;
+        }
+
+        if (byte < 0)
+            break;
+
+        if (extra == 1) {
+            stream->copy_len  = (b0 >> 4) + ((stream->type == 0x10) ? 3 : 1);
+            stream->copy_disp = ((b0 & 0xF) << 8 | b[0]) + 1;
+        }
+        else if (extra == 2) {
+            stream->copy_len  = ((b0 & 0xF) << 4 | b[0] >> 4) + 0x11;
+            stream->copy_disp = ((b[0] & 0xF) << 8 | b[1]) + 1;
+        }
+        else {
+            stream->copy_len  = ((b0 & 0xF) << 12 | b[0] << 4 | b[1] >> 4) + 0x111;
+            stream->copy_disp = ((b[1] & 0xF) << 8 | b[2]) + 1;
+        }
+
+        if (stream->copy_disp > stream->out_pos) {
+            ERROR("Back reference to before the start of the data (%#x > %#x)", stream->copy_disp, stream->out_pos);
+            return stream->in_error = -3;
+        }
+
+        if (stream->copy_len > stream->out_size - stream->out_pos)
+            stream->copy_len = stream->out_size - stream->out_pos;
+    }
+
+    if (stream->in_error)
+        return stream->in_error;
+
+    if (produced < len) {
+        ERROR("LZ77 data ends early (%#x of %#x bytes)", stream->out_pos, stream->out_size);
+        return stream->in_error = -4;
+    }
+
+    return produced;
+}
+
+int LZ77StreamSeek(LZ77Stream* stream, unsigned int offset) {
+    unsigned char temp[0x200];
+    int ret;
+
+    if (offset < stream->out_pos) {
+        ret = LZ77Start(stream);
+        if (ret < 0)
+            return ret;
+    }
+
+    while (stream->out_pos < offset) {
+        unsigned int len = (offset - stream->out_pos < sizeof(temp)) ? offset - stream->out_pos : sizeof(temp);
+
+        ret = LZ77StreamRead(stream, temp, len);
+        if (ret <= 0)
+            return (ret < 0) ? ret : -1;
+    }
+
+    return 0;
+}
+
+int LZ77StreamVerify(LZ77Stream* stream) {
+    if (!stream->has_md5)
+        return 0;
+
+    // The rest of the payload isn't needed for anything other than the hash
+    while (stream->md5_status > 0) {
+        int ret = LZ77Refill(stream);
+        if (ret <= 0)
+            break;
+    }
+
+    if (stream->md5_status > 0) {
+        ERROR("IMD5 payload is truncated");
+        return -1;
+    }
+
+    return stream->md5_status;
+}
+
+static int LZ77StreamIORead(void* user, void* buf, unsigned int len) {
+    return LZ77StreamRead(user, buf, len);
+}
+
+static int LZ77StreamIOSeek(void* user, unsigned int offset) {
+    return LZ77StreamSeek(user, offset);
+}
+
+const U8StreamIO LZ77StreamIO = { LZ77StreamIORead, LZ77StreamIOSeek };
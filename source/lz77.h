@@ -0,0 +1,55 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <mbedtls/md5.h>
+
+#include "u8stream.h"
+
+// Nintendo LZ77 (types 0x10 and 0x11) with the optional IMD5 header in front, as found on banner.bin/icon.bin/sound.bin.
+// Decodes as it reads, so it can sit between a U8StreamIO and U8StreamInit without the whole payload in memory.
+#define IMD5_MAGIC 0x494D4435 // IMD5
+#define LZ77_MAGIC 0x4C5A3737 // LZ77
+
+#define LZ77_WINDOW_SIZE 0x1000
+#define LZ77_INPUT_SIZE  0x1000
+
+typedef struct IMD5Header {
+    uint32_t magic;
+    uint32_t size; // Of everything after this header
+    uint8_t  padding[8];
+    uint8_t  md5_sum[16];
+} IMD5Header;
+_Static_assert(sizeof(IMD5Header) == 0x20, "Size of IMD5Header is not 0x20");
+
+typedef struct LZ77Stream {
+    unsigned char in_buf[LZ77_INPUT_SIZE] __attribute__((aligned(0x40)));
+    unsigned char window[LZ77_WINDOW_SIZE];
+
+    const U8StreamIO* io;
+    void* user;
+    unsigned int base;
+
+    int type; // 0x00: Stored, 0x10, 0x11
+    unsigned int out_size; // ~0 when it's stored and there's no IMD5 header to say how long it is
+    unsigned int out_pos;
+
+    unsigned int in_pos, in_len;
+    unsigned int in_left; // Until the end of the IMD5 payload
+    int in_error;
+
+    unsigned int flags, flag_bits;
+    unsigned int copy_len, copy_disp;
+
+    bool has_md5;
+    int md5_status; // 1: Still going, 0: Matched, < 0: Didn't
+    uint8_t md5_sum[16];
+    mbedtls_md5_context md5;
+} LZ77Stream;
+
+extern const U8StreamIO LZ77StreamIO; // user = LZ77Stream*. Reads come out decompressed
+
+int LZ77StreamInit(LZ77Stream* stream, const U8StreamIO* io, void* user, unsigned int base);
+int LZ77StreamRead(LZ77Stream* stream, void* buf, unsigned int len);
+int LZ77StreamSeek(LZ77Stream* stream, unsigned int offset); // Going backwards starts over from the top
+int LZ77StreamVerify(LZ77Stream* stream); // Reads whatever's left of the IMD5 payload. 0 if the MD5 matched or there wasn't one
+void LZ77StreamFree(LZ77Stream* stream);
@@ -5,6 +5,8 @@
 #include <errno.h>
 #include <stdint.h>
 #include <ctype.h>
+#include <dirent.h>
+#include <strings.h>
 #include <ogc/es.h>
 #include <gccore.h>
 #include <fat.h>
@@ -20,6 +22,15 @@
 #include "save.h"
 #include "identify.h"
 #include "wiimenu.h"
+#include "crypto.h"
+#include "hash.h"
+#include "restore.h"
+#include "manifest.h"
+#include "savediff.h"
+#include "settings.h"
+#include "tune.h"
+#include "wad.h"
+#include "protect.h"
 
 // snake case for snake year !!!
 
@@ -94,6 +105,7 @@ void free_category(title_category_t* category) {
 
 	free(category->title_list);
 	category->title_list = NULL;
+	category->num_titles = 0;
 }
 
 void free_all_categories(void) {
@@ -442,66 +454,15 @@ int uninstall_title(const title_t* title) {
 	if (!title->tmd_view)
 		goto clear;
 
-	if (title->tid_hi == 0x00000001) {
-		if (title->tid_lo == 0x00000002) {
-			// ?
-			exit(-1);
-		}
-
-		if (title->tid_lo == 0x00000001 ||
-		    title->tid_lo == 0x00000002 ||
-		    title->tid_lo == 0x00000100 ||
-		    title->tid_lo == 0x00000101 ||
-		    title->tid_lo == 0x00000102 ||
-		    title->tid_lo == 0x00000200 ||
-		    title->tid_lo == 0x00000201)
-		{
-			no_touchy_reason = "That's a system title.";
-			goto no_touchy;
-		}
-
-		if (title->tid_lo == 254 && title->tmd_view->title_version != 0xFF00) {
-			goto no_touchy;
-		}
-
-		title_t* wiimenu = find_title(0x0000000100000002);
-		if (!wiimenu) {
-			no_touchy_reason = "I can't find the Wii System Menu...?";
-			goto no_touchy;
-		}
-
-		if (title->id == wiimenu->tmd_view->sys_version) {
-			no_touchy_reason = "The Wii System Menu runs on this IOS!!!!";
-			goto no_touchy;
-		}
-
-		if (title->tid_lo != 0x00000000 && title->tid_lo < 200) {
-			no_touchy_reason = "I don't trust you with uninstalling normal IOS.";
-			goto no_touchy;
-		}
+	if (title->id == 0x0000000100000002) {
+		// ?
+		exit(-1);
 	}
-	else if (title->tid_hi == 0x00010008) {
-		uint32_t tid_superlow = title->tid_lo & ~0xFF;
-		if (tid_superlow != 0x48414B00 && tid_superlow != 0x48414C00) {
-			goto clear;
-		}
 
-		title_t* wiimenu = find_title(0x0000000100000002);
-		if (!wiimenu) {
-			no_touchy_reason = "I can't find the Wii System Menu...?";
-			goto no_touchy;
-		}
+	if ((no_touchy_reason = title_no_touchy(title->id, title->tmd_view->title_version, false)))
+		goto no_touchy;
 
-		if (wiimenu_version_is_official(wiimenu->tmd_view->title_version)) {
-			char region = wiimenu_region_table[1][wiimenu->tmd_view->title_version & 0x1F];
-			if (title->tid_lo == (tid_superlow ^ region)) {
-				goto no_touchy;
-			}
-		} else {
-			no_touchy_reason = "I can't determine the Wii System Menu's region!";
-			goto no_touchy;
-		}
-	} else if (title->tid_hi == 0x00010001) {
+	if (title->tid_hi == 0x00010001) {
 		if (title->tid_lo == 0x48415858 ||
 			title->tid_lo == 0x4A4F4449 ||
 			title->tid_lo == 0xAF1BF516 ||
@@ -557,12 +518,36 @@ no_touchy:
 	return -1017;
 }
 
-int dump_title_save(const title_t* title) {
-	int   ret;
-	FILE* fp = NULL;
-	char  name_short[4];
-	char  file_path[128];
-	char  tmp_path[32];
+// What the new data.bin changes compared to the one it's about to replace
+static void diff_with_previous(const char* old_path, const char* new_path) {
+	struct save_diff_stats stats;
+
+	FILE* old_fp = fopen(old_path, "rb");
+	FILE* new_fp = old_fp ? fopen(new_path, "rb") : NULL;
+	if (new_fp) {
+		puts("Changes since the last dump:");
+		int ret = save_diff(old_fp, new_fp, &stats);
+		if (ret == 0)
+			puts("None.");
+		else if (ret > 0)
+			printf("%u added, %u removed, %u changed (%u blocks)\n", stats.added, stats.removed, stats.changed, stats.changed_blocks);
+	}
+
+	if (new_fp)
+		fclose(new_fp);
+
+	if (old_fp)
+		fclose(old_fp);
+}
+
+int dump_title_save(const title_t* title, bool incremental) {
+	int               ret;
+	FILE*             fp = NULL;
+	char              name_short[4];
+	char              file_path[128];
+	char              tmp_path[32];
+	struct file_table manifest = {};
+	uint32_t          data_bin_size;
 
 	if (!(
 		title->tid_hi == 0x00010000 ||
@@ -582,7 +567,19 @@ int dump_title_save(const title_t* title) {
 	sprintf(file_path, "/private/wii/title/%.4s/data.bin", name_short);
 
 	struct stat st;
-	if (!stat(file_path, &st)) {
+	bool exists = !stat(file_path, &st);
+
+	// The data.bin from last time has to still be there (and be the one the manifest was made with)
+	if (incremental && manifest_load(title->id, &manifest, &data_bin_size) == 0) {
+		ret = (exists && st.st_size == data_bin_size) ? save_unchanged(title->id, &manifest) : 0;
+		free_file_table(&manifest);
+		if (ret == 1) {
+			puts("Nothing changed since the last dump, skipping.");
+			return 0;
+		}
+	}
+
+	if (exists && !incremental) {
 		puts(file_path);
 		puts("File already exists! Overwrite?");
 
@@ -598,29 +595,115 @@ int dump_title_save(const title_t* title) {
 		return -3;
 	}
 
-	ret = export_save(title->id, fp);
+	setvbuf(fp, NULL, _IOFBF, save_get_chunk_size(SAVE_STAGE_SD));
+
+	ret = export_save(title->id, fp, incremental ? &manifest : NULL);
 	fclose(fp);
 	if (ret == 0) {
-		rename(tmp_path, file_path);
+		if (exists)
+			diff_with_previous(file_path, tmp_path);
+
+		// The manifest is only any good if the data.bin it goes with made it into place
+		if (rename(tmp_path, file_path) == 0 && incremental && !stat(file_path, &st))
+			manifest_save(title->id, &manifest, st.st_size);
+
+		free_file_table(&manifest);
 	}
 
 	return ret;
 }
 
-int extract_title_save(const title_t* title) {
+int extract_title_save(const title_t* title, bool tar) {
 	int  ret;
-	char dir_path[64];
+	char out_path[64];
+
+	if (!try_name_short(title->id, out_path))
+		sprintf(out_path, "%016llx", title->id);
+
+	if (tar) {
+		strcat(out_path, ".tar");
+	}
+	else {
+		ret = mkdir(out_path, 0644);
+		if (ret < 0 && errno != EEXIST) {
+			perror(out_path);
+			return -errno;
+		}
+	}
+
+	ret = extract_save(title->id, out_path, tar);
 
-	if (!try_name_short(title->id, dir_path))
-		sprintf(dir_path, "%016llx", title->id);
+	// Half a tar is no use to anyone
+	if (ret < 0 && tar)
+		remove(out_path);
+
+	return ret;
+}
+
+int restore_title_save(const title_t* title) {
+	int   ret;
+	FILE* fp = NULL;
+	char  name_short[4];
+	char  file_path[128];
+
+	if (!try_name_short(title->id, name_short)) {
+		puts("try_name_short() said no");
+		return -2;
+	}
+
+	sprintf(file_path, "/private/wii/title/%.4s/data.bin", name_short);
 
-	ret = mkdir(dir_path, 0644);
-	if (ret < 0 && errno != EEXIST) {
-		perror(dir_path);
+	fp = fopen(file_path, "rb");
+	if (!fp) {
+		perror(file_path);
 		return -errno;
 	}
 
-	ret = extract_save(title->id, dir_path);
+	puts(file_path);
+	puts("This will replace the save data on the console. Continue?");
+
+	sleep(2);
+	puts("Press +/START to confirm. \nPress any other button to cancel.");
+	if (!(wait_button(0) & WPAD_BUTTON_PLUS)) {
+		fclose(fp);
+		return -1;
+	}
+
+	ret = import_save(title->id, fp);
+	fclose(fp);
+	if (ret == 0)
+		puts("Save data restored.");
+
+	return ret;
+}
+
+int restore_title_save_extracted(const title_t* title, bool tar) {
+	int         ret;
+	char        in_path[64];
+	struct stat st;
+
+	if (!try_name_short(title->id, in_path))
+		sprintf(in_path, "%016llx", title->id);
+
+	if (tar)
+		strcat(in_path, ".tar");
+
+	if (stat(in_path, &st) < 0) {
+		perror(in_path);
+		return -errno;
+	}
+
+	puts(in_path);
+	puts("This will replace the save data on the console. Continue?");
+
+	sleep(2);
+	puts("Press +/START to confirm. \nPress any other button to cancel.");
+	if (!(wait_button(0) & WPAD_BUTTON_PLUS))
+		return -1;
+
+	ret = tar ? import_save_tar(title->id, in_path) : import_save_dir(title->id, in_path);
+	if (ret == 0)
+		puts("Save data restored.");
 
 	return ret;
 }
@@ -629,6 +712,7 @@ int dump_title_content(const title_t* title) {
 	int   ret;
 	FILE* fp = NULL;
 	char  tmp_path[32];
+	char  journal_path[32];
 	char  file_path[128];
 	char  name_short[4];
 
@@ -638,6 +722,7 @@ int dump_title_content(const title_t* title) {
 	}
 
 	sprintf(tmp_path,  "$~%.4sCONTENT.bin", name_short);
+	sprintf(journal_path, "$~%.4sCONTENT.jnl", name_short);
 	sprintf(file_path, "/private/wii/title/%.4s/content.bin", name_short);
 
 	struct stat st;
@@ -651,20 +736,84 @@ int dump_title_content(const title_t* title) {
 			return -1;
 	}
 
-	fp = fopen(tmp_path, "wb");
+	// Whatever's left from last time stays, export_content() works out if it's any good
+	fp = fopen(tmp_path, "r+b") ?: fopen(tmp_path, "wb");
 	if (!fp) {
 		perror(tmp_path);
 		return -3;
 	}
 
-	ret = export_content(title->id, fp);
-	fclose(fp);
+	setvbuf(fp, NULL, _IOFBF, save_get_chunk_size(SAVE_STAGE_SD));
+
+	ret = export_content(title->id, fp, journal_path);
+	if (fclose(fp) != 0 && ret == 0)
+		ret = -errno;
+
 	if (ret == 0)
 		rename(tmp_path, file_path);
+	else
+		printf("%s is kept, dumping this title again carries on from where it stopped\n", tmp_path);
+
+	return ret;
+}
+
+int dump_title_wad(const title_t* title) {
+	int   ret;
+	FILE* fp = NULL;
+	char  name_short[4];
+	char  file_path[64];
+
+	mkdir("/title_manager", 0755);
+	mkdir(WAD_DIR, 0755);
+	if (!try_name_short(title->id, name_short))
+		sprintf(file_path, WAD_DIR "/%016llx.wad", title->id);
+	else
+		sprintf(file_path, WAD_DIR "/%.4s-v%hu.wad", name_short, title->tmd_view ? title->tmd_view->title_version : 0);
+
+	struct stat st;
+	if (!stat(file_path, &st)) {
+		puts(file_path);
+		puts("File already exists! Overwrite?");
+
+		sleep(2);
+		puts("Press +/START to confirm. \nPress any other button to cancel.");
+		if (!(wait_button(0) & WPAD_BUTTON_PLUS))
+			return -1;
+	}
+
+	fp = fopen(file_path, "wb");
+	if (!fp) {
+		perror(file_path);
+		return -3;
+	}
+
+	setvbuf(fp, NULL, _IOFBF, save_get_chunk_size(SAVE_STAGE_SD));
+
+	ret = export_wad(title->id, fp);
+	if (fclose(fp) != 0 && ret == 0)
+		ret = -errno;
+
+	// Nothing would install half a WAD anyways
+	if (ret < 0)
+		remove(file_path);
+	else
+		printf("Saved to %s\n", file_path);
 
 	return ret;
 }
 
+int extract_title_banner(const title_t* title, bool tar) {
+	char name_short[4];
+	char out_path[64];
+
+	if (!try_name_short(title->id, name_short))
+		sprintf(out_path, "%016llx_banner%s", title->id, tar ? ".tar" : "");
+	else
+		sprintf(out_path, "%.4s_banner%s", name_short, tar ? ".tar" : "");
+
+	return extract_banner(title->id, out_path, tar);
+}
+
 void print_title_header(const void* p) {
 	const title_t* title = p;
 
@@ -687,9 +836,16 @@ void manage_title_menu(const void* p) {
 	int                  cursor = 0;
 	const char* const options[] = { "Uninstall this title",
 	                                "Dump save data (data.bin)",
+	                                "Dump save data (incremental)",
 	                                "Dump save data (extract)",
+	                                "Dump save data (.tar)",
+	                                "Restore save data (data.bin)",
+	                                "Restore save data (extract)",
+	                                "Restore save data (.tar)",
 	                                "Dump title (content.bin)",
-	                                "Dump title (.wad) (X)" };
+	                                "Dump banner (extract)",
+	                                "Dump banner (.tar)",
+	                                "Dump title (.wad)" };
 	const int       num_options = sizeof(options) / sizeof(*options);
 
 	while (true) {
@@ -729,17 +885,49 @@ void manage_title_menu(const void* p) {
 					} break;
 
 					case 1: {
-						dump_title_save(title);
+						dump_title_save(title, false);
 					} break;
 
 					case 2: {
-						extract_title_save(title);
+						dump_title_save(title, true);
 					} break;
 
 					case 3: {
+						extract_title_save(title, false);
+					} break;
+
+					case 4: {
+						extract_title_save(title, true);
+					} break;
+
+					case 5: {
+						restore_title_save(title);
+					} break;
+
+					case 6: {
+						restore_title_save_extracted(title, false);
+					} break;
+
+					case 7: {
+						restore_title_save_extracted(title, true);
+					} break;
+
+					case 8: {
 						dump_title_content(title);
 					} break;
 
+					case 9: {
+						extract_title_banner(title, false);
+					} break;
+
+					case 10: {
+						extract_title_banner(title, true);
+					} break;
+
+					case 11: {
+						dump_title_wad(title);
+					} break;
+
 					default: {
 						puts("Unimplemented. Sorry.");
 					} break;
@@ -802,6 +990,224 @@ const char* name_category(const void* p, char buffer[256]) {
 	return buffer;
 }
 
+void browse_titles(void) {
+	menu_item_list_t category_list = {
+		.items        = g_categories,
+		.item_size    = sizeof(title_category_t),
+		.num_items    = g_num_categories,
+		.get_name     = name_category,
+		.select       = manage_category_menu,
+	};
+
+	ItemMenu(&category_list);
+}
+
+void calibrate_chunk_sizes(void) {
+	// Any downloadable channel will do for timing the content exports
+	uint64_t title_id = 0;
+
+	for (const title_category_t* cat = g_categories; cat - g_categories < g_num_categories; cat++) {
+		if (cat->tid_hi == 0x00010001) {
+			if (cat->num_titles)
+				title_id = cat->title_list[0].id;
+
+			break;
+		}
+	}
+
+	print_this_dumb_header();
+	puts("Timing NAND reads, content exports, SD encryption and SD writes, this takes a minute...\n");
+
+	int ret = tune_chunk_sizes(title_id);
+	if (ret < 0) {
+		print_error("tune_chunk_sizes", ret);
+	}
+	else if ((ret = settings_save()) == 0) {
+		printf("\nSaved to %s\n", SETTINGS_PATH);
+	}
+
+	puts("Press any button to continue...");
+	wait_button(0);
+}
+
+// Files on SD that something can be installed from, for the root menu
+typedef struct install_file {
+	char name[64];  // What the menu shows. Empty for "all of them"
+	char path[192];
+} install_file_t;
+
+static install_file_t* g_install_files;
+static unsigned        g_num_install_files;
+static int           (*g_install)(FILE* fp);
+
+static bool add_install_file(const char* name, const char* path) {
+	install_file_t* temp = reallocarray(g_install_files, g_num_install_files + 1, sizeof(install_file_t));
+	if (!temp)
+		return false;
+
+	g_install_files = temp;
+	temp += g_num_install_files++;
+	snprintf(temp->name, sizeof(temp->name), "%s", name);
+	snprintf(temp->path, sizeof(temp->path), "%s", path);
+	return true;
+}
+
+int install_file(const install_file_t* file) {
+	int ret;
+
+	FILE* fp = fopen(file->path, "rb");
+	if (!fp) {
+		perror(file->path);
+		return -errno;
+	}
+
+	setvbuf(fp, NULL, _IOFBF, save_get_chunk_size(SAVE_STAGE_SD));
+
+	printf("\nInstalling %s\n", file->path);
+	ret = g_install(fp);
+	fclose(fp);
+	if (ret < 0)
+		printf("Failed to install %s (ret=%i)\n", file->path, ret);
+
+	return ret;
+}
+
+const char* name_install_file(const void* p, char buffer[256]) {
+	const install_file_t* file = p;
+
+	if (!*file->name) {
+		snprintf(buffer, 256, "Install all of them (%u)", g_num_install_files - 1);
+		return buffer;
+	}
+
+	return file->name;
+}
+
+void select_install_file(const void* p) {
+	const install_file_t* file = p;
+	unsigned              failed = 0;
+
+	print_this_dumb_header();
+	if (*file->name) {
+		failed = install_file(file) < 0;
+	}
+	else for (unsigned i = 1; i < g_num_install_files; i++) {
+		if (install_file(&g_install_files[i]) < 0)
+			failed++;
+	}
+
+	if (failed)
+		printf("\n%u failed.\n", failed);
+	else
+		puts("\nDone!");
+
+	// Whatever went in should show up in there
+	free_all_categories();
+	populate_title_categories();
+
+	puts("Press any button to continue...");
+	wait_button(0);
+}
+
+// Whatever add_install_file() found, behind "all of them"
+void install_file_menu(int (*install)(FILE* fp), const char* what) {
+	if (g_num_install_files < 2) {
+		printf("No %s found. Press any button to continue...\n", what);
+		wait_button(0);
+	}
+	else {
+		menu_item_list_t file_list = {
+			.items        = g_install_files,
+			.item_size    = sizeof(install_file_t),
+			.num_items    = g_num_install_files,
+			.get_name     = name_install_file,
+			.select       = select_install_file,
+		};
+
+		g_install = install;
+		ItemMenu(&file_list);
+	}
+
+	free(g_install_files);
+	g_install_files = NULL;
+	g_num_install_files = 0;
+}
+
+void install_wads(void) {
+	DIR*           dir;
+	struct dirent* ent;
+	char           path[192];
+
+	if (!(dir = opendir(WAD_DIR))) {
+		perror(WAD_DIR);
+		puts("Put .wad files in there to install them. Press any button to continue...");
+		wait_button(0);
+		return;
+	}
+
+	add_install_file("", "");
+	while ((ent = readdir(dir))) {
+		size_t len = strlen(ent->d_name);
+		if (len < 5 || len >= 64 || strcasecmp(ent->d_name + len - 4, ".wad"))
+			continue;
+
+		sprintf(path, WAD_DIR "/%s", ent->d_name);
+		if (!add_install_file(ent->d_name, path))
+			break;
+	}
+	closedir(dir);
+
+	install_file_menu(install_wad, "WADs in " WAD_DIR);
+}
+
+// Same place Data Management keeps them, /private/wii/title/<ID4>/content.bin
+void import_content_bins(void) {
+	DIR*           dir;
+	struct dirent* ent;
+	struct stat    st;
+	char           path[192];
+
+	if (!(dir = opendir(CONTENT_BIN_DIR))) {
+		perror(CONTENT_BIN_DIR);
+		puts("Press any button to continue...");
+		wait_button(0);
+		return;
+	}
+
+	add_install_file("", "");
+	while ((ent = readdir(dir))) {
+		if (strlen(ent->d_name) != 4)
+			continue;
+
+		sprintf(path, CONTENT_BIN_DIR "/%.4s/content.bin", ent->d_name);
+		if (stat(path, &st) == 0 && !add_install_file(ent->d_name, path))
+			break;
+	}
+	closedir(dir);
+
+	install_file_menu(import_content, "content.bin files in " CONTENT_BIN_DIR);
+}
+
+typedef struct main_option {
+	const char* name;
+	void      (*run)(void);
+} main_option_t;
+
+static const main_option_t main_options[] = {
+	{ "Manage titles",         browse_titles },
+	{ "Install WADs",          install_wads },
+	{ "Import content.bin",    import_content_bins },
+	{ "Calibrate chunk sizes", calibrate_chunk_sizes },
+};
+
+const char* name_main_option(const void* p, char buffer[256]) {
+	return ((const main_option_t *)p)->name;
+}
+
+void run_main_option(const void* p) {
+	((const main_option_t *)p)->run();
+}
+
 extern void __exception_setreload(int seconds);
 
 int main(int argc, char* argv[]) {
@@ -820,20 +1226,35 @@ int main(int argc, char* argv[]) {
 	fatInitDefault();
 
 	identify_sm();
+	crypto_init();
+	settings_load();
 	populate_title_categories();
-	puts("Press any button to continue...");
-	wait_button(0);
+	puts("Press 1 to benchmark SD encryption/hashing, any other button to continue...");
+	if (wait_button(0) & WPAD_BUTTON_1) {
+		void* temp = aligned_alloc(0x40, 0x40000);
+		if (temp) {
+			crypto_benchmark(temp, 0x40000);
+			sha1_benchmark(temp, 0x40000);
+			free(temp);
+		}
 
-	menu_item_list_t category_list = {
-		.items        = g_categories,
-		.item_size    = sizeof(title_category_t),
-		.num_items    = g_num_categories,
-		.get_name     = name_category,
-		.select       = manage_category_menu,
+		printf("\nUsing %s for AES and %s for SHA-1. crypto_backend and sha1_backend in %s pick them.\n",
+			crypto_backend_names[crypto_get_backend()], sha1_backend_names[sha1_get_backend()], SETTINGS_PATH);
+
+		puts("Press any button to continue...");
+		wait_button(0);
+	}
+
+	menu_item_list_t main_list = {
+		.items        = main_options,
+		.item_size    = sizeof(*main_options),
+		.num_items    = sizeof(main_options) / sizeof(*main_options),
+		.get_name     = name_main_option,
+		.select       = run_main_option,
 	};
 
 	// wait_button(0);
-	ItemMenu(&category_list);
+	ItemMenu(&main_list);
 
 	free_all_categories();
 	stoppads();
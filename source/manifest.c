@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "manifest.h"
+
+#define MANIFEST_MAGIC "title_manager manifest 1"
+
+static void manifest_path(uint64_t title_id, char* path, const char* suffix) {
+	sprintf(path, MANIFEST_DIR "/%016llx.txt%s", (unsigned long long)title_id, suffix);
+}
+
+int manifest_load(uint64_t title_id, struct file_table* table, uint32_t* data_bin_size) {
+	int                ret = 0;
+	char               path[64];
+	char               line[256];
+	unsigned long long id;
+
+	*table = (struct file_table){};
+	manifest_path(title_id, path, "");
+
+	FILE* fp = fopen(path, "r");
+	if (!fp)
+		return -errno;
+
+	// Header: magic, title ID, data.bin size
+	if (!fgets(line, sizeof(line), fp) || strncmp(line, MANIFEST_MAGIC " ", sizeof(MANIFEST_MAGIC))
+	||  sscanf(line + sizeof(MANIFEST_MAGIC), "%llx %x", &id, data_bin_size) != 2 || id != title_id)
+	{
+		fprintf(stderr, "%s: Not a manifest for %016llx\n", path, (unsigned long long)title_id);
+		fclose(fp);
+		return -EINVAL;
+	}
+
+	// <f|d> <size> <attributes> <permissions> <sha1> <path>
+	while (fgets(line, sizeof(line), fp)) {
+		char     type, hash[41];
+		unsigned size, attributes, permissions;
+		int      path_start = 0;
+
+		line[strcspn(line, "\n")] = 0;
+		if (sscanf(line, "%c %x %x %x %40s %n", &type, &size, &attributes, &permissions, hash, &path_start) != 5
+		||  !path_start || !line[path_start] || (type != 'f' && type != 'd') || strlen(hash) != 40)
+		{
+			fprintf(stderr, "%s: Bad line \"%s\"\n", path, line);
+			ret = -EINVAL;
+			break;
+		}
+
+		struct file_entry* entry = file_table_add(table, line + path_start);
+		if (!entry) {
+			ret = -ENOMEM;
+			break;
+		}
+
+		entry->type        = (type == 'd') ? 2 : 1;
+		entry->file_size   = size;
+		entry->attributes  = attributes;
+		entry->permissions = permissions;
+		for (int i = 0; i < sizeof(entry->sha1); i++)
+			sscanf(hash + i * 2, "%2hhx", &entry->sha1[i]);
+	}
+
+	fclose(fp);
+	if (ret < 0)
+		free_file_table(table);
+
+	return ret;
+}
+
+int manifest_save(uint64_t title_id, const struct file_table* table, uint32_t data_bin_size) {
+	char path[64], temp_path[64];
+
+	mkdir("/title_manager", 0755);
+	mkdir(MANIFEST_DIR, 0755);
+
+	manifest_path(title_id, path, "");
+	manifest_path(title_id, temp_path, ".tmp");
+
+	FILE* fp = fopen(temp_path, "w");
+	if (!fp) {
+		perror(temp_path);
+		return -errno;
+	}
+
+	fprintf(fp, MANIFEST_MAGIC " %016llx %x\n", (unsigned long long)title_id, data_bin_size);
+	for (const struct file_entry* entry = table->entries; entry - table->entries < table->num_entries; entry++) {
+		fprintf(fp, "%c %x %x %x ", (entry->type == 2) ? 'd' : 'f', entry->file_size, entry->attributes, entry->permissions);
+		for (int i = 0; i < sizeof(entry->sha1); i++)
+			fprintf(fp, "%02x", entry->sha1[i]);
+
+		fprintf(fp, " %s\n", entry->relative_path);
+	}
+
+	// Half a manifest is worse than an old one
+	int failed = ferror(fp);
+	if (fclose(fp) != 0 || failed) {
+		perror(temp_path);
+		remove(temp_path);
+		return -EIO;
+	}
+
+	remove(path);
+	if (rename(temp_path, path) < 0) {
+		perror(path);
+		return -errno;
+	}
+
+	return 0;
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include <stdint.h>
+#include "filetable.h"
+
+// What a save looked like when it was last dumped, one per title: every entry of its file table with a SHA-1 of each file.
+// Plain text, so it's easy to look at (and diff) on a PC.
+
+#define MANIFEST_DIR "/title_manager/manifest"
+
+// -ENOENT when there's no manifest yet. data_bin_size is how big the data.bin made alongside it was
+int  manifest_load(uint64_t title_id, struct file_table* table, uint32_t* data_bin_size);
+int  manifest_save(uint64_t title_id, const struct file_table* table, uint32_t data_bin_size);
@@ -0,0 +1,377 @@
+#ifndef GEKKO
+#define _XOPEN_SOURCE 700 // nftw
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "nand.h"
+
+unsigned int nand_ipc_count;
+
+#ifdef GEKKO
+#include <ogc/es.h>
+
+// IOS wants paths 0x20 aligned
+#define ALIGNED_PATH(name, path) \
+	char name[NAND_MAXPATH] __attribute__((aligned(0x20))); \
+	if (strlen(path) >= NAND_MAXPATH) return ISFS_EINVAL; \
+	strcpy(name, path);
+
+int nand_get_data_dir(uint64_t title_id, char path[NAND_MAXPATH]) {
+	char temp[NAND_MAXPATH] __attribute__((aligned(0x20)));
+
+	nand_ipc_count++;
+	int ret = ES_GetDataDir(title_id, temp);
+	if (ret >= 0)
+		strcpy(path, temp);
+
+	return ret;
+}
+
+int nand_create_dir(const char* path, uint8_t attributes, uint8_t permissions) {
+	ALIGNED_PATH(apath, path);
+	nand_ipc_count++;
+	return ISFS_CreateDir(apath, attributes, (permissions >> 4) & 3, (permissions >> 2) & 3, permissions & 3);
+}
+
+int nand_create_file(const char* path, uint8_t attributes, uint8_t permissions) {
+	ALIGNED_PATH(apath, path);
+	nand_ipc_count++;
+	return ISFS_CreateFile(apath, attributes, (permissions >> 4) & 3, (permissions >> 2) & 3, permissions & 3);
+}
+
+int nand_get_attr(const char* path, uint8_t* attributes, uint8_t* permissions) {
+	uint32_t owner_id;
+	uint16_t group_id;
+	uint8_t  perm_owner, perm_group, perm_other;
+
+	ALIGNED_PATH(apath, path);
+	nand_ipc_count++;
+	int ret = ISFS_GetAttr(apath, &owner_id, &group_id, attributes, &perm_owner, &perm_group, &perm_other);
+	if (ret < 0)
+		return ret;
+
+	*permissions = (perm_owner & 3) << 4 | (perm_group & 3) << 2 | (perm_other & 3);
+	return 0;
+}
+
+int nand_open(const char* path, int mode) {
+	ALIGNED_PATH(apath, path);
+	nand_ipc_count++;
+	return ISFS_Open(apath, mode);
+}
+
+int nand_read_dir(const char* path, char* names, uint32_t* count) {
+	ALIGNED_PATH(apath, path);
+	nand_ipc_count++;
+	return ISFS_ReadDir(apath, names, count);
+}
+
+int nand_get_file_size(int fd, uint32_t* size) {
+	fstats stats __attribute__((aligned(0x20)));
+
+	nand_ipc_count++;
+	int ret = ISFS_GetFileStats(fd, &stats);
+	if (ret >= 0)
+		*size = stats.file_length;
+
+	return ret;
+}
+
+int nand_read(int fd, void* buf, unsigned int len) {
+	nand_ipc_count++;
+	return ISFS_Read(fd, buf, len);
+}
+
+int nand_read_async(int fd, void* buf, unsigned int len, nand_callback callback, void* user) {
+	nand_ipc_count++;
+	return ISFS_ReadAsync(fd, buf, len, (isfscallback)callback, user);
+}
+
+int nand_write(int fd, const void* buf, unsigned int len) {
+	nand_ipc_count++;
+	return ISFS_Write(fd, buf, len);
+}
+
+int nand_close(int fd) {
+	nand_ipc_count++;
+	return ISFS_Close(fd);
+}
+
+int nand_delete(const char* path) {
+	ALIGNED_PATH(apath, path);
+	nand_ipc_count++;
+	return ISFS_Delete(apath);
+}
+
+int nand_rename(const char* from, const char* to) {
+	ALIGNED_PATH(afrom, from);
+	ALIGNED_PATH(ato, to);
+	nand_ipc_count++;
+	return ISFS_Rename(afrom, ato);
+}
+
+int nand_get_free_space(uint32_t* bytes, uint32_t* inodes) {
+	// What ISFS_GetStats hands back, not in libogc
+	struct {
+		uint32_t block_size;
+		uint32_t free_blocks, used_blocks, bad_blocks, reserved_blocks;
+		uint32_t free_inodes, used_inodes;
+	} stats __attribute__((aligned(0x20)));
+
+	nand_ipc_count++;
+	int ret = ISFS_GetStats(&stats);
+	if (ret < 0)
+		return ret;
+
+	*bytes  = stats.free_blocks * stats.block_size;
+	*inodes = stats.free_inodes;
+	return 0;
+}
+
+#else
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <ftw.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+
+static char nand_root[4096] = ".";
+static unsigned int latency_call, latency_kib;
+
+void nand_set_root(const char* path) {
+	snprintf(nand_root, sizeof(nand_root), "%s", path);
+}
+
+void nand_set_latency(unsigned int usec_per_call, unsigned int usec_per_kib) {
+	latency_call = usec_per_call;
+	latency_kib  = usec_per_kib;
+}
+
+static void host_delay(unsigned int len) {
+	unsigned long long usec = latency_call + (unsigned long long)latency_kib * len / 1024;
+	if (usec)
+		nanosleep(&(struct timespec){ usec / 1000000, usec % 1000000 * 1000 }, NULL);
+}
+
+// Stands in for IOS: one thread working through async requests in the order they came in
+struct host_request {
+	int                  fd;
+	void                *buf;
+	unsigned int         len;
+	nand_callback        callback;
+	void                *user;
+	struct host_request *next;
+};
+
+static pthread_once_t       ios_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t      ios_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t       ios_cond = PTHREAD_COND_INITIALIZER;
+static struct host_request *ios_head, *ios_tail;
+
+static void* ios_thread(void* arg) {
+	while (true) {
+		pthread_mutex_lock(&ios_lock);
+		while (!ios_head)
+			pthread_cond_wait(&ios_cond, &ios_lock);
+
+		struct host_request* req = ios_head;
+		if (!(ios_head = req->next))
+			ios_tail = NULL;
+		pthread_mutex_unlock(&ios_lock);
+
+		host_delay(req->len);
+		ssize_t ret = read(req->fd, req->buf, req->len);
+		req->callback((ret < 0) ? -errno : ret, req->user);
+		free(req);
+	}
+
+	return NULL;
+}
+
+static void ios_start(void) {
+	pthread_t thread;
+
+	if (pthread_create(&thread, NULL, ios_thread, NULL) == 0)
+		pthread_detach(thread);
+}
+
+#define HOST_PATH(name, path) \
+	char name[4096 + NAND_MAXPATH]; \
+	if (strlen(path) >= NAND_MAXPATH) return -EINVAL; \
+	sprintf(name, "%s%s", nand_root, path);
+
+int nand_get_data_dir(uint64_t title_id, char path[NAND_MAXPATH]) {
+	nand_ipc_count++;
+	sprintf(path, "/title/%08x/%08x/data", (uint32_t)(title_id >> 32), (uint32_t)title_id);
+	return 0;
+}
+
+// Permissions and attributes don't mean anything here, only the owner's go through
+static mode_t host_mode(uint8_t permissions, mode_t exec) {
+	return ((permissions & 0x10) ? 0400 | exec : 0) | ((permissions & 0x20) ? 0200 : 0);
+}
+
+int nand_create_dir(const char* path, uint8_t attributes, uint8_t permissions) {
+	HOST_PATH(hpath, path);
+	nand_ipc_count++;
+	return (mkdir(hpath, host_mode(permissions, 0100) | 0700) < 0) ? -errno : 0;
+}
+
+int nand_create_file(const char* path, uint8_t attributes, uint8_t permissions) {
+	HOST_PATH(hpath, path);
+	nand_ipc_count++;
+	int fd = open(hpath, O_WRONLY | O_CREAT | O_EXCL, host_mode(permissions, 0) | 0600);
+	if (fd < 0)
+		return -errno;
+
+	close(fd);
+	return 0;
+}
+
+int nand_get_attr(const char* path, uint8_t* attributes, uint8_t* permissions) {
+	struct stat st;
+
+	HOST_PATH(hpath, path);
+	nand_ipc_count++;
+	if (stat(hpath, &st) < 0)
+		return -errno;
+
+	*attributes  = 0;
+	*permissions = 0x3C; // Owner and group read/write, like most saves
+	return 0;
+}
+
+int nand_open(const char* path, int mode) {
+	struct stat st;
+
+	HOST_PATH(hpath, path);
+	nand_ipc_count++;
+	int fd = open(hpath, (mode == NAND_OPEN_READ) ? O_RDONLY : (mode == NAND_OPEN_WRITE) ? O_WRONLY : O_RDWR);
+	if (fd < 0)
+		return -errno;
+
+	// Same as IOS, directories can't be opened
+	if (fstat(fd, &st) == 0 && S_ISDIR(st.st_mode)) {
+		close(fd);
+		return NAND_EINVAL;
+	}
+
+	return fd;
+}
+
+int nand_read_dir(const char* path, char* names, uint32_t* count) {
+	HOST_PATH(hpath, path);
+	nand_ipc_count++;
+	DIR* dir = opendir(hpath);
+	if (!dir)
+		return (errno == ENOTDIR) ? NAND_EINVAL : -errno;
+
+	uint32_t found = 0;
+	struct dirent* ent;
+	while ((ent = readdir(dir)) && (!names || found < *count)) {
+		if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+			continue;
+
+		if (names)
+			names = stpcpy(names, ent->d_name) + 1;
+
+		found++;
+	}
+
+	closedir(dir);
+	*count = found;
+	return 0;
+}
+
+int nand_get_file_size(int fd, uint32_t* size) {
+	struct stat st;
+
+	nand_ipc_count++;
+	if (fstat(fd, &st) < 0)
+		return -errno;
+
+	*size = st.st_size;
+	return 0;
+}
+
+int nand_read(int fd, void* buf, unsigned int len) {
+	nand_ipc_count++;
+	host_delay(len);
+	ssize_t ret = read(fd, buf, len);
+	return (ret < 0) ? -errno : ret;
+}
+
+int nand_read_async(int fd, void* buf, unsigned int len, nand_callback callback, void* user) {
+	struct host_request* req = malloc(sizeof(struct host_request));
+	if (!req)
+		return -ENOMEM;
+
+	*req = (struct host_request){ fd, buf, len, callback, user, NULL };
+	nand_ipc_count++;
+	pthread_once(&ios_once, ios_start);
+
+	pthread_mutex_lock(&ios_lock);
+	if (ios_tail)
+		ios_tail->next = req;
+	else
+		ios_head = req;
+	ios_tail = req;
+	pthread_cond_signal(&ios_cond);
+	pthread_mutex_unlock(&ios_lock);
+	return 0;
+}
+
+int nand_write(int fd, const void* buf, unsigned int len) {
+	nand_ipc_count++;
+	host_delay(len);
+	ssize_t ret = write(fd, buf, len);
+	return (ret < 0) ? -errno : ret;
+}
+
+int nand_close(int fd) {
+	nand_ipc_count++;
+	return (close(fd) < 0) ? -errno : 0;
+}
+
+static int nand_delete_one(const char* path, const struct stat* st, int type, struct FTW* ftw) {
+	return remove(path);
+}
+
+int nand_delete(const char* path) {
+	HOST_PATH(hpath, path);
+	nand_ipc_count++;
+	struct stat st;
+
+	if (lstat(hpath, &st) < 0)
+		return -errno;
+
+	return (nftw(hpath, nand_delete_one, 16, FTW_DEPTH | FTW_PHYS) < 0) ? -errno : 0;
+}
+
+int nand_rename(const char* from, const char* to) {
+	HOST_PATH(hfrom, from);
+	HOST_PATH(hto, to);
+	nand_ipc_count++;
+	return (rename(hfrom, hto) < 0) ? -errno : 0;
+}
+
+int nand_get_free_space(uint32_t* bytes, uint32_t* inodes) {
+	struct statvfs st;
+
+	nand_ipc_count++;
+	if (statvfs(nand_root, &st) < 0)
+		return -errno;
+
+	// Never more than a real NAND could have
+	uint64_t free = (uint64_t)st.f_bavail * st.f_frsize;
+	*bytes  = (free > 0x20000000) ? 0x20000000 : free;
+	*inodes = (st.f_favail > 0x17FF) ? 0x17FF : st.f_favail;
+	return 0;
+}
+#endif
@@ -0,0 +1,51 @@
+#pragma once
+#include <stdint.h>
+
+// Just enough of ISFS to walk saves and put them back. On host builds a plain directory stands in for the NAND, see nand_set_root().
+// Permissions are packed like they are in data.bin: owner << 4 | group << 2 | other, 2 bits each.
+
+#define NAND_MAXPATH 64
+#define NAND_DATA_DIR_LEN 29 // strlen("/title/00010000/xxxxxxxx/data")
+
+#ifdef GEKKO
+#include <ogc/isfs.h>
+
+#define NAND_EINVAL ISFS_EINVAL
+#define NAND_ENOENT ISFS_ENOENT
+#define NAND_EEXIST ISFS_EEXIST
+#else
+#include <errno.h>
+
+#define NAND_EINVAL (-EINVAL)
+#define NAND_ENOENT (-ENOENT)
+#define NAND_EEXIST (-EEXIST)
+
+void nand_set_root(const char* path);
+void nand_set_latency(unsigned int usec_per_call, unsigned int usec_per_kib); // Reads and writes take about as long as they would on a console
+#endif
+
+enum {
+	NAND_OPEN_READ  = 1,
+	NAND_OPEN_WRITE = 2,
+};
+
+// Runs once the read is done, with what nand_read() would have returned. From an interrupt on the console, so keep it short
+typedef int (*nand_callback)(int result, void* user);
+
+// Every call that would have been an IPC round trip on the console. For counting, never reset
+extern unsigned int nand_ipc_count;
+
+int nand_get_data_dir(uint64_t title_id, char path[NAND_MAXPATH]);
+int nand_create_dir(const char* path, uint8_t attributes, uint8_t permissions);
+int nand_create_file(const char* path, uint8_t attributes, uint8_t permissions);
+int nand_get_attr(const char* path, uint8_t* attributes, uint8_t* permissions);
+int nand_open(const char* path, int mode); // NAND_EINVAL for directories
+int nand_read_dir(const char* path, char* names, uint32_t* count); // names NULL just counts. Otherwise *count is how many fit (13 bytes each) and then how many came back, packed one after another
+int nand_get_file_size(int fd, uint32_t* size);
+int nand_read(int fd, void* buf, unsigned int len);
+int nand_read_async(int fd, void* buf, unsigned int len, nand_callback callback, void* user); // Queued behind anything else in flight on fd
+int nand_write(int fd, const void* buf, unsigned int len); // 0x20 aligned buf, please
+int nand_close(int fd);
+int nand_delete(const char* path); // Directories go with everything in them
+int nand_rename(const char* from, const char* to); // IOS wants the last part of both paths to be the same
+int nand_get_free_space(uint32_t* bytes, uint32_t* inodes);
@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "pipeline.h"
+#include "bufpool.h"
+
+#ifdef GEKKO
+#define LOCK(p)          LWP_MutexLock((p)->lock)
+#define UNLOCK(p)        LWP_MutexUnlock((p)->lock)
+#define WAIT(p, cond)    LWP_CondWait((p)->cond, (p)->lock)
+#define SIGNAL(p, cond)  LWP_CondSignal((p)->cond)
+#else
+#define LOCK(p)          pthread_mutex_lock(&(p)->lock)
+#define UNLOCK(p)        pthread_mutex_unlock(&(p)->lock)
+#define WAIT(p, cond)    pthread_cond_wait(&(p)->cond, &(p)->lock)
+#define SIGNAL(p, cond)  pthread_cond_signal(&(p)->cond)
+#endif
+
+static void* pipeline_worker(void* arg) {
+	pipeline* p = arg;
+
+	LOCK(p);
+	while (true) {
+		while (!p->count && !p->done)
+			WAIT(p, cond_full);
+
+		if (!p->count)
+			break;
+
+		unsigned int index = p->tail;
+		int          ret = p->error;
+		UNLOCK(p);
+
+		// Once something fails, everything after it just gets dropped
+		if (ret == 0)
+			ret = p->consume(p->user, p->buffers[index], p->lengths[index]);
+
+		LOCK(p);
+		if (ret < 0 && !p->error)
+			p->error = ret;
+
+		p->tail = (p->tail + 1) % p->num_buffers;
+		p->count--;
+		SIGNAL(p, cond_free);
+	}
+	UNLOCK(p);
+
+	return NULL;
+}
+
+int pipeline_start(pipeline* p, unsigned int num_buffers, unsigned int buffer_size, pipeline_consumer consume, void* user) {
+	int ret;
+
+	if (num_buffers < 2 || num_buffers > PIPELINE_MAX_BUFFERS || buffer_size % 0x40)
+		return -EINVAL;
+
+	memset(p, 0, sizeof(pipeline));
+	p->num_buffers = num_buffers;
+	p->buffer_size = buffer_size;
+	p->consume     = consume;
+	p->user        = user;
+
+	p->buffers[0] = bufpool_acquire(num_buffers * buffer_size);
+	if (!p->buffers[0])
+		return -ENOMEM;
+
+	for (unsigned int i = 1; i < num_buffers; i++)
+		p->buffers[i] = p->buffers[0] + (i * buffer_size);
+
+#ifdef GEKKO
+	LWP_MutexInit(&p->lock, false);
+	LWP_CondInit(&p->cond_free);
+	LWP_CondInit(&p->cond_full);
+
+	// Same priority as the main thread, it's going to be blocked on IOS most of the time anyways
+	ret = LWP_CreateThread(&p->thread, pipeline_worker, p, NULL, 0x8000, 64);
+#else
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->cond_free, NULL);
+	pthread_cond_init(&p->cond_full, NULL);
+
+	ret = -pthread_create(&p->thread, NULL, pipeline_worker, p);
+#endif
+	if (ret < 0) {
+		bufpool_release(p->buffers[0]);
+		return ret;
+	}
+
+	return 0;
+}
+
+void* pipeline_acquire(pipeline* p) {
+	void* buffer = NULL;
+
+	LOCK(p);
+	while (p->count == p->num_buffers && !p->error)
+		WAIT(p, cond_free);
+
+	if (!p->error)
+		buffer = p->buffers[p->head];
+	UNLOCK(p);
+
+	return buffer;
+}
+
+int pipeline_submit(pipeline* p, unsigned int len) {
+	int ret;
+
+	LOCK(p);
+	p->lengths[p->head] = len;
+	p->head = (p->head + 1) % p->num_buffers;
+	p->count++;
+	ret = p->error;
+	SIGNAL(p, cond_full);
+	UNLOCK(p);
+
+	return ret;
+}
+
+int pipeline_finish(pipeline* p) {
+	LOCK(p);
+	p->done = true;
+	SIGNAL(p, cond_full);
+	UNLOCK(p);
+
+#ifdef GEKKO
+	LWP_JoinThread(p->thread, NULL);
+	LWP_CondDestroy(p->cond_full);
+	LWP_CondDestroy(p->cond_free);
+	LWP_MutexDestroy(p->lock);
+#else
+	pthread_join(p->thread, NULL);
+	pthread_cond_destroy(&p->cond_full);
+	pthread_cond_destroy(&p->cond_free);
+	pthread_mutex_destroy(&p->lock);
+#endif
+
+	bufpool_release(p->buffers[0]);
+	return p->error;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <stdbool.h>
+
+#ifdef GEKKO
+#include <ogc/lwp.h>
+#include <ogc/mutex.h>
+#include <ogc/cond.h>
+#else
+#include <pthread.h>
+#endif
+
+// One producer (whoever calls pipeline_acquire/pipeline_submit), one worker thread that hands every
+// submitted buffer to the consumer, strictly in the order they were submitted.
+#define PIPELINE_MAX_BUFFERS 4
+
+typedef int (*pipeline_consumer)(void* user, const void* data, unsigned int len); // < 0 stops the pipeline
+
+typedef struct pipeline {
+	unsigned char    *buffers[PIPELINE_MAX_BUFFERS]; // 0x40 aligned
+	unsigned int      lengths[PIPELINE_MAX_BUFFERS];
+	unsigned int      num_buffers, buffer_size;
+	unsigned int      head;  // Next one to fill
+	unsigned int      tail;  // Next one to consume
+	unsigned int      count; // Filled, including the one being consumed
+	int               error; // First error from the consumer
+	bool              done;
+
+	pipeline_consumer consume;
+	void             *user;
+
+#ifdef GEKKO
+	lwp_t             thread;
+	mutex_t           lock;
+	cond_t            cond_free, cond_full;
+#else
+	pthread_t         thread;
+	pthread_mutex_t   lock;
+	pthread_cond_t    cond_free, cond_full;
+#endif
+} pipeline;
+
+int   pipeline_start(pipeline* p, unsigned int num_buffers, unsigned int buffer_size, pipeline_consumer consume, void* user);
+void* pipeline_acquire(pipeline* p); // buffer_size bytes to fill. NULL if the consumer failed, see pipeline_finish
+int   pipeline_submit(pipeline* p, unsigned int len); // Queues the buffer from pipeline_acquire
+int   pipeline_finish(pipeline* p); // Drains the queue and stops the worker. Returns the consumer's error, if any
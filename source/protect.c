@@ -0,0 +1,76 @@
+#include <stdlib.h>
+#include <ogc/es.h>
+
+#include "common.h"
+#include "protect.h"
+#include "wiimenu.h"
+
+#define SYSMENU_TID 0x0000000100000002
+
+// Straight from ES, the title list in main.c might not be filled in yet
+static tmd_view* get_wiimenu_view(void) {
+	uint32_t  size = 0;
+	tmd_view* view;
+
+	if (ES_GetTMDViewSize(SYSMENU_TID, &size) < 0 || !size)
+		return NULL;
+
+	if (!(view = memalign32(size)))
+		return NULL;
+
+	if (ES_GetTMDView(SYSMENU_TID, view, size) < 0) {
+		free(view);
+		return NULL;
+	}
+
+	return view;
+}
+
+const char* title_no_touchy(uint64_t title_id, uint16_t version, bool installing) {
+	uint32_t    tid_hi = (uint32_t)(title_id >> 32), tid_lo = (uint32_t)title_id;
+	const char* reason = NULL;
+	tmd_view*   wiimenu = NULL;
+
+	if (tid_hi == 0x00000001) {
+		if (installing)
+			return "System titles don't get installed from here.";
+
+		if (tid_lo == 0x00000001 ||
+		    tid_lo == 0x00000002 ||
+		    tid_lo == 0x00000100 ||
+		    tid_lo == 0x00000101 ||
+		    tid_lo == 0x00000102 ||
+		    tid_lo == 0x00000200 ||
+		    tid_lo == 0x00000201)
+			return "That's a system title.";
+
+		// The stub is the only 254 that can go
+		if (tid_lo == 254 && version != 0xFF00)
+			return "That's BootMii IOS.";
+
+		if (!(wiimenu = get_wiimenu_view()))
+			return "I can't find the Wii System Menu...?";
+
+		if (title_id == wiimenu->sys_version)
+			reason = "The Wii System Menu runs on this IOS!!!!";
+		else if (tid_lo != 0x00000000 && tid_lo < 200)
+			reason = "I don't trust you with uninstalling normal IOS.";
+	}
+	// EULA and region select, for the System Menu's own region
+	else if (tid_hi == 0x00010008) {
+		uint32_t tid_superlow = tid_lo & ~0xFF;
+		if (tid_superlow != 0x48414B00 && tid_superlow != 0x48414C00)
+			return NULL;
+
+		if (!(wiimenu = get_wiimenu_view()))
+			return "I can't find the Wii System Menu...?";
+
+		if (!wiimenu_version_is_official(wiimenu->title_version))
+			reason = "I can't determine the Wii System Menu's region!";
+		else if (tid_lo == (tid_superlow ^ wiimenu_region_table[1][wiimenu->title_version & 0x1F]))
+			reason = "The Wii System Menu needs this one.";
+	}
+
+	free(wiimenu);
+	return reason;
+}
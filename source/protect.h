@@ -0,0 +1,7 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// Why title_id had better be left alone, NULL if it's fair game. version is the installed title's, for uninstalling.
+// Installing is stricter: nothing from 00000001 at all, a bad boot2, System Menu or IOS off the SD card is a brick
+const char* title_no_touchy(uint64_t title_id, uint16_t version, bool installing);
@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "readahead.h"
+#include "nand.h"
+#include "bufpool.h"
+
+#ifdef GEKKO
+#include <ogc/irq.h>
+#endif
+
+// From IOS' interrupt on the console, from the stand-in's thread on host builds
+static int readahead_callback(int result, void* user) {
+	struct readahead_request* req = user;
+	readahead* ra = req->ra;
+
+#ifdef GEKKO
+	req->result   = result;
+	req->complete = true;
+	LWP_ThreadSignal(ra->queue);
+#else
+	pthread_mutex_lock(&ra->lock);
+	req->result   = result;
+	req->complete = true;
+	pthread_cond_broadcast(&ra->cond);
+	pthread_mutex_unlock(&ra->lock);
+#endif
+
+	return 0;
+}
+
+static void wait_for(readahead* ra, struct readahead_request* req) {
+#ifdef GEKKO
+	// Interrupts off between the check and going to sleep, or the signal could land in between and get lost
+	uint32_t level = IRQ_Disable();
+	while (!req->complete)
+		LWP_ThreadSleep(ra->queue);
+	IRQ_Restore(level);
+#else
+	pthread_mutex_lock(&ra->lock);
+	while (!req->complete)
+		pthread_cond_wait(&ra->cond, &ra->lock);
+	pthread_mutex_unlock(&ra->lock);
+#endif
+}
+
+// Every free buffer gets a read, as long as there's file left
+static int submit(readahead* ra) {
+	while (ra->in_flight < ra->num_buffers && ra->submitted < ra->size) {
+		struct readahead_request* req = &ra->requests[(ra->head + ra->in_flight) % ra->num_buffers];
+		unsigned int len = (ra->size - ra->submitted > ra->buffer_size) ? ra->buffer_size : ra->size - ra->submitted;
+
+		req->len      = len;
+		req->result   = 0;
+		req->complete = false;
+
+		int ret = nand_read_async(ra->fd, req->buffer, len, readahead_callback, req);
+		if (ret < 0)
+			return ret;
+
+		ra->submitted += len;
+		ra->in_flight++;
+	}
+
+	return 0;
+}
+
+int readahead_start(readahead* ra, int fd, uint32_t size, unsigned int num_buffers, unsigned int buffer_size) {
+	if (num_buffers < 1 || num_buffers > READAHEAD_MAX_BUFFERS || buffer_size % 0x40)
+		return -EINVAL;
+
+	memset(ra, 0, sizeof(readahead));
+	ra->num_buffers = num_buffers;
+	ra->buffer_size = buffer_size;
+	ra->fd          = fd;
+	ra->size        = size;
+
+	unsigned char* buffers = bufpool_acquire(num_buffers * buffer_size);
+	if (!buffers)
+		return -ENOMEM;
+
+	for (unsigned int i = 0; i < num_buffers; i++)
+		ra->requests[i] = (struct readahead_request){ ra, buffers + (i * buffer_size) };
+
+#ifdef GEKKO
+	LWP_InitQueue(&ra->queue);
+#else
+	pthread_mutex_init(&ra->lock, NULL);
+	pthread_cond_init(&ra->cond, NULL);
+#endif
+
+	int ret = submit(ra);
+	if (ret < 0)
+		ra->error = ret;
+
+	return 0;
+}
+
+int readahead_next(readahead* ra, void** data) {
+	// Done with the last one, so it can go fetch more
+	if (ra->holding) {
+		ra->head = (ra->head + 1) % ra->num_buffers;
+		ra->in_flight--;
+		ra->holding = false;
+	}
+
+	if (ra->error)
+		return ra->error;
+
+	int ret = submit(ra);
+	if (ret < 0)
+		return ra->error = ret;
+
+	if (!ra->in_flight)
+		return 0;
+
+	struct readahead_request* req = &ra->requests[ra->head];
+	wait_for(ra, req);
+
+	ra->holding = true;
+	if (req->result != req->len)
+		return ra->error = (req->result < 0) ? req->result : -EIO;
+
+	*data = req->buffer;
+	return req->result;
+}
+
+int readahead_finish(readahead* ra) {
+	// IOS still has these buffers, they can't go anywhere until it's done with them
+	for (unsigned int i = ra->holding ? 1 : 0; i < ra->in_flight; i++)
+		wait_for(ra, &ra->requests[(ra->head + i) % ra->num_buffers]);
+
+	bufpool_release(ra->requests[0].buffer);
+
+#ifdef GEKKO
+	LWP_CloseQueue(ra->queue);
+#else
+	pthread_mutex_destroy(&ra->lock);
+	pthread_cond_destroy(&ra->cond);
+#endif
+
+	return ra->error;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef GEKKO
+#include <ogc/lwp.h>
+#else
+#include <pthread.h>
+#endif
+
+// Streams one NAND file with up to READAHEAD_MAX_BUFFERS reads in flight, so IOS is already fetching
+// the next chunks while the caller is busy with this one. Chunks come back in file order.
+#define READAHEAD_MAX_BUFFERS 4
+
+struct readahead;
+
+struct readahead_request {
+	struct readahead *ra;
+	unsigned char    *buffer; // 0x40 aligned
+	unsigned int      len;
+	volatile int      result;
+	volatile bool     complete;
+};
+
+typedef struct readahead {
+	struct readahead_request requests[READAHEAD_MAX_BUFFERS];
+	unsigned int             num_buffers, buffer_size;
+	unsigned int             head;      // Oldest read, the next one handed out
+	unsigned int             in_flight; // Including the one the caller is holding
+	bool                     holding;   // Caller still has head's buffer from the last readahead_next
+	int                      fd;
+	uint32_t                 size, submitted;
+	int                      error;
+
+#ifdef GEKKO
+	lwpq_t                   queue;
+#else
+	pthread_mutex_t          lock;
+	pthread_cond_t           cond;
+#endif
+} readahead;
+
+int readahead_start(readahead* ra, int fd, uint32_t size, unsigned int num_buffers, unsigned int buffer_size); // Reads size bytes from where fd is now
+int readahead_next(readahead* ra, void** data); // Length of the next chunk, 0 at the end. *data is good until the next call
+int readahead_finish(readahead* ra); // Waits out anything still in flight. Doesn't close fd, returns the first error if there was one
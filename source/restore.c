@@ -0,0 +1,622 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <mbedtls/md5.h>
+
+#include "common.h"
+#include "save.h"
+#include "restore.h"
+#include "nand.h"
+#include "crypto.h"
+#include "hash.h"
+#include "byteorder.h"
+#include "tar.h"
+
+#ifdef GEKKO
+#include <ogc/es.h>
+#include "identify.h"
+#endif
+
+__attribute__((aligned(0x40)))
+static unsigned char buffer[0x10000];
+
+// Default for directories we have to make up. Owner and group can read and write
+#define DEFAULT_PERMISSIONS 0x3C
+
+// Anything that could walk out of the data directory (or that IOS would choke on) doesn't get in
+static bool check_save_path(const char* name) {
+	if (!*name || *name == '/')
+		return false;
+
+	while (*name) {
+		size_t len = strcspn(name, "/");
+
+		if (len == 0 || len > 12 || (name[0] == '.' && (len == 1 || (len == 2 && name[1] == '.'))))
+			return false;
+
+		name += len;
+		if (*name == '/')
+			name++;
+	}
+
+	return name[-1] != '/';
+}
+
+static int read_exact(FILE* fp, void* buf, size_t len) {
+	if (!fread(buf, len, 1, fp)) {
+		int ret = ferror(fp) ? -errno : -EIO;
+		fprintf(stderr, "data.bin: %s\n", ferror(fp) ? strerror(errno) : "Unexpected end of file");
+		return ret;
+	}
+
+	return 0;
+}
+
+static int write_nand_file(const char* path, uint8_t attributes, uint8_t permissions, const void* data, unsigned int len) {
+	int ret = nand_create_file(path, attributes, permissions);
+	if (ret < 0) {
+		print_error("nand_create_file(%s)", ret, path);
+		return ret;
+	}
+
+	int fd = ret = nand_open(path, NAND_OPEN_WRITE);
+	if (ret < 0) {
+		print_error("nand_open(%s)", ret, path);
+		return ret;
+	}
+
+	ret = nand_write(fd, data, len);
+	nand_close(fd);
+	if (ret != len) {
+		print_error("nand_write(%s)", ret, path);
+		return (ret < 0) ? ret : -EIO;
+	}
+
+	return 0;
+}
+
+int swap_data_dir(uint64_t title_id, const char* new_data_dir) {
+	int  ret;
+	char data_dir[NAND_MAXPATH];
+	char old_root[NAND_MAXPATH], old_data_dir[NAND_MAXPATH];
+
+	ret = nand_get_data_dir(title_id, data_dir);
+	if (ret < 0) {
+		print_error("nand_get_data_dir", ret);
+		return ret;
+	}
+
+	sprintf(old_root,     "/tmp/%08x.old", (uint32_t)title_id);
+	sprintf(old_data_dir, "/tmp/%08x.old/data", (uint32_t)title_id);
+
+	nand_delete(old_root);
+	ret = nand_create_dir(old_root, 0, DEFAULT_PERMISSIONS);
+	if (ret < 0) {
+		print_error("nand_create_dir(%s)", ret, old_root);
+		return ret;
+	}
+
+	// No rename-over for directories, so the old one steps aside first and comes back if the new one won't go in
+	ret = nand_rename(data_dir, old_data_dir);
+	if (ret < 0 && ret != NAND_ENOENT) {
+		print_error("nand_rename(%s)", ret, data_dir);
+		nand_delete(old_root);
+		return ret;
+	}
+
+	ret = nand_rename(new_data_dir, data_dir);
+	if (ret < 0) {
+		print_error("nand_rename(%s)", ret, new_data_dir);
+		if (nand_rename(old_data_dir, data_dir) == 0)
+			nand_delete(old_root);
+		else
+			fprintf(stderr, "Couldn't put the old save back either, it's still in %s\n", old_data_dir);
+
+		return ret;
+	}
+
+	nand_delete(old_root);
+	return 0;
+}
+
+// Where an import gets put together, before it goes over the real data directory
+struct import_target {
+	uint64_t title_id;
+	char     root[NAND_MAXPATH];     // /tmp/<title id>
+	char     data[NAND_MAXPATH];     // /tmp/<title id>/data
+	char     data_dir[NAND_MAXPATH]; // The title's own, for anything that wants to know what used to be there
+};
+
+static int import_begin(uint64_t title_id, struct import_target* target) {
+	int     ret;
+	uint8_t data_attributes = 0, data_permissions = DEFAULT_PERMISSIONS;
+
+	*target = (struct import_target){ title_id };
+
+#ifdef GEKKO
+	if (identify_sm() == 0) {
+		ret = ES_SetUID(title_id);
+		if (ret < 0)
+			print_error("ES_SetUID", ret);
+	}
+#endif
+
+	// Keep whatever the current data directory has, if there is one
+	ret = nand_get_data_dir(title_id, target->data_dir);
+	if (ret < 0) {
+		print_error("nand_get_data_dir", ret);
+		return ret;
+	}
+	nand_get_attr(target->data_dir, &data_attributes, &data_permissions);
+
+	sprintf(target->root, "/tmp/%08x", (uint32_t)title_id);
+	sprintf(target->data, "/tmp/%08x/data", (uint32_t)title_id);
+
+	nand_delete(target->root);
+	if ((ret = nand_create_dir(target->root, 0, DEFAULT_PERMISSIONS)) < 0
+	||  (ret = nand_create_dir(target->data, data_attributes, data_permissions)) < 0)
+	{
+		print_error("nand_create_dir(%s)", ret, target->data);
+		nand_delete(target->root);
+		return ret;
+	}
+
+	return 0;
+}
+
+static int import_finish(struct import_target* target) {
+	int ret = swap_data_dir(target->title_id, target->data);
+
+	nand_delete(target->root);
+	return ret;
+}
+
+// One pass over the file: decrypt, check, hash and write out as it goes. Nothing gets bigger than the buffer
+static int import_files(FILE* fp, const char* temp_data, unsigned int num_files, sha1_ctx* sha) {
+	int  ret;
+	char path[NAND_MAXPATH];
+
+	for (unsigned int i = 0; i < num_files; i++) {
+		__attribute__((aligned(0x40)))
+		struct file_header file;
+
+		if ((ret = read_exact(fp, &file, sizeof(file))) < 0)
+			return ret;
+
+		sha1_update(sha, &file, sizeof(file));
+
+		if (be32(file.magic) != FILE_HDR_MAGIC) {
+			fprintf(stderr, "data.bin: File header #%u has a bad magic (%08x)\n", i, be32(file.magic));
+			return -EINVAL;
+		}
+
+		if (!memchr(file.name, 0, sizeof(file.name)) || !check_save_path(file.name)
+		||  snprintf(path, sizeof(path), "%s/%s", temp_data, file.name) >= sizeof(path)
+		||  NAND_DATA_DIR_LEN + 1 + strlen(file.name) >= NAND_MAXPATH)
+		{
+			fprintf(stderr, "data.bin: File header #%u has a bad name (%.64s)\n", i, file.name);
+			return -EINVAL;
+		}
+
+		if (file.type == 2) {
+			ret = nand_create_dir(path, file.attributes, file.permissions);
+			if (ret < 0) {
+				print_error("nand_create_dir(%s)", ret, file.name);
+				return ret;
+			}
+
+			continue;
+		}
+		else if (file.type != 1) {
+			fprintf(stderr, "data.bin: %s has an unknown type (%u)\n", file.name, file.type);
+			return -EINVAL;
+		}
+
+		// Already written from the header, and export_save doesn't store it twice
+		if (strcmp(file.name, "banner.bin") == 0)
+			continue;
+
+		unsigned int size = be32(file.size);
+		printf("Restoring %s (%#x, %uKiB)\n", file.name, size, (size + 0x3FF) >> 10);
+
+		ret = nand_create_file(path, file.attributes, file.permissions);
+		if (ret < 0) {
+			print_error("nand_create_file(%s)", ret, file.name);
+			return ret;
+		}
+
+		int fd = ret = nand_open(path, NAND_OPEN_WRITE);
+		if (ret < 0) {
+			print_error("nand_open(%s)", ret, file.name);
+			return ret;
+		}
+
+		uint32_t iv[4] __attribute__((aligned(0x20)));
+		memcpy(iv, file.iv, sizeof(iv));
+
+		unsigned int left = align_up(size, 0x40);
+		while (left) {
+			unsigned int chunk = (left > sizeof(buffer)) ? sizeof(buffer) : left;
+			unsigned int data_left = size - (align_up(size, 0x40) - left);
+
+			if ((ret = read_exact(fp, buffer, chunk)) < 0)
+				break;
+
+			// The hash is over what's in the file, so before decrypting
+			sha1_update(sha, buffer, chunk);
+
+			ret = sd_decrypt(iv, buffer, chunk, buffer);
+			if (ret < 0) {
+				print_error("sd_decrypt", ret);
+				break;
+			}
+
+			unsigned int write = (data_left < chunk) ? data_left : chunk;
+			ret = nand_write(fd, buffer, write);
+			if (ret != write) {
+				print_error("nand_write(%s)", ret, file.name);
+				ret = (ret < 0) ? ret : -EIO;
+				break;
+			}
+
+			left -= chunk;
+		}
+
+		nand_close(fd);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+int import_save(uint64_t title_id, FILE* fp) {
+	int              ret;
+	struct data_bin *save = (struct data_bin *)buffer;
+	uint32_t         iv[4] __attribute__((aligned(0x20)));
+	uint32_t         md5_sum[4];
+	uint8_t          hash[20];
+	char             path[NAND_MAXPATH];
+	sha1_ctx         sha;
+	struct import_target target;
+
+	__attribute__((aligned(0x40)))
+	struct bk_header bk_header;
+
+	if ((ret = read_exact(fp, save, sizeof(struct data_bin))) < 0)
+		return ret;
+
+	memcpy(iv, sd_initial_iv, sizeof(iv));
+	ret = sd_decrypt(iv, buffer, sizeof(struct data_bin), buffer);
+	if (ret < 0) {
+		print_error("sd_decrypt", ret);
+		return ret;
+	}
+
+	memcpy(md5_sum, save->header.md5_sum, sizeof(md5_sum));
+	memcpy(save->header.md5_sum, md5_blanker, sizeof(md5_sum));
+	mbedtls_md5_ret(buffer, sizeof(struct data_bin), (unsigned char *)save->header.md5_sum);
+	if (memcmp(md5_sum, save->header.md5_sum, sizeof(md5_sum))) {
+		fprintf(stderr, "data.bin: Header MD5 doesn't match, wrong file (or wrong SD key)?\n");
+		return -EINVAL;
+	}
+
+	unsigned int banner_sz = be32(save->header.banner_sz);
+	if (be64(save->header.title_id) != title_id) {
+		fprintf(stderr, "data.bin: This is for %016llx, not %016llx\n", (unsigned long long)be64(save->header.title_id), (unsigned long long)title_id);
+		return -EINVAL;
+	}
+
+	if (banner_sz < FULL_BNR_MIN || banner_sz > FULL_BNR_MAX) {
+		fprintf(stderr, "data.bin: Banner size is out of range (%#x)\n", banner_sz);
+		return -EINVAL;
+	}
+
+	if ((ret = import_begin(title_id, &target)) < 0)
+		return ret;
+
+	sprintf(path, "/tmp/%08x/data/banner.bin", (uint32_t)title_id);
+	ret = write_nand_file(path, save->header.attributes, save->header.permissions, &save->banner, banner_sz);
+	if (ret < 0)
+		goto fail;
+
+	// Bk header onwards is what the signature covers
+	if ((ret = read_exact(fp, &bk_header, sizeof(bk_header))) < 0)
+		goto fail;
+
+	sha1_init(&sha);
+	sha1_update(&sha, &bk_header, sizeof(bk_header));
+
+	if (be32(bk_header.magic) != BK_HDR_MAGIC || be32(bk_header.header_size) != BK_LISTED_SZ) {
+		fprintf(stderr, "data.bin: Bk header is invalid (%08x, %#x)\n", be32(bk_header.magic), be32(bk_header.header_size));
+		ret = -EINVAL;
+		goto fail;
+	}
+
+	if (be64(bk_header.title_id) != title_id) {
+		fprintf(stderr, "data.bin: Bk header is for %016llx\n", (unsigned long long)be64(bk_header.title_id));
+		ret = -EINVAL;
+		goto fail;
+	}
+
+	ret = import_files(fp, target.data, be32(bk_header.num_files), &sha);
+	if (ret < 0)
+		goto fail;
+
+	// Signature and certificates, then nothing
+	if ((ret = read_exact(fp, buffer, FULL_CERT_SZ)) < 0)
+		goto fail;
+
+	if (fgetc(fp) != EOF) {
+		fprintf(stderr, "data.bin: Trailing data after the certificates\n");
+		ret = -EINVAL;
+		goto fail;
+	}
+
+	sha1_finish(&sha, hash);
+	printf("Bk SHA-1: ");
+	for (int i = 0; i < sizeof(hash); i++)
+		printf("%02x", hash[i]);
+	putchar('\n');
+
+	return import_finish(&target);
+
+fail:
+	nand_delete(target.root);
+	return ret;
+}
+
+// Where one entry from an extracted save goes, under the same rules as data.bin
+static int target_path(const struct import_target* target, const char* relative_path, char path[NAND_MAXPATH]) {
+	if (!check_save_path(relative_path)
+	||  snprintf(path, NAND_MAXPATH, "%s/%s", target->data, relative_path) >= NAND_MAXPATH
+	||  NAND_DATA_DIR_LEN + 1 + strlen(relative_path) >= NAND_MAXPATH)
+	{
+		fprintf(stderr, "%s: Bad name for a save file\n", relative_path);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+// Nothing in a plain directory says what the permissions were, so they stay as they are on the NAND (or the default, for new things)
+static void existing_mode(const struct import_target* target, const char* relative_path, uint8_t* attributes, uint8_t* permissions) {
+	char    path[NAND_MAXPATH];
+	uint8_t attr, perm;
+
+	*attributes  = 0;
+	*permissions = DEFAULT_PERMISSIONS;
+	if (snprintf(path, sizeof(path), "%s/%s", target->data_dir, relative_path) < sizeof(path) && nand_get_attr(path, &attr, &perm) == 0) {
+		*attributes  = attr;
+		*permissions = perm;
+	}
+}
+
+// A whole buffer per write, only the last one is short
+static int copy_to_nand(FILE* fp, const char* path, const char* name, uint8_t attributes, uint8_t permissions, uint64_t size) {
+	int ret;
+
+	if (size > UINT32_MAX) {
+		fprintf(stderr, "%s: Too big for the NAND (%#llx)\n", name, (unsigned long long)size);
+		return -EFBIG;
+	}
+
+	printf("Restoring %s (%#x, %uKiB)\n", name, (uint32_t)size, (uint32_t)((size + 0x3FF) >> 10));
+	ret = nand_create_file(path, attributes, permissions);
+	if (ret < 0) {
+		print_error("nand_create_file(%s)", ret, name);
+		return ret;
+	}
+
+	int fd = ret = nand_open(path, NAND_OPEN_WRITE);
+	if (ret < 0) {
+		print_error("nand_open(%s)", ret, name);
+		return ret;
+	}
+
+	for (uint32_t left = size; left; left -= ret) {
+		unsigned int chunk = (left > sizeof(buffer)) ? sizeof(buffer) : left;
+
+		if (!fread(buffer, chunk, 1, fp)) {
+			ret = ferror(fp) ? -errno : -EIO;
+			fprintf(stderr, "%s: %s\n", name, ferror(fp) ? strerror(errno) : "Unexpected end of file");
+			break;
+		}
+
+		ret = nand_write(fd, buffer, chunk);
+		if (ret != chunk) {
+			print_error("nand_write(%s)", ret, name);
+			ret = (ret < 0) ? ret : -EIO;
+			break;
+		}
+	}
+
+	nand_close(fd);
+	return (ret < 0) ? ret : 0;
+}
+
+static int import_tree(const struct import_target* target, char* sd_path, size_t sd_size, char* relative_path) {
+	int            ret = 0;
+	size_t         sd_len = strlen(sd_path), relative_len = strlen(relative_path);
+	struct dirent* ent;
+
+	DIR* dir = opendir(sd_path);
+	if (!dir) {
+		perror(sd_path);
+		return -errno;
+	}
+
+	while (ret >= 0 && (ent = readdir(dir))) {
+		struct stat st;
+		char        path[NAND_MAXPATH];
+		uint8_t     attributes, permissions;
+
+		if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+			continue;
+
+		// Too long for one is too long for the other, names can't be more than 12 characters either way
+		if (snprintf(sd_path + sd_len, sd_size - sd_len, "/%s", ent->d_name) >= sd_size - sd_len
+		||  snprintf(relative_path + relative_len, NAND_MAXPATH - relative_len, relative_len ? "/%s" : "%s", ent->d_name) >= NAND_MAXPATH - relative_len)
+		{
+			fprintf(stderr, "%s: Path is too long\n", ent->d_name);
+			ret = -ENAMETOOLONG;
+			break;
+		}
+
+		if (stat(sd_path, &st) < 0) {
+			perror(sd_path);
+			ret = -errno;
+			break;
+		}
+
+		if ((ret = target_path(target, relative_path, path)) < 0)
+			break;
+
+		existing_mode(target, relative_path, &attributes, &permissions);
+		if (S_ISDIR(st.st_mode)) {
+			ret = nand_create_dir(path, attributes, permissions);
+			if (ret < 0) {
+				print_error("nand_create_dir(%s)", ret, relative_path);
+				break;
+			}
+
+			ret = import_tree(target, sd_path, sd_size, relative_path);
+		}
+		else if (S_ISREG(st.st_mode)) {
+			FILE* fp = fopen(sd_path, "rb");
+			if (!fp) {
+				perror(sd_path);
+				ret = -errno;
+				break;
+			}
+
+			ret = copy_to_nand(fp, path, relative_path, attributes, permissions, st.st_size);
+			fclose(fp);
+		}
+		else {
+			printf("Skipping %s, not a file or a directory\n", relative_path);
+		}
+	}
+
+	sd_path[sd_len] = '\0';
+	relative_path[relative_len] = '\0';
+	closedir(dir);
+	return ret;
+}
+
+// Values in save tars are hex, see SAVE_PAX_ATTRIBUTES
+static void pax_mode(const tar_read_entry* entry, uint8_t* attributes, uint8_t* permissions) {
+	const char* value;
+
+	if ((value = tar_pax_find(entry, SAVE_PAX_ATTRIBUTES)))
+		*attributes = strtoul(value, NULL, 16);
+
+	if ((value = tar_pax_find(entry, SAVE_PAX_PERMISSIONS)))
+		*permissions = strtoul(value, NULL, 16);
+}
+
+static int import_tar(const struct import_target* target, FILE* fp) {
+	int            ret;
+	tar_read_entry entry;
+
+	while ((ret = tar_read_next(fp, &entry)) > 0) {
+		char        path[NAND_MAXPATH];
+		uint8_t     attributes, permissions;
+		const char* relative_path = entry.path;
+
+		// "tar -C save ." puts ./ on the front of everything, and the top directory in as "."
+		while (relative_path[0] == '.' && relative_path[1] == '/')
+			relative_path += 2;
+
+		if (!strcmp(relative_path, ".") || !*relative_path)
+			continue;
+
+		if ((ret = target_path(target, relative_path, path)) < 0)
+			break;
+
+		existing_mode(target, relative_path, &attributes, &permissions);
+		pax_mode(&entry, &attributes, &permissions);
+
+		if (entry.type == TAR_TYPE_DIRECTORY) {
+			ret = nand_create_dir(path, attributes, permissions);
+			if (ret < 0) {
+				print_error("nand_create_dir(%s)", ret, relative_path);
+				break;
+			}
+		}
+		else if (entry.type == TAR_TYPE_FILE) {
+			if ((ret = copy_to_nand(fp, path, relative_path, attributes, permissions, entry.size)) < 0)
+				break;
+
+			unsigned int pad = align_up(entry.size, TAR_BLOCK_SIZE) - entry.size;
+			if (pad && !fread(buffer, pad, 1, fp)) {
+				fprintf(stderr, "tar: Unexpected end of file\n");
+				ret = -EIO;
+				break;
+			}
+		}
+		else {
+			fprintf(stderr, "%s: Can't put this type of entry (%c) on the NAND\n", relative_path, entry.type);
+			ret = -EINVAL;
+			break;
+		}
+	}
+
+	return ret;
+}
+
+static int import_extracted(uint64_t title_id, const char* sd_path, bool tar) {
+	int                  ret;
+	struct import_target target;
+	char                 path[NAND_MAXPATH];
+	uint8_t              attributes, permissions;
+
+	if ((ret = import_begin(title_id, &target)) < 0)
+		return ret;
+
+	if (tar) {
+		FILE* fp = fopen(sd_path, "rb");
+		if (!fp) {
+			perror(sd_path);
+			ret = -errno;
+			goto fail;
+		}
+
+		ret = import_tar(&target, fp);
+		fclose(fp);
+	}
+	else {
+		char walk_path[512], relative_path[NAND_MAXPATH] = "";
+
+		if (snprintf(walk_path, sizeof(walk_path), "%s", sd_path) >= sizeof(walk_path)) {
+			ret = -ENAMETOOLONG;
+			goto fail;
+		}
+
+		ret = import_tree(&target, walk_path, sizeof(walk_path), relative_path);
+	}
+
+	if (ret < 0)
+		goto fail;
+
+	sprintf(path, "/tmp/%08x/data/banner.bin", (uint32_t)title_id);
+	if (nand_get_attr(path, &attributes, &permissions) < 0)
+		puts("No banner.bin in there, the save won't show up in Data Management.");
+
+	return import_finish(&target);
+
+fail:
+	nand_delete(target.root);
+	return ret;
+}
+
+int import_save_dir(uint64_t title_id, const char* dir_path) {
+	return import_extracted(title_id, dir_path, false);
+}
+
+int import_save_tar(uint64_t title_id, const char* tar_path) {
+	return import_extracted(title_id, tar_path, true);
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+
+// Puts a data.bin back onto the NAND. Everything is written under /tmp first, the save only gets replaced once the whole file checked out.
+int import_save(uint64_t title_id, FILE* fp);
+
+// The same, from what "Dump save data (extract)" or "(.tar)" wrote. Permissions come from the tar, or stay as they are on the NAND
+int import_save_dir(uint64_t title_id, const char* dir_path);
+int import_save_tar(uint64_t title_id, const char* tar_path);
+
+// Moves a freshly built data directory (which has to be called "data" too) over the title's current one
+int swap_data_dir(uint64_t title_id, const char* new_data_dir);
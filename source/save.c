@@ -7,17 +7,145 @@
 #include <ogc/isfs.h>
 #include <ogc/es.h>
 #include <ogc/sha.h>
+#include <ogc/lwp_watchdog.h>
 #include <mbedtls/aes.h>
-#include <mbedtls/sha1.h>
 
 #include "common.h"
 #include "save.h"
 #include "ncd.h"
-#include "u8.h"
+#include "u8stream.h"
 #include "identify.h"
+#include "tar.h"
+#include "lz77.h"
+#include "pipeline.h"
+#include "crypto.h"
+#include "hash.h"
+#include "nand.h"
+#include "readahead.h"
+#include "bufpool.h"
+#include "journal.h"
+
+const char* const save_stage_names[SAVE_NUM_STAGES] = {
+	[SAVE_STAGE_NAND]   = "nand",
+	[SAVE_STAGE_ES]     = "es",
+	[SAVE_STAGE_CRYPTO] = "crypto",
+	[SAVE_STAGE_SD]     = "sd",
+};
+
+static unsigned int chunk_sizes[SAVE_NUM_STAGES] = {
+	SAVE_DEFAULT_CHUNK, SAVE_DEFAULT_CHUNK, SAVE_DEFAULT_CHUNK, SAVE_DEFAULT_CHUNK,
+};
+
+// Reads kept in flight on a NAND file while the last chunk is being dealt with
+#define NAND_READAHEAD 2
+
+int save_set_chunk_size(enum save_stage stage, unsigned int size) {
+	if (stage >= SAVE_NUM_STAGES || size < SAVE_MIN_CHUNK || size > SAVE_MAX_CHUNK || size % BUFPOOL_ALIGN)
+		return -EINVAL;
+
+	chunk_sizes[stage] = size;
+	return 0;
+}
+
+unsigned int save_get_chunk_size(enum save_stage stage) {
+	return chunk_sizes[stage];
+}
+
+static int es_content_read(void* user, void* buf, unsigned int len) {
+	return ES_ReadContent(*(int *)user, buf, len);
+}
+
+static int es_content_seek(void* user, unsigned int offset) {
+	int ret = ES_SeekContent(*(int *)user, offset, SEEK_SET);
+	return (ret == offset) ? 0 : ret;
+}
+
+static const U8StreamIO es_content_io = { es_content_read, es_content_seek };
+
+// Opens one of the title's contents through its ticket views
+int open_title_content(uint64_t title_id, uint16_t index) {
+	int      ret;
+	uint32_t n_views = 0;
+	tikview *p_views = NULL;
+
+	ret = ES_GetNumTicketViews(title_id, &n_views);
+	if (ret < 0) {
+		print_error("ES_GetNumTicketViews", ret);
+		return ret;
+	}
+
+	p_views = memalign32(sizeof(tikview) * n_views);
+	if (!p_views) {
+		print_error("memory allocation", 0);
+		return -1;
+	}
+
+	ret = ES_GetTicketViews(title_id, p_views, n_views);
+	if (ret < 0) {
+		free(p_views);
+		print_error("ES_GetTicketViews", ret);
+		return ret;
+	}
+
+	ret = ES_OpenTitleContent(title_id, p_views, index);
+	free(p_views);
+	if (ret < 0)
+		print_error("ES_OpenTitleContent", ret);
+
+	return ret;
+}
+
+struct tar_sink {
+	tar_writer   tar;
+	const char  *prefix; // Where in the tar the archive goes, NULL for the top
+	unsigned int total;
+};
+
+static int tar_sink_directory(void* user, const char* path) {
+	struct tar_sink* sink = user;
+	char full_path[512];
+
+	if (sink->prefix) {
+		if (snprintf(full_path, sizeof(full_path), "%s/%s", sink->prefix, path) >= sizeof(full_path)) {
+			fprintf(stderr, "%s/%s: Path is too long\n", sink->prefix, path);
+			return -ENAMETOOLONG;
+		}
+
+		path = full_path;
+	}
+
+	return tar_add(&sink->tar, &(tar_entry){ path, 0, 0755, TAR_TYPE_DIRECTORY });
+}
+
+static int tar_sink_open(void* user, const char* path, unsigned int size) {
+	struct tar_sink* sink = user;
+	char full_path[512];
+
+	if (sink->prefix) {
+		if (snprintf(full_path, sizeof(full_path), "%s/%s", sink->prefix, path) >= sizeof(full_path)) {
+			fprintf(stderr, "%s/%s: Path is too long\n", sink->prefix, path);
+			return -ENAMETOOLONG;
+		}
+
+		path = full_path;
+	}
 
-__attribute__((aligned(0x40)))
-static unsigned char buffer[0x10000];
+	printf("%s (%#x)\n", path, size);
+	return tar_add(&sink->tar, &(tar_entry){ path, size, 0644, TAR_TYPE_FILE });
+}
+
+static int tar_sink_write(void* user, const void* buf, unsigned int len) {
+	struct tar_sink* sink = user;
+
+	sink->total += len;
+	return tar_write(&sink->tar, buf, len);
+}
+
+static int tar_sink_close(void* user) {
+	return 0;
+}
+
+static const U8Sink tar_sink_ops = { tar_sink_directory, tar_sink_open, tar_sink_write, tar_sink_close };
 
 static int get_bin_mode(const char* filepath, uint8_t* permissions, uint8_t* attributes) {
 	uint32_t ownerID;
@@ -38,181 +166,161 @@ static int get_bin_mode(const char* filepath, uint8_t* permissions, uint8_t* att
 	return 0;
 }
 
-static bool append_to_table(struct file_table* file_table, struct file_entry* file_entry) {
-	struct file_entry* temp = reallocarray(file_table->entries, ++file_table->num_entries, sizeof(struct file_entry));
-	if (!temp) {
-		print_error("memory allocation", 0);
-		return false;
-	}
-
-	file_table->entries = temp;
-	file_table->entries[file_table->num_entries - 1] = *file_entry;
-	return true;
-}
+struct export_sink {
+	sha1_ctx             *sha;
+	FILE                 *fp;
+};
 
-static int build_file_table(const char* path, struct file_table* file_table) {
-	int      ret;
-	char     file_path[0x40];
-	char*    file_list = NULL;
-	uint32_t num_files = 0;
+// Runs on the pipeline's thread, in the exact order everything was submitted
+static int export_sink_consume(void* user, const void* data, unsigned int len) {
+	struct export_sink* sink = user;
 
-	strcpy(file_path, path);
-
-	ret = ISFS_ReadDir(file_path, NULL, &num_files);
-	if (ret < 0) {
-		print_error("ISFS_ReadDir(%s)", ret, file_path);
-		return ret;
-	}
-
-	char file_list_buf[12 + 1][num_files] __attribute__((aligned(0x20)));
-	file_list = file_list_buf[0];
-	ret = ISFS_ReadDir(file_path, file_list, &num_files);
+	int ret = sha1_update(sink->sha, data, len);
 	if (ret < 0) {
-		print_error("ISFS_ReadDir(%s)", ret, file_path);
+		print_error("sha1_update", ret);
 		return ret;
 	}
 
-	const char* file_name = file_list;
-	for (int i = 0; i < num_files; i++) {
-		uint32_t file_stats[2] __attribute__((aligned(0x20)));
-		struct file_entry temp = {};
-
-		sprintf(strrchr(file_path, 0), "/%s", file_name);
-		strcpy(temp.relative_path, file_path + 30);
-
-		ret = get_bin_mode(file_path, &temp.permissions, &temp.attributes);
-		if (ret < 0)
-			return ret;
-
-		int fd = ret = ISFS_Open(file_path, 1);
-		if (ret == ISFS_EINVAL) {
-			temp.type = 2;
-			temp.file_size = 0;
-			if (!append_to_table(file_table, &temp)) {
-				print_error("memory allocation", 0);
-				return -1;
-			}
-			ret = build_file_table(file_path, file_table);
-			if (ret < 0)
-				return ret;
-		}
-		else if (ret < 0) {
-			print_error("ISFS_Open(%s)", ret, file_path + 30);
-			return ret;
-		}
-		else {
-			temp.type = 1;
-			ret = ISFS_GetFileStats(fd, (fstats*) file_stats);
-			if (ret < 0) {
-				print_error("ISFS_GetFileStats", ret);
-				return ret;
-			}
-
-			temp.file_size = file_stats[0];
-			if (!append_to_table(file_table, &temp)) {
-				print_error("memory allocation", 0);
-				return -1;
-			}
-		}
-
-		file_name += strlen(file_name) + 1;
-		*(strrchr(file_path, '/')) = '\0';
+	if (!fwrite(data, len, 1, sink->fp)) {
+		print_error("fwrite", errno);
+		return -errno;
 	}
 
 	return 0;
 }
 
-static int write_file_table(const char* data_path, struct file_table* file_table, mbedtls_sha1_context* sha, FILE* fp) {
-	char     file_path[0x40] __attribute__((aligned(0x20)));
-	int      ret;
+// NAND reads and encryption happen here, hashing and writing to SD happen on the pipeline's thread
+static int write_file_table(const char* data_path, struct file_table* file_table, sha1_ctx* sha, FILE* fp, bool hash_files) {
+	char               file_path[0x40] __attribute__((aligned(0x20)));
+	int                ret = 0;
+	pipeline           pipe;
+	struct export_sink sink = { sha, fp };
 
 	strcpy(file_path, data_path);
 
+	// Encrypted straight into the pipeline's buffers, so they match the reads
+	ret = pipeline_start(&pipe, 3, chunk_sizes[SAVE_STAGE_NAND], export_sink_consume, &sink);
+	if (ret < 0) {
+		print_error("pipeline_start", ret);
+		return ret;
+	}
+
 	for (int i = 0; i < file_table->num_entries; i++) {
 		struct file_entry* entry = &file_table->entries[i];
 
 		__attribute__((aligned(0x20)))
 		uint32_t iv[4] = { 0x74686570, 0x696b6163, 0x68756761, 0x6d65723c + i };
-		__attribute__((aligned(0x40)))
-		struct file_header file = {};
-
-		file.magic       = FILE_HDR_MAGIC;
-		strcpy(file.name,  entry->relative_path);
-		file.type        = entry->type;
-		file.size        = entry->file_size;
-		file.permissions = entry->permissions;
-		file.attributes  = entry->attributes;
-		memcpy(file.iv,    iv, sizeof(iv));
-
-		mbedtls_sha1_update_ret(sha, (const unsigned char *)&file, sizeof(file));
-		if (!fwrite(&file, sizeof(file), 1, fp)) {
-			print_error("fwrite", errno);
-			return -errno;
+		struct file_header* file = pipeline_acquire(&pipe);
+		if (!file) {
+			ret = pipe.error;
+			break;
 		}
 
-		if (file.type == 2 || strcmp(entry->relative_path, "banner.bin") == 0)
+		memset(file, 0, sizeof(*file));
+		file->magic       = FILE_HDR_MAGIC;
+		strcpy(file->name,  entry->relative_path);
+		file->type        = entry->type;
+		file->size        = entry->file_size;
+		file->permissions = entry->permissions;
+		file->attributes  = entry->attributes;
+		memcpy(file->iv,    iv, sizeof(iv));
+
+		if ((ret = pipeline_submit(&pipe, sizeof(*file))) < 0)
+			break;
+
+		if (entry->type == 2 || strcmp(entry->relative_path, "banner.bin") == 0)
 			continue;
 
 		printf("Processing %s (%#x, %uKiB)\n", entry->relative_path, entry->file_size, (entry->file_size + 0x3FF) >> 10);
-		sprintf(file_path + 29, "/%s", entry->relative_path);
+		sprintf(file_path + NAND_DATA_DIR_LEN, "/%s", entry->relative_path);
 		int fd = ret = ISFS_Open(file_path, ISFS_OPEN_READ);
 		if (ret < 0) {
 			print_error("ISFS_Open", ret);
-			return ret;
+			break;
 		}
 
-		unsigned processed = 0;
-		while (processed < entry->file_size) {
-			unsigned read = (entry->file_size - processed > sizeof(buffer)) ? sizeof(buffer) : entry->file_size - processed;
+		sha1_ctx file_sha;
+		if (hash_files)
+			sha1_init(&file_sha);
+
+		readahead ra;
+		ret = readahead_start(&ra, fd, entry->file_size, NAND_READAHEAD, pipe.buffer_size);
+		if (ret < 0) {
+			print_error("readahead_start", ret);
+			ISFS_Close(fd);
+			break;
+		}
 
-			int ret = ISFS_Read(fd, buffer, read);
-			if (ret <= 0) {
-				print_error("ISFS_Read", ret);
+		void* chunk;
+		while ((ret = readahead_next(&ra, &chunk)) > 0) {
+			unsigned read = ret;
+			unsigned char* data = pipeline_acquire(&pipe);
+			if (!data) {
+				ret = pipe.error;
 				break;
 			}
 
-			ret = ES_Encrypt(ES_KEY_SDCARD, iv, buffer, align_up(read, 0x40), buffer);
+			if (hash_files)
+				sha1_update(&file_sha, chunk, read);
+
+			// Straight from the read buffer into the pipeline's. Tail end of the last block is whatever was left in there, same as it always was
+			unsigned read64 = align_up(read, 0x40);
+			for (unsigned done = 0; done < read64 && ret >= 0; done += chunk_sizes[SAVE_STAGE_CRYPTO]) {
+				unsigned piece = (read64 - done > chunk_sizes[SAVE_STAGE_CRYPTO]) ? chunk_sizes[SAVE_STAGE_CRYPTO] : read64 - done;
+
+				ret = sd_encrypt(iv, (unsigned char *)chunk + done, piece, data + done);
+			}
+
 			if (ret < 0) {
-				print_error("ES_Encrypt", ret);
+				print_error("sd_encrypt", ret);
 				break;
 			}
 
-			mbedtls_sha1_update_ret(sha, buffer, align_up(read, 0x40));
-
-			if (!fwrite(buffer, align_up(read, 0x40), 1, fp)) {
-				print_error("fwrite", errno);
-				ret = -errno;
+			if ((ret = pipeline_submit(&pipe, align_up(read, 0x40))) < 0)
 				break;
-			}
+		}
 
-			processed += read;
+		int ra_ret = readahead_finish(&ra);
+		if (ra_ret < 0) {
+			print_error("ISFS_Read(%s)", ra_ret, entry->relative_path);
+			if (ret >= 0)
+				ret = ra_ret;
 		}
 
 		ISFS_Close(fd);
+		if (hash_files)
+			sha1_finish(&file_sha, entry->sha1);
+
 		if (ret < 0)
-			return ret;
+			break;
 	}
 
-	return 0;
-}
+	int pipe_ret = pipeline_finish(&pipe);
+	if (pipe_ret < 0) {
+		print_error("pipeline", pipe_ret);
+		if (ret >= 0)
+			ret = pipe_ret;
+	}
 
-static void free_file_table(struct file_table* table) {
-	free(table->entries);
-	table->entries = NULL;
-	table->num_entries = 0;
+	return (ret < 0) ? ret : 0;
 }
 
-int export_save(uint64_t title_id, FILE* fp) {
+int export_save(uint64_t title_id, FILE* fp, struct file_table* hashed) {
 	int              ret;
 	char             data_path[ISFS_MAXPATH] __attribute__((aligned(0x20))) = {};
+	unsigned char   *buffer = bufpool_acquire(sizeof(struct data_bin));
 	struct data_bin *save = (struct data_bin *)buffer; // just enough space is here, and i personally didn't like the idea of.... 0xF0C0.... 64 kilos on my stack
 	struct bk_header bk_header = {};
 	uint32_t         iv[4] __attribute__((aligned(0x20)));
 	uint32_t         hash[5] __attribute__((aligned(0x20)));
+	struct file_table table = {};
 	// you all can go here too
 	unsigned char   *ap_signature = buffer;
 	struct ecc_cert *certificates = (struct ecc_cert *)(buffer + SIG_SZ); // [NG, AP] // WHERE IS MS!!!
 
+	if (!buffer)
+		return -ENOMEM;
+
 	if (identify_sm() == 0) {
 		ret = ES_SetUID(title_id);
 		if (ret < 0) {
@@ -223,21 +331,30 @@ int export_save(uint64_t title_id, FILE* fp) {
 	ret = ES_GetDataDir(title_id, data_path);
 	if (ret < 0) {
 		print_error("ES_GetDataDir", ret);
-		return ret;
+		goto foiled;
 	}
 
 	strcat(data_path, "/banner.bin");
 	int fd = ret = ISFS_Open(data_path, ISFS_OPEN_READ);
 	if (ret < 0) {
 		print_error("ISFS_Open(banner.bin)", ret);
-		return ret;
+		goto foiled;
 	}
 
 	int banner_sz = ret = ISFS_Read(fd, (void*)&save->banner, sizeof(save->banner));
 	ISFS_Close(fd);
 	if (ret < FULL_BNR_MIN) {
 		print_error("ISFS_Read(banner.bin)", ret);
-		return ret;
+		goto foiled;
+	}
+
+	// Before the nocopy flag comes off, so it matches what's on the NAND
+	uint8_t banner_hash[20];
+	if (hashed) {
+		sha1_ctx banner_sha;
+		sha1_init(&banner_sha);
+		sha1_update(&banner_sha, &save->banner, banner_sz);
+		sha1_finish(&banner_sha, banner_hash);
 	}
 
 	// nocopy
@@ -247,17 +364,22 @@ int export_save(uint64_t title_id, FILE* fp) {
 	save->header.banner_sz = banner_sz;
 	ret = get_bin_mode(data_path, &save->header.permissions, &save->header.attributes);
 	if (ret < 0)
-		return ret;
+		goto foiled;
 
 	memcpy(save->header.md5_sum, md5_blanker, sizeof(save->header.md5_sum));
 	mbedtls_md5_ret(buffer, sizeof(struct data_bin), (unsigned char *)save->header.md5_sum);
 
 	memcpy(iv, sd_initial_iv, sizeof(sd_initial_iv));
-	ES_Encrypt(ES_KEY_SDCARD, iv, buffer, sizeof(struct data_bin), buffer);
+	ret = sd_encrypt(iv, buffer, sizeof(struct data_bin), buffer);
+	if (ret < 0) {
+		print_error("sd_encrypt", ret);
+		goto foiled;
+	}
 
 	if (!fwrite(buffer, sizeof(struct data_bin), 1, fp)) {
 		print_error("fwrite", ret);
-		return -errno;
+		ret = -errno;
+		goto foiled;
 	}
 
 	*(strrchr(data_path, '/')) = 0;
@@ -269,12 +391,12 @@ int export_save(uint64_t title_id, FILE* fp) {
 
 	if (ret < 0) {
 		print_error("ES_GetDeviceID", ret);
-		return ret;
+		goto foiled;
 	}
-	struct file_table table = {};
+
 	ret = build_file_table(data_path, &table);
 	if (ret < 0)
-		return ret;
+		goto foiled;
 
 	bk_header.num_files = table.num_entries;
 	for (struct file_entry* entry = table.entries; entry - table.entries < table.num_entries; entry++)
@@ -283,9 +405,9 @@ int export_save(uint64_t title_id, FILE* fp) {
 	bk_header.total_size = bk_header.total_files_size + FULL_CERT_SZ;
 
 	// OK, Bk header is all done
-	mbedtls_sha1_context sha;
-	mbedtls_sha1_starts_ret(&sha);
-	mbedtls_sha1_update_ret(&sha, (const unsigned char *)&bk_header, sizeof(bk_header));
+	sha1_ctx sha;
+	sha1_init(&sha);
+	sha1_update(&sha, &bk_header, sizeof(bk_header));
 
 	if (!fwrite(&bk_header, sizeof(struct bk_header), 1, fp)) {
 		print_error("fwrite", errno);
@@ -293,11 +415,18 @@ int export_save(uint64_t title_id, FILE* fp) {
 		goto foiled;
 	}
 
-	ret = write_file_table(data_path, &table, &sha, fp);
+	if (hashed) {
+		for (struct file_entry* entry = table.entries; entry - table.entries < table.num_entries; entry++) {
+			if (strcmp(entry->relative_path, "banner.bin") == 0)
+				memcpy(entry->sha1, banner_hash, sizeof(banner_hash));
+		}
+	}
+
+	ret = write_file_table(data_path, &table, &sha, fp, hashed != NULL);
 	if (ret < 0)
 		goto foiled;
 
-	mbedtls_sha1_finish_ret(&sha, (unsigned char *)hash);
+	sha1_finish(&sha, (uint8_t *)hash);
 
 	ret = ES_GetDeviceCert((u8 *)&certificates[0]);
 	if (ret < 0) {
@@ -319,20 +448,145 @@ int export_save(uint64_t title_id, FILE* fp) {
 		goto foiled;
 	}
 
-	free_file_table(&table);
+	// Caller's now, hashes and all
+	if (hashed)
+		*hashed = table;
+	else
+		free_file_table(&table);
+
+	bufpool_release(buffer);
 	return 0;
 
 foiled:
+	free_file_table(&table);
+	bufpool_release(buffer);
+	return ret;
+}
+
+static int hash_nand_file(const char* path, uint32_t size, uint8_t hash[20]) {
+	int      ret = 0;
+	sha1_ctx sha;
+
+	int fd = ret = nand_open(path, NAND_OPEN_READ);
+	if (ret < 0) {
+		print_error("ISFS_Open(%s)", ret, path);
+		return ret;
+	}
+
+	readahead ra;
+	ret = readahead_start(&ra, fd, size, NAND_READAHEAD, chunk_sizes[SAVE_STAGE_NAND]);
+	if (ret < 0) {
+		print_error("readahead_start", ret);
+		nand_close(fd);
+		return ret;
+	}
+
+	void* chunk;
+	sha1_init(&sha);
+	while ((ret = readahead_next(&ra, &chunk)) > 0)
+		sha1_update(&sha, chunk, ret);
+
+	if (readahead_finish(&ra) < 0)
+		print_error("ISFS_Read(%s)", ret, path);
+
+	nand_close(fd);
+	sha1_finish(&sha, hash);
+	return (ret < 0) ? ret : 0;
+}
+
+int save_unchanged(uint64_t title_id, const struct file_table* manifest) {
+	int               ret;
+	char              data_path[NAND_MAXPATH], file_path[NAND_MAXPATH];
+	struct file_table table;
+
+	if (identify_sm() == 0) {
+		ret = ES_SetUID(title_id);
+		if (ret < 0)
+			print_error("ES_SetUID", ret);
+	}
+
+	ret = nand_get_data_dir(title_id, data_path);
+	if (ret < 0) {
+		print_error("ES_GetDataDir", ret);
+		return ret;
+	}
+
+	ret = build_file_table(data_path, &table);
+	if (ret < 0)
+		return ret;
+
+	// Anything added, removed, resized or chmod'ed shows up without reading a byte
+	ret = (table.num_entries == manifest->num_entries);
+	for (int i = 0; ret == 1 && i < table.num_entries; i++) {
+		const struct file_entry *entry = &table.entries[i], *old = &manifest->entries[i];
+
+		if (strcmp(entry->relative_path, old->relative_path) || entry->type != old->type || entry->file_size != old->file_size
+		||  entry->attributes != old->attributes || entry->permissions != old->permissions)
+		{
+			printf("%s is different\n", entry->relative_path);
+			ret = 0;
+		}
+	}
+
+	// Same shape, so it's down to the contents. First one that's off ends it
+	for (int i = 0; ret == 1 && i < table.num_entries; i++) {
+		struct file_entry* entry = &table.entries[i];
+		if (entry->type != 1)
+			continue;
+
+		sprintf(file_path, "%s/%s", data_path, entry->relative_path);
+		ret = hash_nand_file(file_path, entry->file_size, entry->sha1);
+		if (ret < 0)
+			break;
+
+		ret = (memcmp(entry->sha1, manifest->entries[i].sha1, sizeof(entry->sha1)) == 0);
+		if (!ret)
+			printf("%s changed\n", entry->relative_path);
+	}
+
 	free_file_table(&table);
 	return ret;
 }
 
-int extract_save(uint64_t title_id, const char* out_dir) {
-	int   ret, fd;
-	FILE *fp = NULL;
-	char  data_path[ISFS_MAXPATH] __attribute__((aligned(0x20)));
-	char  file_path[256];
-	char *file_path_in, *file_path_out = stpcpy(file_path, out_dir);
+// NAND permissions (owner/group/other, 2 bits each) as a Unix mode, directories get x wherever they get r
+static unsigned tar_mode(const struct file_entry* entry) {
+	unsigned mode = 0;
+
+	for (int i = 0; i < 3; i++) {
+		unsigned bits = (entry->permissions >> (i * 2)) & 3;
+		unsigned unix_bits = ((bits & 1) ? 4 : 0) | ((bits & 2) ? 2 : 0);
+
+		if (entry->type == 2 && (bits & 1))
+			unix_bits |= 1;
+
+		mode |= unix_bits << (i * 3);
+	}
+
+	return mode;
+}
+
+static int tar_add_entry(tar_writer* tar, const struct file_entry* entry) {
+	char pax[128], value[8];
+	int  len;
+
+	// The Unix mode covers the permissions, but not the attributes. Both go in as they are
+	sprintf(value, "%#x", entry->attributes);
+	len = tar_pax_record(pax, sizeof(pax), SAVE_PAX_ATTRIBUTES, value);
+	sprintf(value, "%#x", entry->permissions);
+	tar_pax_record(pax + len, sizeof(pax) - len, SAVE_PAX_PERMISSIONS, value);
+
+	return tar_add(tar, &(tar_entry){ entry->relative_path, entry->file_size, tar_mode(entry), (entry->type == 2) ? TAR_TYPE_DIRECTORY : TAR_TYPE_FILE, pax });
+}
+
+int extract_save(uint64_t title_id, const char* out_path, bool tar) {
+	int         ret, fd;
+	FILE       *fp = NULL;
+	char        data_path[ISFS_MAXPATH] __attribute__((aligned(0x20)));
+	char        file_path[256];
+	char       *file_path_in, *file_path_out = stpcpy(file_path, out_path);
+	tar_writer  tar_out;
+	unsigned    total = 0;
+	void       *staging = NULL;
 
 	ret = ES_GetDataDir(title_id, data_path);
 	if (ret < 0) {
@@ -347,17 +601,40 @@ int extract_save(uint64_t title_id, const char* out_dir) {
 	if (ret < 0)
 		return ret;
 
+	// One file, and a whole chunk for staging, so FAT only ever sees big sequential writes
+	if (tar) {
+		if (!(staging = bufpool_acquire(chunk_sizes[SAVE_STAGE_SD]))) {
+			free_file_table(&table);
+			return -ENOMEM;
+		}
+
+		fp = fopen(out_path, "wb");
+		if (!fp) {
+			perror(out_path);
+			bufpool_release(staging);
+			free_file_table(&table);
+			return -errno;
+		}
+
+		tar_init(&tar_out, fp, staging, chunk_sizes[SAVE_STAGE_SD]);
+	}
+
 	for (int i = 0; i < table.num_entries; i++) {
 		struct file_entry* entry =  &table.entries[i];
 
 		sprintf(file_path_in,  "/%s", entry->relative_path);
 		sprintf(file_path_out, "/%s", entry->relative_path);
 
+		if (tar && (ret = tar_add_entry(&tar_out, entry)) < 0) {
+			print_error("tar_add(%s)", ret, entry->relative_path);
+			break;
+		}
+
 		if (entry->type == 2) {
-			ret = mkdir(file_path, 0644);
-			if (ret < 0 && errno != EEXIST) {
+			if (!tar && mkdir(file_path, 0644) < 0 && errno != EEXIST) {
 				perror(file_path_out);
-				return ret;
+				ret = -errno;
+				break;
 			}
 
 			continue;
@@ -367,83 +644,107 @@ int extract_save(uint64_t title_id, const char* out_dir) {
 		ret = fd = ISFS_Open(data_path, ISFS_OPEN_READ);
 		if (ret < 0) {
 			print_error("ISFS_Open", ret);
-			return ret;
+			break;
 		}
 
-		fp = fopen(file_path, "wb");
-		if (!fp) {
+		if (!tar) {
+			if (!(fp = fopen(file_path, "wb"))) {
+				ret = -errno;
+				ISFS_Close(fd);
+				perror(file_path_out);
+				break;
+			}
+
+			setvbuf(fp, NULL, _IOFBF, chunk_sizes[SAVE_STAGE_SD]);
+		}
+
+		readahead ra;
+		ret = readahead_start(&ra, fd, entry->file_size, NAND_READAHEAD, chunk_sizes[SAVE_STAGE_NAND]);
+		if (ret < 0) {
+			print_error("readahead_start", ret);
 			ISFS_Close(fd);
-			perror(file_path_out);
-			return -errno;
+			break;
 		}
 
-		unsigned processed = 0;
-		while (processed < entry->file_size) {
-			unsigned read = (entry->file_size - processed > sizeof(buffer)) ? sizeof(buffer) : entry->file_size - processed;
+		void* chunk;
+		while ((ret = readahead_next(&ra, &chunk)) > 0) {
+			int len = ret;
 
-			int ret = ISFS_Read(fd, buffer, read);
-			if (ret <= 0) {
-				print_error("ISFS_Read", ret);
-				break;
+			if (tar) {
+				ret = tar_write(&tar_out, chunk, len);
 			}
-
-			if (!fwrite(buffer, ret, 1, fp)) {
-				print_error("fwrite", errno);
+			else if (!fwrite(chunk, len, 1, fp)) {
 				ret = -errno;
-				break;
+				print_error("fwrite", ret);
 			}
 
-			processed += ret;
+			if (ret < 0)
+				break;
+
+			total += len;
 		}
 
+		if (readahead_finish(&ra) < 0)
+			print_error("ISFS_Read", ret);
+
 		ISFS_Close(fd);
-		fclose(fp);
+		if (!tar) {
+			fclose(fp);
+			fp = NULL;
+		}
+
 		if (ret < 0)
-			return ret;
+			break;
 	}
 
-	return 0;
+	if (tar) {
+		if (ret >= 0)
+			ret = tar_finish(&tar_out);
+
+		if (fclose(fp) != 0 && ret >= 0) {
+			perror(out_path);
+			ret = -errno;
+		}
+
+		printf("Wrote %#x bytes of files\n", total);
+	}
+	else if (fp) {
+		fclose(fp);
+	}
+
+	bufpool_release(staging);
+	free_file_table(&table);
+	return (ret < 0) ? ret : 0;
+}
+
+static int es_export_read(void* user, void* buf, unsigned int len) {
+	int ret = ES_ExportContentData(*(int *)user, buf, len);
+	if (ret < 0)
+		print_error("ES_ExportContentData", ret);
+
+	return (ret < 0) ? ret : 0;
 }
 
-int export_content(uint64_t title_id, FILE* fp) {
+int export_content(uint64_t title_id, FILE* fp, const char* journal_path) {
 	int             ret, cfd = -1, cfdx = -1;
-	uint32_t        n_views = 0;
-	tikview        *p_views = NULL;
-	U8Context       ctx = {};
-	U8File          meta_icon = {};
+	U8Stream        u8_stream;
+	U8StreamFile    meta_icon = {};
+	unsigned int    chunk_size = chunk_sizes[SAVE_STAGE_ES];
+	unsigned char  *buffer = bufpool_acquire(chunk_size); // Never smaller than the header, see SAVE_MIN_CHUNK
 	content_header *header = (content_header *)buffer;
-	U8Header       *u8_header = (U8Header *)(buffer + sizeof(*header));
 	bk_header      *bk_header = (struct bk_header *)buffer;
 	signed_blob    *s_tmd = NULL;
 	void           *ptr_icon = NULL;
 	uint32_t        iv[4];
+	journal         jr = {};
+	bool            done = false;
 
+	if (!buffer)
+		return -ENOMEM;
 
-	ret = ES_GetNumTicketViews(title_id, &n_views);
-	if (ret < 0) {
-		print_error("ES_GetNumTicketViews", ret);
-		goto exit;
-	}
-
-	p_views = memalign32(sizeof(tikview) * n_views);
-	if (!p_views) {
-		print_error("memory allocation", 0);
-		goto exit;
-	}
-
-	ret = ES_GetTicketViews(title_id, p_views, n_views);
-	if (ret < 0) {
-		free(p_views);
-		print_error("ES_GetTicketViews", ret);
-		goto exit;
-	}
-
-	ret = cfd = ES_OpenTitleContent(title_id, p_views, 0);
-	free(p_views);
-	if (ret < 0) {
-		print_error("ES_OpenTitleContent", ret);
+	ret = cfd = open_title_content(title_id, 0);
+	if (ret < 0)
 		goto exit;
-	}
 
 	ret = ES_ReadContent(cfd, buffer, sizeof(struct content_header));
 	if (ret != sizeof(struct content_header)) {
@@ -455,35 +756,17 @@ int export_content(uint64_t title_id, FILE* fp) {
 	for (int i = 0; i < 0x40; i += 4)
 		memcpy(buffer + i, ":3c", 4);
 
-	ret = ES_ReadContent(cfd, (u8 *)u8_header, sizeof(U8Header));
-	if (ret != sizeof(U8Header)) {
-		print_error("ES_ReadContent", ret);
-		goto exit;
-	}
-
-	if (u8_header->magic != U8_MAGIC) {
-		fprintf(stderr, "What's up with this banner? (U8 header is invalid!)\n");
-		ret = -1;
-		goto exit;
-	}
-
-	unsigned full_hdr_size = u8_header->root_node_offset + u8_header->meta_size;
-	ES_SeekContent(cfd, -sizeof(U8Header), SEEK_CUR);
-	ret = ES_ReadContent(cfd, (u8 *)u8_header, full_hdr_size);
-	if (ret != full_hdr_size) {
-		print_error("ES_ReadContent", ret);
-		goto exit;
-	}
-
-	ret = U8Init(u8_header, &ctx);
+	// The banner's U8 archive follows the header; only pull in what we need from it
+	ret = U8StreamInit(&u8_stream, &es_content_io, &cfd, sizeof(struct content_header), 0);
 	if (ret != 0) {
-		print_error("U8Init", ret);
+		fprintf(stderr, "What's up with this banner? (U8 header is invalid!)\n");
+		print_error("U8StreamInit", ret);
 		goto exit;
 	}
 
-	ret = U8OpenFile(&ctx, "/meta/icon.bin", &meta_icon);
+	ret = U8StreamOpenFile(&u8_stream, "/meta/icon.bin", &meta_icon);
 	if (ret != 0) {
-		print_error("U8OpenFile(%s)", ret, "/meta/icon.bin");
+		print_error("U8StreamOpenFile(%s)", ret, "/meta/icon.bin");
 		goto exit;
 	}
 	printf("icon.bin size: %#x\n", meta_icon.size);
@@ -496,18 +779,11 @@ int export_content(uint64_t title_id, FILE* fp) {
 	}
 	memset(ptr_icon, 0, icon_size64);
 
-	unsigned meta_offset = sizeof(*header) + meta_icon.offset;
-	ret = ES_SeekContent(cfd, meta_offset, SEEK_SET);
-	if (ret != meta_offset) {
-		print_error("ES_SeekContent(%#x)", ret, meta_offset);
-		goto exit;
-	}
-
-	ret = ES_ReadContent(cfd, ptr_icon, meta_icon.size);
+	ret = U8StreamRead(&meta_icon, ptr_icon, meta_icon.size);
 	ES_CloseContent(cfd);
 	cfd = -1;
 	if (ret != meta_icon.size) {
-		print_error("ES_ReadContent(%#x)", ret, meta_icon.size);
+		print_error("U8StreamRead(%#x)", ret, meta_icon.size);
 		goto exit;
 	}
 	mbedtls_md5_ret(ptr_icon, icon_size64, (unsigned char *)header->icon_md5);
@@ -520,16 +796,16 @@ int export_content(uint64_t title_id, FILE* fp) {
 
 	// we are clear now
 	memcpy(iv, sd_initial_iv, sizeof(iv));
-	ret = ES_Encrypt(ES_KEY_SDCARD, iv, header, sizeof(content_header), header);
+	ret = sd_encrypt(iv, header, sizeof(content_header), header);
 	if (ret < 0) {
-		print_error("ES_Encrypt", ret);
+		print_error("sd_encrypt", ret);
 		goto exit;
 	}
 
 	memcpy(iv, sd_initial_iv, sizeof(iv));
-	ret = ES_Encrypt(ES_KEY_SDCARD, iv, ptr_icon, icon_size64, ptr_icon);
+	ret = sd_encrypt(iv, ptr_icon, icon_size64, ptr_icon);
 	if (ret < 0) {
-		print_error("ES_Encrypt", ret);
+		print_error("sd_encrypt", ret);
 		goto exit;
 	}
 
@@ -590,16 +866,34 @@ int export_content(uint64_t title_id, FILE* fp) {
 	bk_header->total_size = tmd_size64 + bk_header->total_contents_size + FULL_CERT_SZ; // ?
 
 	// OK!
-	mbedtls_sha1_context sha;
-	mbedtls_sha1_starts_ret(&sha);
-	mbedtls_sha1_update_ret(&sha, (const unsigned char *)bk_header, sizeof(struct bk_header));
-	mbedtls_sha1_update_ret(&sha, (const unsigned char *)s_tmd, tmd_size64);
-
 	if (!fwrite(bk_header, sizeof(struct bk_header), 1, fp)
 	||	!fwrite(s_tmd, tmd_size64,  1, fp))
 	{
 		print_error("fwrite", errno);
 		ret = -errno;
+		goto exit;
+	}
+
+	// Same title, same TMD, then whatever's already in the file from last time is still good
+	uint8_t  tmd_sha1[20];
+	sha1_ctx sha;
+	sha1_init(&sha);
+	sha1_update(&sha, s_tmd, bk_header->tmd_size);
+	sha1_finish(&sha, tmd_sha1);
+
+	ret = journal_open(&jr, journal_path, fp, title_id, tmd_sha1);
+	if (ret < 0) {
+		print_error("journal_open", ret);
+		goto exit;
+	}
+
+	if (ret == 0) {
+		sha1_update(&jr.state.sha, bk_header, sizeof(struct bk_header));
+		sha1_update(&jr.state.sha, s_tmd, tmd_size64);
+		jr.state.file_offset = ftell(fp);
+	}
+	else {
+		printf("Picking up from content %u, offset %#x\n", jr.state.content, jr.state.content_offset);
 	}
 
 	for (int i = 0; i < p_tmd->num_contents; i++) {
@@ -608,6 +902,9 @@ int export_content(uint64_t title_id, FILE* fp) {
 		if (con->type & 0x8000) // We don't care
 			continue;
 
+		if (i < jr.state.content) // Already there
+			continue;
+
 		printf("Processing content %i (%08x, %#llx)\n", con->index, con->cid, con->size);
 		ret = cfdx = ES_ExportContentBegin(title_id, con->cid);
 		if (ret < 0) {
@@ -615,38 +912,22 @@ int export_content(uint64_t title_id, FILE* fp) {
 			break;
 		}
 
-		unsigned processed = 0;
-		while (processed < (unsigned)con->size) {
-			unsigned process = (con->size - processed > sizeof(buffer)) ? sizeof(buffer) : con->size - processed;
-			unsigned process64 = align_up(process, 0x40);
-
-			ret = ES_ExportContentData(cfdx, buffer, process64);
-			if (ret < 0) {
-				print_error("ES_ExportContentData", ret);
-				break;
-			}
-
-			mbedtls_sha1_update_ret(&sha, buffer, process64);
-
-			if (!fwrite(buffer, process64, 1, fp)) {
-				print_error("fwrite", -errno);
-				ret = -errno;
-				break;
-			}
-
-			processed += process64;
-		}
-
+		ret = journal_copy(&jr, i, con->size, es_export_read, &cfdx, buffer, chunk_size);
 		ES_ExportContentEnd(cfdx);
-		if (ret < 0)
+		if (ret < 0) {
+			print_error("journal_copy", ret);
 			break;
+		}
 	}
 
+	if (ret < 0)
+		goto exit;
+
 	unsigned char   *ap_signature = buffer;
 	struct ecc_cert *certificates = (struct ecc_cert *)(buffer + SIG_SZ);
 	unsigned char   *hash         = (unsigned char *)&certificates[2];
 
-	mbedtls_sha1_finish_ret(&sha, hash);
+	sha1_finish(&jr.state.sha, hash);
 
 	ret = ES_GetDeviceCert((u8 *)&certificates[0]);
 	if (ret < 0) {
@@ -665,9 +946,14 @@ int export_content(uint64_t title_id, FILE* fp) {
 		ret = -errno;
 	}
 
+	done = (ret >= 0);
+
 exit:
+	// Kept around if it didn't make it, for next time
+	journal_close(&jr, journal_path, done);
 	free(ptr_icon);
 	free(s_tmd);
+	bufpool_release(buffer);
 
 	if (cfd >= 0)
 		ES_CloseContent(cfd);
@@ -676,3 +962,169 @@ exit:
 
 	return ret;
 }
+
+// banner.bin and icon.bin are U8 archives of their own, normally behind IMD5 + LZ77
+static int extract_inner_archive(U8StreamFile* file, const U8Sink* sink_ops, void* sink, void* buffer, unsigned chunk_size) {
+	int         ret;
+	LZ77Stream *lz77 = aligned_alloc(0x40, sizeof(LZ77Stream));
+	U8Stream   *u8_stream = aligned_alloc(0x40, sizeof(U8Stream));
+	uint64_t    start = gettime();
+
+	if (!lz77 || !u8_stream) {
+		print_error("memory allocation", 0);
+		free(lz77);
+		free(u8_stream);
+		return -1;
+	}
+
+	u8_stream->meta = NULL; // U8StreamFree() is fine even if U8StreamInit() never gets to it
+
+	ret = LZ77StreamInit(lz77, &U8StreamSubIO, file, 0);
+	if (ret < 0) {
+		print_error("LZ77StreamInit", ret);
+		goto exit;
+	}
+
+	ret = U8StreamInit(u8_stream, &LZ77StreamIO, lz77, 0, (lz77->out_size != ~0u) ? lz77->out_size : 0);
+	if (ret < 0) {
+		print_error("U8StreamInit", ret);
+		goto exit;
+	}
+
+	// Going backwards means decompressing from the top again
+	ret = U8StreamCacheMeta(u8_stream);
+	if (ret < 0) {
+		print_error("U8StreamCacheMeta", ret);
+		goto exit;
+	}
+
+	ret = U8StreamExtractAll(u8_stream, sink_ops, sink, buffer, chunk_size);
+	if (ret < 0) {
+		print_error("U8StreamExtractAll", ret);
+		goto exit;
+	}
+
+	ret = LZ77StreamVerify(lz77);
+	if (ret < 0) {
+		print_error("LZ77StreamVerify", ret);
+		goto exit;
+	}
+
+	unsigned ms = diff_msec(start, gettime());
+	printf("%#x -> %#x bytes in %ums (%llu KiB/s)\n", file->size, lz77->out_pos, ms, ms ? (lz77->out_pos * 1000ULL / 1024 / ms) : 0);
+
+exit:
+	U8StreamFree(u8_stream);
+	LZ77StreamFree(lz77);
+	free(lz77);
+	free(u8_stream);
+	return ret;
+}
+
+int extract_banner(uint64_t title_id, const char* out_path, bool tar) {
+	static const char* const inner_archives[][2] = {
+		{ "/meta/banner.bin", "meta/banner" },
+		{ "/meta/icon.bin",   "meta/icon"   },
+	};
+	static const int num_inner_archives = sizeof(inner_archives) / sizeof(*inner_archives);
+
+	int       ret, cfd = -1;
+	U8Stream  u8_stream;
+	FILE     *fp = NULL;
+	// The tar writer gets one of its own for staging
+	unsigned  chunk_size = chunk_sizes[SAVE_STAGE_ES];
+	void     *buffer = bufpool_acquire(chunk_size);
+	void     *staging = tar ? bufpool_acquire(chunk_sizes[SAVE_STAGE_SD]) : NULL;
+
+	if (!buffer || (tar && !staging)) {
+		ret = -ENOMEM;
+		goto exit;
+	}
+
+	ret = cfd = open_title_content(title_id, 0);
+	if (ret < 0)
+		goto exit;
+
+	ret = U8StreamInit(&u8_stream, &es_content_io, &cfd, sizeof(struct content_header), 0);
+	if (ret != 0) {
+		fprintf(stderr, "What's up with this banner? (U8 header is invalid!)\n");
+		print_error("U8StreamInit", ret);
+		goto exit;
+	}
+
+	if (tar) {
+		struct tar_sink sink = {};
+
+		fp = fopen(out_path, "wb");
+		if (!fp) {
+			perror(out_path);
+			ret = -errno;
+			goto exit;
+		}
+
+		tar_init(&sink.tar, fp, staging, chunk_sizes[SAVE_STAGE_SD]);
+		ret = U8StreamExtractAll(&u8_stream, &tar_sink_ops, &sink, buffer, chunk_size);
+
+		for (int i = 0; ret == 0 && i < num_inner_archives; i++) {
+			U8StreamFile file;
+
+			if (U8StreamOpenFile(&u8_stream, inner_archives[i][0], &file) != 0)
+				continue;
+
+			sink.prefix = inner_archives[i][1];
+			ret = tar_add(&sink.tar, &(tar_entry){ sink.prefix, 0, 0755, TAR_TYPE_DIRECTORY });
+			if (ret == 0)
+				ret = extract_inner_archive(&file, &tar_sink_ops, &sink, buffer, chunk_size);
+		}
+
+		if (ret == 0)
+			ret = tar_finish(&sink.tar);
+
+		printf("Wrote %#x bytes of files\n", sink.total);
+	}
+	else {
+		U8DirSink sink = { out_path };
+
+		ret = mkdir(out_path, 0755);
+		if (ret < 0 && errno != EEXIST) {
+			perror(out_path);
+			ret = -errno;
+			goto exit;
+		}
+
+		ret = U8StreamExtractAll(&u8_stream, &U8DirSinkOps, &sink, buffer, chunk_size);
+
+		for (int i = 0; ret == 0 && i < num_inner_archives; i++) {
+			U8StreamFile file;
+			char         inner_path[128];
+
+			if (U8StreamOpenFile(&u8_stream, inner_archives[i][0], &file) != 0)
+				continue;
+
+			sprintf(inner_path, "%.64s/%s", out_path, inner_archives[i][1]);
+			ret = mkdir(inner_path, 0755);
+			if (ret < 0 && errno != EEXIST) {
+				perror(inner_path);
+				ret = -errno;
+				break;
+			}
+
+			U8DirSink inner_sink = { inner_path };
+			ret = extract_inner_archive(&file, &U8DirSinkOps, &inner_sink, buffer, chunk_size);
+		}
+	}
+
+	if (ret < 0)
+		print_error("U8StreamExtractAll", ret);
+
+exit:
+	if (fp && fclose(fp) != 0 && ret == 0)
+		ret = -errno;
+
+	if (cfd >= 0)
+		ES_CloseContent(cfd);
+
+	bufpool_release(staging);
+	bufpool_release(buffer);
+	return ret;
+}
@@ -1,8 +1,16 @@
 #include <stdint.h>
+#include <stdbool.h>
 #include <assert.h>
+#ifdef GEKKO
 #include <ogc/es.h>
+#else
+// Host builds (tools/) only need the shape of these
+typedef struct { uint32_t type; uint8_t sig[60]; uint8_t fill[64]; } __attribute__((packed)) sig_ecdsa;
+typedef struct { char issuer[64]; uint32_t cert_type; char cert_name[64]; uint32_t cert_id; uint8_t r[30]; uint8_t s[30]; uint8_t fill[60]; } __attribute__((packed)) cert_ecdsa;
+#endif
 #include <mbedtls/md5.h>
 #include "converter/converter.h"
+#include "filetable.h"
 
 #define CHECK_STRUCT_SIZE(T, size) _Static_assert(sizeof(T) == (size), "Size of " #T " is not " #size)
 
@@ -118,19 +126,35 @@ typedef struct data_bin {
 	struct save_banner banner;
 } data_header;
 
-struct file_entry {
-	char     relative_path[64 - 31];
-	uint8_t  permissions;
-	uint8_t  attributes;
-	uint8_t  type;
-	uint32_t file_size;
-};
+// How much the dump/extract functions move at once, per stage. Buffers come from the pool (bufpool.h).
+// Set from settings.ini, which tune.c fills in
+enum save_stage {
+	SAVE_STAGE_NAND,   // ISFS reads
+	SAVE_STAGE_ES,     // ES_ExportContentData, and ES_ReadContent for banners
+	SAVE_STAGE_CRYPTO, // sd_encrypt
+	SAVE_STAGE_SD,     // fwrite to SD/USB
 
-struct file_table {
-	unsigned int       num_entries;
-	struct file_entry *entries;
+	SAVE_NUM_STAGES,
 };
 
-int export_save(uint64_t title_id, FILE* out);
-int extract_save(uint64_t title_id, const char* out_dir);
-int export_content(uint64_t title_id, FILE* fp);
+extern const char* const save_stage_names[SAVE_NUM_STAGES];
+
+#define SAVE_DEFAULT_CHUNK 0x10000
+#define SAVE_MIN_CHUNK     0x4000   // Room for a content_header and then some
+#define SAVE_MAX_CHUNK     0x100000
+
+int          save_set_chunk_size(enum save_stage stage, unsigned int size); // A multiple of BUFPOOL_ALIGN, in range
+unsigned int save_get_chunk_size(enum save_stage stage);
+
+int export_save(uint64_t title_id, FILE* out, struct file_table* hashed); // hashed (optional) gets the file table, with every file's SHA-1
+int save_unchanged(uint64_t title_id, const struct file_table* manifest); // 1 if every file still matches, 0 if not
+int extract_save(uint64_t title_id, const char* out_path, bool tar); // tar: one archive at out_path instead of a directory tree
+
+// pax records in save tars with each entry's NAND attributes and permissions, as hex.
+// Dressed up as user xattrs so GNU tar and bsdtar pass over them quietly
+#define SAVE_PAX_ATTRIBUTES  "SCHILY.xattr.user.wii.attributes"
+#define SAVE_PAX_PERMISSIONS "SCHILY.xattr.user.wii.permissions"
+int export_content(uint64_t title_id, FILE* fp, const char* journal_path); // journal_path (optional) lets a failed export pick up where it left off, see journal.h
+int extract_banner(uint64_t title_id, const char* out_path, bool tar);
+
+int open_title_content(uint64_t title_id, uint16_t index); // ES_OpenTitleContent with the title's own ticket views, for decrypted reads
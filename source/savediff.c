@@ -0,0 +1,328 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <mbedtls/md5.h>
+
+#include "common.h"
+#include "save.h"
+#include "savediff.h"
+#include "crypto.h"
+#include "byteorder.h"
+
+// Read and decrypted in big pieces so the card keeps streaming, compared SAVE_DIFF_BLOCK at a time
+#define DIFF_CHUNK 0x10000
+
+struct diff_file {
+	char     name[0x41];
+	uint32_t size;
+	uint8_t  type, permissions, attributes;
+	long     offset; // Where the data starts in the data.bin
+	uint32_t iv[4];
+	bool     matched;
+};
+
+struct diff_side {
+	const char       *label;
+	FILE             *fp;
+	struct data_bin  *header;
+	struct diff_file *files;
+	unsigned int      num_files;
+	unsigned char    *buf;
+};
+
+// One file's changed blocks, printed as ranges once they stop running on
+struct block_diff {
+	const char  *name;
+	bool         printed;
+	uint32_t     run_start, run_end;
+	unsigned int changed;
+};
+
+static int read_exact(struct diff_side* side, void* buf, size_t len) {
+	if (!fread(buf, len, 1, side->fp)) {
+		int ret = ferror(side->fp) ? -errno : -EIO;
+		fprintf(stderr, "%s data.bin: %s\n", side->label, ferror(side->fp) ? strerror(errno) : "Unexpected end of file");
+		return ret;
+	}
+
+	return 0;
+}
+
+// Header, Bk header and then every file header, skipping over the data. Nothing else gets kept
+static int read_headers(struct diff_side* side) {
+	int              ret;
+	uint32_t         iv[4] __attribute__((aligned(0x20)));
+	uint32_t         md5_sum[4];
+	struct bk_header bk_header __attribute__((aligned(0x40)));
+
+	if ((ret = read_exact(side, side->header, sizeof(struct data_bin))) < 0)
+		return ret;
+
+	memcpy(iv, sd_initial_iv, sizeof(iv));
+	ret = sd_decrypt(iv, side->header, sizeof(struct data_bin), side->header);
+	if (ret < 0) {
+		print_error("sd_decrypt", ret);
+		return ret;
+	}
+
+	memcpy(md5_sum, side->header->header.md5_sum, sizeof(md5_sum));
+	memcpy(side->header->header.md5_sum, md5_blanker, sizeof(md5_sum));
+	mbedtls_md5_ret((const unsigned char *)side->header, sizeof(struct data_bin), (unsigned char *)side->header->header.md5_sum);
+	if (memcmp(md5_sum, side->header->header.md5_sum, sizeof(md5_sum))) {
+		fprintf(stderr, "%s data.bin: Header MD5 doesn't match, wrong file (or wrong SD key)?\n", side->label);
+		return -EINVAL;
+	}
+
+	if (be32(side->header->header.banner_sz) > FULL_BNR_MAX) {
+		fprintf(stderr, "%s data.bin: Banner size is out of range (%#x)\n", side->label, be32(side->header->header.banner_sz));
+		return -EINVAL;
+	}
+
+	if ((ret = read_exact(side, &bk_header, sizeof(bk_header))) < 0)
+		return ret;
+
+	if (be32(bk_header.magic) != BK_HDR_MAGIC || be32(bk_header.header_size) != BK_LISTED_SZ) {
+		fprintf(stderr, "%s data.bin: Bk header is invalid (%08x, %#x)\n", side->label, be32(bk_header.magic), be32(bk_header.header_size));
+		return -EINVAL;
+	}
+
+	side->num_files = be32(bk_header.num_files);
+	side->files = calloc(side->num_files, sizeof(struct diff_file));
+	if (side->num_files && !side->files)
+		return -ENOMEM;
+
+	for (unsigned int i = 0; i < side->num_files; i++) {
+		struct file_header file __attribute__((aligned(0x40)));
+		struct diff_file*  entry = &side->files[i];
+
+		if ((ret = read_exact(side, &file, sizeof(file))) < 0)
+			return ret;
+
+		if (be32(file.magic) != FILE_HDR_MAGIC) {
+			fprintf(stderr, "%s data.bin: File header #%u has a bad magic (%08x)\n", side->label, i, be32(file.magic));
+			return -EINVAL;
+		}
+
+		memcpy(entry->name, file.name, sizeof(file.name));
+		memcpy(entry->iv, file.iv, sizeof(entry->iv));
+		entry->size        = be32(file.size);
+		entry->type        = file.type;
+		entry->permissions = file.permissions;
+		entry->attributes  = file.attributes;
+		entry->offset      = ftell(side->fp);
+
+		// banner.bin only has its header, the data is up in the banner
+		if (entry->type != 1 || strcmp(entry->name, "banner.bin") == 0)
+			continue;
+
+		if (fseek(side->fp, align_up(entry->size, 0x40), SEEK_CUR) < 0) {
+			ret = -errno;
+			fprintf(stderr, "%s data.bin: %s\n", side->label, strerror(errno));
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+static void print_file_line(struct block_diff* diff) {
+	if (!diff->printed) {
+		printf("~ %s:", diff->name);
+		diff->printed = true;
+	}
+}
+
+static void flush_run(struct block_diff* diff) {
+	if (diff->run_end > diff->run_start) {
+		print_file_line(diff);
+		printf(" %#x-%#x", diff->run_start * SAVE_DIFF_BLOCK, diff->run_end * SAVE_DIFF_BLOCK);
+		diff->changed += diff->run_end - diff->run_start;
+	}
+
+	diff->run_start = diff->run_end = 0;
+}
+
+static void block_changed(struct block_diff* diff, uint32_t block) {
+	if (diff->run_end == block && diff->run_end > diff->run_start) {
+		diff->run_end++;
+		return;
+	}
+
+	flush_run(diff);
+	diff->run_start = block;
+	diff->run_end   = block + 1;
+}
+
+// Block by block, anything past the end of the shorter one counts as changed
+static void compare_blocks(struct block_diff* diff, uint32_t pos, const unsigned char* old_data, uint32_t old_len, const unsigned char* new_data, uint32_t new_len) {
+	uint32_t len = (old_len > new_len) ? old_len : new_len;
+
+	for (uint32_t offset = 0; offset < len; offset += SAVE_DIFF_BLOCK) {
+		uint32_t old_block = (old_len > offset) ? old_len - offset : 0;
+		uint32_t new_block = (new_len > offset) ? new_len - offset : 0;
+
+		if (old_block > SAVE_DIFF_BLOCK) old_block = SAVE_DIFF_BLOCK;
+		if (new_block > SAVE_DIFF_BLOCK) new_block = SAVE_DIFF_BLOCK;
+
+		if (old_block != new_block || memcmp(old_data + offset, new_data + offset, old_block))
+			block_changed(diff, (pos + offset) / SAVE_DIFF_BLOCK);
+	}
+}
+
+// The chunk at pos, decrypted, with *len set to how much of it is the file's. The IV carries on from the chunk before
+static int read_chunk(struct diff_side* side, struct diff_file* file, uint32_t pos, uint32_t* len) {
+	int ret;
+	uint32_t left = (file->size > pos) ? align_up(file->size, 0x40) - pos : 0;
+	uint32_t read = (left > DIFF_CHUNK) ? DIFF_CHUNK : left;
+
+	*len = 0;
+	if (!read)
+		return 0;
+
+	if (fseek(side->fp, file->offset + pos, SEEK_SET) < 0) {
+		ret = -errno;
+		fprintf(stderr, "%s data.bin: %s\n", side->label, strerror(errno));
+		return ret;
+	}
+
+	if ((ret = read_exact(side, side->buf, read)) < 0)
+		return ret;
+
+	ret = sd_decrypt(file->iv, side->buf, read, side->buf);
+	if (ret < 0) {
+		print_error("sd_decrypt", ret);
+		return ret;
+	}
+
+	*len = (file->size - pos < read) ? file->size - pos : read;
+	return 0;
+}
+
+static int compare_file(struct diff_side* old_side, struct diff_file* old_file, struct diff_side* new_side, struct diff_file* new_file, struct save_diff_stats* stats) {
+	int               ret = 0;
+	struct block_diff diff = { old_file->name };
+
+	if (old_file->type != new_file->type) {
+		print_file_line(&diff);
+		printf(" %s -> %s", (old_file->type == 2) ? "directory" : "file", (new_file->type == 2) ? "directory" : "file");
+	}
+	else if (old_file->type == 1 && strcmp(old_file->name, "banner.bin") == 0) {
+		compare_blocks(&diff, 0, (const unsigned char *)&old_side->header->banner, be32(old_side->header->header.banner_sz),
+		                         (const unsigned char *)&new_side->header->banner, be32(new_side->header->header.banner_sz));
+	}
+	else if (old_file->type == 1) {
+		uint32_t size = (old_file->size > new_file->size) ? old_file->size : new_file->size;
+
+		for (uint32_t pos = 0; pos < size; pos += DIFF_CHUNK) {
+			uint32_t old_len, new_len;
+
+			if ((ret = read_chunk(old_side, old_file, pos, &old_len)) < 0
+			||  (ret = read_chunk(new_side, new_file, pos, &new_len)) < 0)
+				return ret;
+
+			compare_blocks(&diff, pos, old_side->buf, old_len, new_side->buf, new_len);
+			stats->bytes_compared += (old_len < new_len) ? old_len : new_len;
+		}
+	}
+
+	flush_run(&diff);
+
+	if (old_file->size != new_file->size) {
+		print_file_line(&diff);
+		printf(" (size %#x -> %#x)", old_file->size, new_file->size);
+	}
+
+	if (old_file->permissions != new_file->permissions || old_file->attributes != new_file->attributes) {
+		print_file_line(&diff);
+		printf(" (permissions %#x -> %#x, attributes %#x -> %#x)", old_file->permissions, new_file->permissions, old_file->attributes, new_file->attributes);
+	}
+
+	if (diff.printed) {
+		putchar('\n');
+		stats->changed++;
+		stats->changed_blocks += diff.changed;
+	}
+	else {
+		stats->unchanged++;
+	}
+
+	return 0;
+}
+
+// Same order on both sides unless something was added or removed, so the next one along is nearly always it
+static struct diff_file* find_match(struct diff_side* side, const char* name, unsigned int* cursor) {
+	if (*cursor < side->num_files && !side->files[*cursor].matched && strcmp(side->files[*cursor].name, name) == 0)
+		return &side->files[(*cursor)++];
+
+	for (unsigned int i = 0; i < side->num_files; i++) {
+		if (!side->files[i].matched && strcmp(side->files[i].name, name) == 0) {
+			*cursor = i + 1;
+			return &side->files[i];
+		}
+	}
+
+	return NULL;
+}
+
+int save_diff(FILE* old_fp, FILE* new_fp, struct save_diff_stats* stats) {
+	int              ret;
+	unsigned int     cursor = 0;
+	struct diff_side sides[2] = {
+		{ "Old", old_fp },
+		{ "New", new_fp },
+	};
+	struct diff_side *old_side = &sides[0], *new_side = &sides[1];
+
+	*stats = (struct save_diff_stats){};
+
+	for (int i = 0; i < 2; i++) {
+		sides[i].header = memalign32(sizeof(struct data_bin));
+		sides[i].buf    = aligned_alloc(0x40, DIFF_CHUNK);
+		if (!sides[i].header || !sides[i].buf) {
+			ret = -ENOMEM;
+			goto exit;
+		}
+
+		if ((ret = read_headers(&sides[i])) < 0)
+			goto exit;
+	}
+
+	if (old_side->header->header.title_id != new_side->header->header.title_id)
+		printf("Title IDs don't match (%016llx, %016llx), comparing anyway\n",
+		       (unsigned long long)be64(old_side->header->header.title_id), (unsigned long long)be64(new_side->header->header.title_id));
+
+	for (unsigned int i = 0; i < old_side->num_files; i++) {
+		struct diff_file* old_file = &old_side->files[i];
+		struct diff_file* new_file = find_match(new_side, old_file->name, &cursor);
+
+		if (!new_file) {
+			printf("- %s\n", old_file->name);
+			stats->removed++;
+			continue;
+		}
+
+		new_file->matched = true;
+		if ((ret = compare_file(old_side, old_file, new_side, new_file, stats)) < 0)
+			goto exit;
+	}
+
+	for (unsigned int i = 0; i < new_side->num_files; i++) {
+		if (!new_side->files[i].matched) {
+			printf("+ %s (%#x)\n", new_side->files[i].name, new_side->files[i].size);
+			stats->added++;
+		}
+	}
+
+	ret = (stats->added || stats->removed || stats->changed) ? 1 : 0;
+
+exit:
+	for (int i = 0; i < 2; i++) {
+		free(sides[i].header);
+		free(sides[i].buf);
+		free(sides[i].files);
+	}
+
+	return ret;
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+
+// What changed between two data.bin backups of the same save, down to 4KiB blocks of each file.
+// Only the file headers and one chunk from either side are ever in memory.
+
+#define SAVE_DIFF_BLOCK 0x1000
+
+struct save_diff_stats {
+	unsigned int added, removed, changed, unchanged;
+	unsigned int changed_blocks;
+	uint64_t     bytes_compared;
+};
+
+// Prints a line per file that differs, plus its changed block ranges. 1 if anything differs, 0 if not
+int save_diff(FILE* old_fp, FILE* new_fp, struct save_diff_stats* stats);
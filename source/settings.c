@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "settings.h"
+#include "save.h"
+#include "crypto.h"
+#include "hash.h"
+
+// What settings.ini asked for, -1 for auto. Kept so that saving doesn't pin down whatever auto came up with
+static int crypto_choice = -1, sha1_choice = -1;
+
+// Index into names, -1 for "auto", -2 if it's neither
+static int backend_index(const char* value, const char* const names[], int count) {
+	if (!strcasecmp(value, "auto"))
+		return -1;
+
+	for (int i = 0; i < count; i++) {
+		if (!strcasecmp(value, names[i]))
+			return i;
+	}
+
+	return -2;
+}
+
+int settings_load(void) {
+	char line[128];
+
+	FILE* fp = fopen(SETTINGS_PATH, "r");
+	if (!fp)
+		return (errno == ENOENT) ? 0 : -errno;
+
+	while (fgets(line, sizeof(line), fp)) {
+		char     key[32], str[32];
+		char*    end;
+
+		if (line[0] == '#' || line[0] == ';' || sscanf(line, " %31[^= ] = %31s", key, str) != 2)
+			continue;
+
+		if (!strcmp(key, "crypto_backend")) {
+			int choice = backend_index(str, crypto_backend_names, CRYPTO_NUM_BACKENDS);
+
+			if (choice == -2 || (choice >= 0 && crypto_set_backend(choice) < 0))
+				fprintf(stderr, "%s: %s = %s isn't available, keeping %s\n", SETTINGS_PATH, key, str, crypto_backend_names[crypto_get_backend()]);
+			else
+				crypto_choice = choice;
+
+			continue;
+		}
+
+		if (!strcmp(key, "sha1_backend")) {
+			int choice = backend_index(str, sha1_backend_names, SHA1_NUM_BACKENDS);
+
+			if (choice == -2 || (choice >= 0 && sha1_set_backend(choice) < 0))
+				fprintf(stderr, "%s: %s = %s isn't available, keeping %s\n", SETTINGS_PATH, key, str, sha1_backend_names[sha1_get_backend()]);
+			else
+				sha1_choice = choice;
+
+			continue;
+		}
+
+		int value = strtol(str, &end, 0);
+		if (*end)
+			continue;
+
+		for (int i = 0; i < SAVE_NUM_STAGES; i++) {
+			size_t len = strlen(save_stage_names[i]);
+
+			if (strncmp(key, save_stage_names[i], len) || strcmp(key + len, "_chunk"))
+				continue;
+
+			if (save_set_chunk_size(i, value) < 0)
+				fprintf(stderr, "%s: %s = %#x is out of range, keeping %#x\n", SETTINGS_PATH, key, value, save_get_chunk_size(i));
+		}
+	}
+
+	fclose(fp);
+	return 0;
+}
+
+int settings_save(void) {
+	const char* temp_path = SETTINGS_PATH ".tmp";
+
+	mkdir("/title_manager", 0755);
+
+	FILE* fp = fopen(temp_path, "w");
+	if (!fp) {
+		perror(temp_path);
+		return -errno;
+	}
+
+	fputs("# title_manager settings\n", fp);
+	for (int i = 0; i < SAVE_NUM_STAGES; i++)
+		fprintf(fp, "%s_chunk = %#x\n", save_stage_names[i], save_get_chunk_size(i));
+
+	fprintf(fp, "crypto_backend = %s\n", (crypto_choice < 0) ? "auto" : crypto_backend_names[crypto_choice]);
+	fprintf(fp, "sha1_backend = %s\n", (sha1_choice < 0) ? "auto" : sha1_backend_names[sha1_choice]);
+
+	int failed = ferror(fp);
+	if (fclose(fp) != 0 || failed) {
+		perror(temp_path);
+		remove(temp_path);
+		return -EIO;
+	}
+
+	remove(SETTINGS_PATH);
+	if (rename(temp_path, SETTINGS_PATH) < 0) {
+		perror(SETTINGS_PATH);
+		return -errno;
+	}
+
+	return 0;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+// Things worth keeping between runs, as "key = value" lines. Unknown keys are left alone (and dropped on the next save).
+// Right now that's the chunk size for every stage in save.h, "<stage>_chunk = 0x40000",
+// and which backend does AES and SHA-1, "crypto_backend = es|software" and "sha1_backend = software|starlet".
+// Either backend can be "auto" (the default): crypto_init() times both for AES, SHA-1 stays on Starlet.
+
+#define SETTINGS_PATH "/title_manager/settings.ini"
+
+int settings_load(void); // Fine if there isn't one yet
+int settings_save(void);
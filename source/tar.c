@@ -0,0 +1,329 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "common.h"
+#include "tar.h"
+
+struct ustar_header {
+	char name[100];
+	char mode[8];
+	char uid[8];
+	char gid[8];
+	char size[12];
+	char mtime[12];
+	char checksum[8];
+	char type;
+	char linkname[100];
+	char magic[6];
+	char version[2];
+	char uname[32];
+	char gname[32];
+	char devmajor[8];
+	char devminor[8];
+	char prefix[155];
+	char padding[12];
+};
+_Static_assert(sizeof(struct ustar_header) == TAR_BLOCK_SIZE, "Size of ustar_header is not 0x200");
+
+static int tar_flush(tar_writer* tar) {
+	if (tar->buf_used && !fwrite(tar->buf, tar->buf_used, 1, tar->fp)) {
+		print_error("fwrite", errno);
+		return -errno;
+	}
+
+	tar->buf_used = 0;
+	return 0;
+}
+
+static int tar_put(tar_writer* tar, const void* data, unsigned int len) {
+	const unsigned char* ptr = data;
+	int ret;
+
+	while (len) {
+		// Nothing staged and plenty to write, skip the copy
+		if (!tar->buf_used && len >= tar->buf_size) {
+			unsigned int count = len - (len % tar->buf_size);
+			if (!fwrite(ptr, count, 1, tar->fp)) {
+				print_error("fwrite", errno);
+				return -errno;
+			}
+
+			ptr += count;
+			len -= count;
+			continue;
+		}
+
+		unsigned int count = tar->buf_size - tar->buf_used;
+		if (count > len)
+			count = len;
+
+		memcpy(tar->buf + tar->buf_used, ptr, count);
+		tar->buf_used += count;
+		ptr += count;
+		len -= count;
+
+		if (tar->buf_used == tar->buf_size && (ret = tar_flush(tar)) < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int tar_pad(tar_writer* tar, unsigned int len) {
+	static const unsigned char zero[TAR_BLOCK_SIZE] = {};
+
+	return tar_put(tar, zero, len);
+}
+
+static int tar_put_header(tar_writer* tar, const char* name, uint64_t size, unsigned mode, char type) {
+	struct ustar_header header = {};
+	unsigned int checksum = 0;
+
+	memcpy(header.name, name, strnlen(name, sizeof(header.name))); // Not necessarily terminated, that's fine here
+	snprintf(header.mode,  sizeof(header.mode),  "%07o", mode & 07777);
+	snprintf(header.uid,   sizeof(header.uid),   "%07o", 0);
+	snprintf(header.gid,   sizeof(header.gid),   "%07o", 0);
+	snprintf(header.size,  sizeof(header.size),  "%011llo", (unsigned long long)size);
+	snprintf(header.mtime, sizeof(header.mtime), "%011o", 0);
+	memset(header.checksum, ' ', sizeof(header.checksum));
+	header.type = type;
+	memcpy(header.magic, "ustar", 6);
+	memcpy(header.version, "00", 2);
+
+	for (int i = 0; i < sizeof(header); i++)
+		checksum += ((unsigned char *)&header)[i];
+
+	snprintf(header.checksum, sizeof(header.checksum), "%06o", checksum);
+	return tar_put(tar, &header, sizeof(header));
+}
+
+int tar_pax_record(char* out, size_t size, const char* key, const char* value) {
+	int len = strlen(key) + strlen(value) + 3;
+	int digits = 1;
+
+	while (snprintf(NULL, 0, "%i", len + digits) > digits)
+		digits++;
+
+	return snprintf(out, size, "%i %s=%s\n", len + digits, key, value);
+}
+
+int tar_init(tar_writer* tar, FILE* fp, void* buf, unsigned int buf_size) {
+	if (buf_size < TAR_BLOCK_SIZE || buf_size % TAR_BLOCK_SIZE)
+		return -EINVAL;
+
+	memset(tar, 0, sizeof(tar_writer));
+	tar->fp       = fp;
+	tar->buf      = buf;
+	tar->buf_size = buf_size;
+	return 0;
+}
+
+int tar_add(tar_writer* tar, const tar_entry* entry) {
+	int      ret;
+	char     name[512];
+	char     pax[1024];
+	int      pax_len = 0;
+	uint64_t size = (entry->type == TAR_TYPE_FILE) ? entry->size : 0;
+
+	if (tar->file_left) {
+		fprintf(stderr, "tar: Previous file is still missing %llu bytes\n", (unsigned long long)tar->file_left);
+		return -EINVAL;
+	}
+
+	if (snprintf(name, sizeof(name), (entry->type == TAR_TYPE_DIRECTORY) ? "%s/" : "%s", entry->path) >= sizeof(name)) {
+		fprintf(stderr, "tar: %s: Path is too long\n", entry->path);
+		return -ENAMETOOLONG;
+	}
+
+	if (strlen(name) > 100) {
+		pax_len = tar_pax_record(pax, sizeof(pax), "path", name);
+		if (pax_len >= sizeof(pax))
+			return -ENAMETOOLONG;
+	}
+
+	if (entry->pax) {
+		int len = snprintf(pax + pax_len, sizeof(pax) - pax_len, "%s", entry->pax);
+		if (len >= sizeof(pax) - pax_len)
+			return -ENAMETOOLONG;
+
+		pax_len += len;
+	}
+
+	if (pax_len) {
+		if ((ret = tar_put_header(tar, "PaxHeader", pax_len, 0644, TAR_TYPE_PAX)) < 0
+		||  (ret = tar_put(tar, pax, pax_len)) < 0
+		||  (ret = tar_pad(tar, align_up(pax_len, TAR_BLOCK_SIZE) - pax_len)) < 0)
+			return ret;
+	}
+
+	ret = tar_put_header(tar, name, size, entry->mode, entry->type);
+	if (ret < 0)
+		return ret;
+
+	tar->file_left = size;
+	tar->file_pad  = align_up(size, TAR_BLOCK_SIZE) - size;
+	return 0;
+}
+
+int tar_write(tar_writer* tar, const void* data, unsigned int len) {
+	int ret;
+
+	if (len > tar->file_left) {
+		fprintf(stderr, "tar: Writing %#x bytes past the end of the file\n", len);
+		return -EINVAL;
+	}
+
+	ret = tar_put(tar, data, len);
+	if (ret < 0)
+		return ret;
+
+	tar->file_left -= len;
+	if (!tar->file_left && tar->file_pad) {
+		ret = tar_pad(tar, tar->file_pad);
+		tar->file_pad = 0;
+	}
+
+	return ret;
+}
+
+int tar_finish(tar_writer* tar) {
+	int ret;
+
+	if (tar->file_left) {
+		fprintf(stderr, "tar: Last file is still missing %llu bytes\n", (unsigned long long)tar->file_left);
+		return -EINVAL;
+	}
+
+	if ((ret = tar_pad(tar, TAR_BLOCK_SIZE)) < 0
+	||  (ret = tar_pad(tar, TAR_BLOCK_SIZE)) < 0)
+		return ret;
+
+	return tar_flush(tar);
+}
+
+// Octal, padded with spaces or NULs on either side
+static uint64_t tar_octal(const char* field, size_t size) {
+	uint64_t value = 0;
+
+	while (size && (*field == ' ' || *field == '0')) {
+		field++;
+		size--;
+	}
+
+	while (size && *field >= '0' && *field <= '7') {
+		value = (value << 3) | (*field++ - '0');
+		size--;
+	}
+
+	return value;
+}
+
+static int tar_read_block(FILE* fp, void* block) {
+	if (!fread(block, TAR_BLOCK_SIZE, 1, fp)) {
+		fprintf(stderr, "tar: %s\n", ferror(fp) ? strerror(errno) : "Unexpected end of file");
+		return ferror(fp) ? -errno : -EIO;
+	}
+
+	return 0;
+}
+
+static bool tar_checksum_ok(const struct ustar_header* header) {
+	unsigned int checksum = 0;
+
+	for (int i = 0; i < sizeof(*header); i++)
+		checksum += (i >= offsetof(struct ustar_header, checksum) && i < offsetof(struct ustar_header, type)) ? ' ' : ((const unsigned char *)header)[i];
+
+	return checksum == tar_octal(header->checksum, sizeof(header->checksum));
+}
+
+const char* tar_pax_find(const tar_read_entry* entry, const char* key) {
+	const char* record = entry->pax;
+	const char* end    = entry->pax + entry->pax_len;
+	size_t      key_len = strlen(key);
+
+	while (record < end) {
+		char* kv;
+		unsigned long len = strtoul(record, &kv, 10);
+		if (!len || len > end - record || *kv++ != ' ')
+			break;
+
+		if (record + len - kv > key_len && !memcmp(kv, key, key_len) && kv[key_len] == '=')
+			return kv + key_len + 1;
+
+		record += len;
+	}
+
+	return NULL;
+}
+
+int tar_read_next(FILE* fp, tar_read_entry* entry) {
+	int                 ret;
+	struct ustar_header header;
+
+	memset(entry, 0, sizeof(tar_read_entry));
+	while (true) {
+		if ((ret = tar_read_block(fp, &header)) < 0)
+			return ret;
+
+		// Two zero blocks end it, though one is plenty to know
+		if (!header.name[0] && !header.checksum[0])
+			return 0;
+
+		if (!tar_checksum_ok(&header)) {
+			fprintf(stderr, "tar: Bad header checksum\n");
+			return -EINVAL;
+		}
+
+		uint64_t size = tar_octal(header.size, sizeof(header.size));
+		if (header.type != TAR_TYPE_PAX && header.type != TAR_TYPE_PAX_GLOBAL) {
+			entry->size = size;
+			entry->mode = tar_octal(header.mode, sizeof(header.mode));
+			entry->type = (header.type == '\0') ? TAR_TYPE_FILE : header.type;
+			break;
+		}
+
+		// Records for the next entry. Global ones get the same treatment, nothing here writes those anyway
+		if (size > sizeof(entry->pax) - entry->pax_len) {
+			fprintf(stderr, "tar: pax header is too big (%#llx)\n", (unsigned long long)size);
+			return -EINVAL;
+		}
+
+		for (uint64_t left = align_up(size, TAR_BLOCK_SIZE); left; left -= TAR_BLOCK_SIZE) {
+			char block[TAR_BLOCK_SIZE];
+			unsigned int used = (size > TAR_BLOCK_SIZE) ? TAR_BLOCK_SIZE : size;
+
+			if ((ret = tar_read_block(fp, block)) < 0)
+				return ret;
+
+			memcpy(entry->pax + entry->pax_len, block, used);
+			entry->pax_len += used;
+			size -= used;
+		}
+	}
+
+	const char* pax_path = tar_pax_find(entry, "path");
+	if (pax_path) {
+		const char* end = memchr(pax_path, '\n', entry->pax + entry->pax_len - pax_path);
+		if (!end || end - pax_path >= sizeof(entry->path))
+			return -ENAMETOOLONG;
+
+		int len = end - pax_path;
+		memcpy(entry->path, pax_path, len);
+	}
+	else if (header.prefix[0] && memcmp(header.magic, "ustar", 5) == 0) {
+		snprintf(entry->path, sizeof(entry->path), "%.155s/%.100s", header.prefix, header.name);
+	}
+	else {
+		snprintf(entry->path, sizeof(entry->path), "%.100s", header.name);
+	}
+
+	size_t len = strlen(entry->path);
+	while (len && entry->path[len - 1] == '/')
+		entry->path[--len] = '\0';
+
+	return 1;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+
+// POSIX (ustar + pax) tar writer. Everything goes through one big staging buffer so the output is written in large pieces.
+
+#define TAR_BLOCK_SIZE 0x200
+
+enum {
+	TAR_TYPE_FILE      = '0',
+	TAR_TYPE_DIRECTORY = '5',
+	TAR_TYPE_PAX       = 'x',
+	TAR_TYPE_PAX_GLOBAL = 'g',
+};
+
+typedef struct tar_writer {
+	FILE          *fp;
+	unsigned char *buf;
+	unsigned int   buf_size;
+	unsigned int   buf_used;
+	uint64_t       file_left; // Bytes still expected for the current file
+	unsigned int   file_pad;  // Padding after it
+} tar_writer;
+
+typedef struct tar_entry {
+	const char *path;
+	uint64_t    size;
+	unsigned    mode;
+	char        type;
+	const char *pax; // More pax records to go with it (from tar_pax_record()), or NULL
+} tar_entry;
+
+// "<length> <key>=<value>\n", where length counts itself. Returns the length like snprintf
+int tar_pax_record(char* out, size_t size, const char* key, const char* value);
+
+int tar_init(tar_writer* tar, FILE* fp, void* buf, unsigned int buf_size);
+int tar_add(tar_writer* tar, const tar_entry* entry); // For files, follow with tar_write() until size bytes are in
+int tar_write(tar_writer* tar, const void* data, unsigned int len);
+int tar_finish(tar_writer* tar);
+
+// And reading them back, one entry at a time. The file's data (padded out to TAR_BLOCK_SIZE) comes right after
+typedef struct tar_read_entry {
+	char         path[256]; // No trailing slash for directories
+	uint64_t     size;
+	unsigned     mode;
+	char         type;
+	char         pax[512];  // Every pax record that came with it, see tar_pax_find()
+	unsigned int pax_len;
+} tar_read_entry;
+
+int tar_read_next(FILE* fp, tar_read_entry* entry); // 1 for an entry, 0 at the end of the archive
+const char* tar_pax_find(const tar_read_entry* entry, const char* key); // Value of the record, ends at the '\n'. NULL if there isn't one
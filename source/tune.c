@@ -0,0 +1,270 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef GEKKO
+#include <ogc/es.h>
+#include <ogc/lwp_watchdog.h>
+#else
+#include <time.h>
+#endif
+
+#include "common.h"
+#include "tune.h"
+#include "save.h"
+#include "nand.h"
+#include "readahead.h"
+#include "bufpool.h"
+#include "crypto.h"
+
+#define TUNE_NAND_PATH "/tmp/tune.bin"
+#define TUNE_SD_PATH   "/title_manager/tune.tmp"
+#define TUNE_SIZE      0x200000 // Per chunk size, per stage
+#define TUNE_NUM_SIZES 7        // 16KiB to 1MiB
+
+// Anything within this many percent of the fastest is just as good, and the smallest of those wins. Less memory, and the numbers wobble
+#define TUNE_MARGIN    5
+
+static uint64_t now_usec(void) {
+#ifdef GEKKO
+	return ticks_to_microsecs(gettime());
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+#endif
+}
+
+static unsigned int tune_chunk(int i) {
+	return SAVE_MIN_CHUNK << i;
+}
+
+typedef int (*tune_fn)(void* buf, unsigned int chunk, unsigned int total, void* user);
+
+static int time_nand(void* buf, unsigned int chunk, unsigned int total, void* user) {
+	readahead ra;
+	void*     data;
+	int       ret, fd;
+
+	if ((fd = nand_open(TUNE_NAND_PATH, NAND_OPEN_READ)) < 0)
+		return fd;
+
+	ret = readahead_start(&ra, fd, total, 2, chunk);
+	if (ret == 0) {
+		while ((ret = readahead_next(&ra, &data)) > 0)
+			;
+
+		int ret2 = readahead_finish(&ra);
+		if (ret == 0)
+			ret = ret2;
+	}
+
+	nand_close(fd);
+	return ret;
+}
+
+static int time_crypto(void* buf, unsigned int chunk, unsigned int total, void* user) {
+	uint32_t iv[4] __attribute__((aligned(0x20))) = {};
+	int ret = 0;
+
+	for (unsigned int done = 0; done < total && ret >= 0; done += chunk)
+		ret = sd_encrypt(iv, buf, chunk, buf);
+
+	return ret;
+}
+
+// Unbuffered, so every fwrite() is one write of chunk bytes. fclose() counts, that's when it really has to be on the card
+static int time_sd(void* buf, unsigned int chunk, unsigned int total, void* user) {
+	int ret = 0;
+
+	FILE* fp = fopen(TUNE_SD_PATH, "wb");
+	if (!fp) {
+		perror(TUNE_SD_PATH);
+		return -errno;
+	}
+
+	setvbuf(fp, NULL, _IONBF, 0);
+	for (unsigned int done = 0; done < total; done += chunk) {
+		if (!fwrite(buf, chunk, 1, fp)) {
+			ret = -errno;
+			break;
+		}
+	}
+
+	if (fclose(fp) != 0 && ret == 0)
+		ret = -errno;
+
+	remove(TUNE_SD_PATH);
+	return ret;
+}
+
+#ifdef GEKKO
+struct es_tune {
+	uint64_t title_id;
+	uint32_t cid;
+};
+
+static int time_es(void* buf, unsigned int chunk, unsigned int total, void* user) {
+	struct es_tune* es = user;
+	int ret = 0;
+
+	int cfd = ES_ExportContentBegin(es->title_id, es->cid);
+	if (cfd < 0)
+		return cfd;
+
+	for (unsigned int done = 0; done < total && ret >= 0; done += chunk)
+		ret = ES_ExportContentData(cfd, buf, (total - done > chunk) ? chunk : total - done);
+
+	ES_ExportContentEnd(cfd);
+	return (ret < 0) ? ret : 0;
+}
+
+// ExportTitleInit, and the biggest content that isn't shared. Sizes come back in *total, 0 if there's nothing to go on
+static int es_tune_begin(struct es_tune* es, unsigned int* total) {
+	uint32_t tmd_size = 0;
+	int      ret;
+
+	*total = 0;
+	if (!es->title_id)
+		return 0;
+
+	ret = ES_GetStoredTMDSize(es->title_id, &tmd_size);
+	if (ret < 0) {
+		print_error("ES_GetStoredTMDSize", ret);
+		return ret;
+	}
+
+	signed_blob* s_tmd = memalign32(tmd_size);
+	if (!s_tmd)
+		return -ENOMEM;
+
+	ret = ES_GetStoredTMD(es->title_id, s_tmd, tmd_size);
+	if (ret < 0) {
+		print_error("ES_GetStoredTMD", ret);
+		free(s_tmd);
+		return ret;
+	}
+
+	tmd* p_tmd = SIGNATURE_PAYLOAD(s_tmd);
+	for (int i = 0; i < p_tmd->num_contents; i++) {
+		tmd_content* con = &p_tmd->contents[i];
+
+		if (!(con->type & 0x8000) && con->size > *total) {
+			*total  = (con->size > TUNE_SIZE) ? TUNE_SIZE : con->size & ~0x3F;
+			es->cid = con->cid;
+		}
+	}
+
+	ret = *total ? ES_ExportTitleInit(es->title_id, s_tmd, tmd_size) : 0;
+	free(s_tmd);
+	if (ret < 0) {
+		print_error("ES_ExportTitleInit", ret);
+		*total = 0;
+	}
+
+	return ret;
+}
+#endif
+
+// A scratch file with something in it for time_nand() to read back
+static int make_nand_file(void* buf, unsigned int total) {
+	int ret, fd;
+
+	nand_delete(TUNE_NAND_PATH);
+	if ((ret = nand_create_file(TUNE_NAND_PATH, 0, 0x3C)) < 0)
+		return ret;
+
+	if ((fd = ret = nand_open(TUNE_NAND_PATH, NAND_OPEN_WRITE)) < 0)
+		return ret;
+
+	for (unsigned int done = 0; done < total && ret >= 0; done += SAVE_MAX_CHUNK)
+		ret = nand_write(fd, buf, SAVE_MAX_CHUNK);
+
+	nand_close(fd);
+	return (ret < 0) ? ret : 0;
+}
+
+static void tune_stage(enum save_stage stage, tune_fn fn, void* buf, unsigned int total, void* user) {
+	uint64_t times[TUNE_NUM_SIZES] = {};
+	uint64_t best = 0;
+	int      ret = 0;
+
+	printf("%-7s", save_stage_names[stage]);
+	for (int i = 0; i < TUNE_NUM_SIZES; i++) {
+		uint64_t start = now_usec();
+
+		if ((ret = fn(buf, tune_chunk(i), total, user)) < 0)
+			break;
+
+		times[i] = now_usec() - start;
+		if (!times[i])
+			times[i] = 1;
+
+		if (!best || times[i] < best)
+			best = times[i];
+
+		printf(" %7.2f", total / (double)times[i]);
+		fflush(stdout);
+	}
+
+	if (ret < 0) {
+		printf("\n");
+		print_error("%s stage", ret, save_stage_names[stage]);
+		return;
+	}
+
+	for (int i = 0; i < TUNE_NUM_SIZES; i++) {
+		if (times[i] * 100 <= best * (100 + TUNE_MARGIN)) {
+			save_set_chunk_size(stage, tune_chunk(i));
+			break;
+		}
+	}
+
+	printf("  -> %#x\n", save_get_chunk_size(stage));
+}
+
+int tune_chunk_sizes(uint64_t title_id) {
+	int ret;
+
+	void* buf = bufpool_acquire(SAVE_MAX_CHUNK);
+	if (!buf)
+		return -ENOMEM;
+
+	for (unsigned int i = 0; i < SAVE_MAX_CHUNK; i++)
+		((unsigned char *)buf)[i] = i * 0x9D;
+
+	printf("MB/s at %#x", tune_chunk(0));
+	for (int i = 1; i < TUNE_NUM_SIZES; i++)
+		printf(" %#x", tune_chunk(i));
+	printf(" bytes\n");
+
+	if ((ret = make_nand_file(buf, TUNE_SIZE)) < 0) {
+		print_error("nand_create_file(%s)", ret, TUNE_NAND_PATH);
+	}
+	else {
+		tune_stage(SAVE_STAGE_NAND, time_nand, buf, TUNE_SIZE, NULL);
+	}
+	nand_delete(TUNE_NAND_PATH);
+
+#ifdef GEKKO
+	struct es_tune es = { title_id };
+	unsigned int   es_total;
+
+	if (es_tune_begin(&es, &es_total) >= 0 && es_total) {
+		tune_stage(SAVE_STAGE_ES, time_es, buf, es_total, &es);
+		ES_ExportTitleDone();
+	}
+	else {
+		printf("%-7s skipped, no content to export\n", save_stage_names[SAVE_STAGE_ES]);
+	}
+#endif
+
+	tune_stage(SAVE_STAGE_CRYPTO, time_crypto, buf, TUNE_SIZE, NULL);
+	tune_stage(SAVE_STAGE_SD, time_sd, buf, TUNE_SIZE * 2, NULL);
+
+	bufpool_release(buf);
+	bufpool_trim();
+	return 0;
+}
@@ -0,0 +1,6 @@
+#pragma once
+#include <stdint.h>
+
+// Times every stage in save.h at chunk sizes from SAVE_MIN_CHUNK up to SAVE_MAX_CHUNK and keeps the best one for each.
+// The ES stage exports the biggest content of title_id, 0 skips it. Doesn't save anything, see settings_save()
+int tune_chunk_sizes(uint64_t title_id);
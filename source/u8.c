@@ -2,155 +2,331 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
 #include <assert.h>
-#include <ogc/video.h>
 
 #include "u8.h"
 
 #define ERROR(str, ...) fprintf(stderr, "%s:%i: \n" str "\n", __FILE__, __LINE__, ##__VA_ARGS__)
 
-int U8Init(void* ptr, U8Context* ctx) {
+int U8Init(void* ptr, size_t size, U8Context* ctx) {
     assert(ptr != NULL);
 
     if (ctx) memset(ctx, 0, sizeof(U8Context));
 
-    U8Header* header = (U8Header*)ptr;
+    if (size < sizeof(U8Header)) {
+        ERROR("File is too small to be a U8 archive (%#zx < %#zx)", size, sizeof(U8Header));
+        return U8_ERR_BOUNDS;
+    }
 
-    if (header->magic != U8_MAGIC) {
-        ERROR("U8 header magic is invalid (%#08x != %#08x)", header->magic, U8_MAGIC);
-        return -1;
+    U8Header header = U8HeaderSwap((U8Header*)ptr);
+
+    if (header.magic != U8_MAGIC) {
+        ERROR("U8 header magic is invalid (%#08x != %#08x)", header.magic, U8_MAGIC);
+        return U8_ERR_MAGIC;
+    }
+
+    // Node table + string table, all of it has to be there before anything gets read out of it
+    if (header.root_node_offset < sizeof(U8Header) || header.root_node_offset % 4
+    ||  header.meta_size < sizeof(U8Node) || header.root_node_offset > size || header.meta_size > size - header.root_node_offset) {
+        ERROR("Node table is out of bounds (%#x+%#x, file size %#zx)", header.root_node_offset, header.meta_size, size);
+        return U8_ERR_BOUNDS;
     }
-    
-    U8Node* nodes = (U8Node*)(ptr + header->root_node_offset);
+
+    if (header.data_offset > size) {
+        ERROR("Data offset is out of bounds (%#x > %#zx)", header.data_offset, size);
+        return U8_ERR_BOUNDS;
+    }
+
+    U8Node* nodes = (U8Node*)(ptr + header.root_node_offset);
     U8Node* root_node = &nodes[0];
 
-    if (root_node->type != 0x01) {
+    if (U8NodeType(root_node) != 0x01) {
         ERROR("Root node is not a directory? What?");
-        return -2;
+        return U8_ERR_ROOT;
     }
 
-    unsigned int node_count = root_node->size;
+    unsigned int node_count = U8NodeSize(root_node);
+    if (node_count == 0 || node_count > (header.meta_size - 1) / sizeof(U8Node)) { // And at least one byte of string table
+        ERROR("Node count is out of range (%#x nodes, meta size %#x)", node_count, header.meta_size);
+        return U8_ERR_ROOT;
+    }
 
     const char* str_table = (const char*)(nodes + node_count);
-    unsigned int str_table_size = header->meta_size - (node_count * sizeof(U8Node));
+    unsigned int str_table_size = header.meta_size - (node_count * sizeof(U8Node));
+
+    // Usually the last name's terminator is the last byte, and then nothing needs to be looked for per node
+    bool terminated = (str_table[str_table_size - 1] == 0);
+
+    // End markers of the directories we're in, innermost last
+    unsigned int  dir_stack_buf[32];
+    unsigned int* dir_stack = dir_stack_buf;
+    unsigned int  max_depth = sizeof(dir_stack_buf) / sizeof(*dir_stack_buf), depth = 0;
+    int ret = 0;
+
+    dir_stack[0] = node_count;
 
     for (unsigned int index = 1; index < node_count; index++) {
         U8Node* node = &nodes[index];
 
-        if (node->type != 0x00 && node->type != 0x01) {
-            ERROR("Node #%u has invalid node type (%#x)", index, node->type);
-            return -3;
+        while (index >= dir_stack[depth])
+            depth--;
+
+        if (U8NodeType(node) != 0x00 && U8NodeType(node) != 0x01) {
+            ERROR("Node #%u has invalid node type (%#x)", index, U8NodeType(node));
+            ret = U8_ERR_TYPE;
+            break;
         }
 
-        if (node->name_offset >= str_table_size) {
-            ERROR("Name offset for node #%u is out of range (%#x >= %#x)", index, node->name_offset, str_table_size);
-            return -4;
+        if (U8NodeNameOffset(node) >= str_table_size
+        || (!terminated && !memchr(str_table + U8NodeNameOffset(node), 0, str_table_size - U8NodeNameOffset(node)))) {
+            ERROR("Name for node #%u is out of range (%#x, string table size %#x)", index, U8NodeNameOffset(node), str_table_size);
+            ret = U8_ERR_NAME;
+            break;
         }
 
-        const char* node_name = str_table + node->name_offset;
+        const char* node_name = str_table + U8NodeNameOffset(node);
+
+        if (U8NodeType(node) == 0x00) {
+            if (U8NodeOffset(node) < header.data_offset) {
+                ERROR("Data offset for file node #%u (%s) is out of bounds (%#x < %#x)", index, node_name, U8NodeOffset(node), header.data_offset); // Only use for data_offset lmao
+                ret = U8_ERR_DATA;
+                break;
+            }
 
-        if (node->type == 0x00) {
-            if (node->offset < header->data_offset) {
-                ERROR("Data offset for file node #%u (%s) is out of bounds (%#x < %#x)", index, node_name, node->offset, header->data_offset); // Only use for data_offset lmao
-                return -5;
-            }       
+            if (U8NodeOffset(node) > size || U8NodeSize(node) > size - U8NodeOffset(node)) {
+                ERROR("Data for file node #%u (%s) is out of bounds (%#x+%#x > %#zx)", index, node_name, U8NodeOffset(node), U8NodeSize(node), size);
+                ret = U8_ERR_DATA;
+                break;
+            }
         } else {
-            if (node->size > node_count) {
-                ERROR("End marker for directory node #%u (%s) is out of bounds (%#x > %#x)", index, node_name, node->offset, node_count);
-                return -5;
+            // Has to end after itself, and no later than whatever it's in
+            if (U8NodeSize(node) <= index || U8NodeSize(node) > dir_stack[depth]) {
+                ERROR("End marker for directory node #%u (%s) is out of bounds (%#x, parent ends at %#x)", index, node_name, U8NodeSize(node), dir_stack[depth]);
+                ret = U8_ERR_DIR;
+                break;
             }
+
+            if (depth + 1 == max_depth) {
+                unsigned int* temp = malloc(sizeof(unsigned int) * max_depth * 2);
+                if (!temp) {
+                    ERROR("Memory allocation failed (depth %u)", depth);
+                    ret = U8_ERR_NOMEM;
+                    break;
+                }
+
+                memcpy(temp, dir_stack, sizeof(unsigned int) * max_depth);
+                if (dir_stack != dir_stack_buf)
+                    free(dir_stack);
+
+                dir_stack = temp;
+                max_depth *= 2;
+            }
+
+            dir_stack[++depth] = U8NodeSize(node);
         }
     }
 
+    if (dir_stack != dir_stack_buf)
+        free(dir_stack);
+
+    if (ret < 0)
+        return ret;
+
     if (ctx) {
-        ctx->header = *header;
+        ctx->header = header;
         ctx->nodes = nodes;
         ctx->node_count = node_count;
         ctx->str_table = str_table;
         ctx->str_table_size = str_table_size;
 
         ctx->ptr = ptr;
+        ctx->fsize = size;
     }
 
     return 0;
 }
 
-#define next_sibling(N, n) ((((N[n]).type == 0x00) ? n + 1 : ((N[n]).size)))
-#define has_child(N, n) ((N[n]).type == 0x01 && (n + 1) != (N[n].size))
-
-void U8Examine(U8Context* ctx) {
-    unsigned int dir_stack[16] = { ctx->node_count };
-    int dir_lvl = 0;
-    char string[128];
-    const char
-        dir_skip = 0xb3,
-        dir_child = 0xc3,
-        dir_last_child = 0xc0,
-        dir_start = 0xc2,
-        child = 0xc4;
-
-
-    printf("/ (node count=%u)\n", ctx->node_count);
-
-    for (unsigned int index = 1; index < ctx->node_count; index++) {
-        U8Node* node = &ctx->nodes[index];
-        const char* name = ctx->str_table + node->name_offset;
-
-        char* ptr = string;
-        for (int i = 0; i < dir_lvl; i++) {
-            *ptr++ = (next_sibling(ctx->nodes, index) == dir_stack[i]) ? ' ' : dir_skip;
-        }
-        *ptr++ = (next_sibling(ctx->nodes, index) == dir_stack[dir_lvl]) ? dir_last_child : dir_child;
-        *ptr++ = has_child(ctx->nodes, index) ? dir_start : child;
-        ptr += sprintf(ptr, node->type == 0x00 ? "%s " : "%s/ ", name);
-        if (node->type == 0x00) {
-            sprintf(ptr, "(%#x)", node->size);
-        }
-        else {
-            dir_stack[++dir_lvl] = node->size;
-        }
-
-        puts(string);
-        VIDEO_WaitVSync();
-        VIDEO_WaitVSync();
-
-        while (index + 1 == dir_stack[dir_lvl] && dir_lvl > 0) dir_lvl--;
-    }
+static inline unsigned int U8NextSibling(const U8Node* nodes, unsigned int index) {
+    return (U8NodeType(&nodes[index]) == 0x00) ? index + 1 : U8NodeSize(&nodes[index]);
 }
 
 static unsigned int U8FindChild(U8Context* ctx, unsigned int parent, const char* name) {
-    if (ctx->nodes[parent].type != 0x01) {
+    if (U8NodeType(&ctx->nodes[parent]) != 0x01) {
         ERROR("Tried to find child in a non-directory node");
         return 0;
     }
 
     unsigned int dir_cur = parent + 1;
-    unsigned int dir_end = ctx->nodes[parent].size;
+    unsigned int dir_end = U8NodeSize(&ctx->nodes[parent]);
 
     while (dir_cur < dir_end) {
         U8Node* node = &ctx->nodes[dir_cur];
-        const char* node_name = ctx->str_table + node->name_offset;
+        const char* node_name = ctx->str_table + U8NodeNameOffset(node);
 
         if (!strcmp(name, node_name))
             return dir_cur;
 
         // Next child node
-        dir_cur = next_sibling(ctx->nodes, dir_cur);
+        dir_cur = U8NextSibling(ctx->nodes, dir_cur);
+    }
+
+    return 0;
+}
+
+struct U8PathIndex {
+    unsigned int mask; // Slot count - 1
+    uint32_t* hashes;  // [node_count], full path hash of every node
+    uint32_t* parents; // [node_count], index of the directory that holds every node
+    uint32_t* slots;   // [mask + 1], node indices. 0 is free, the root node never goes in here
+};
+
+#define FNV_OFFSET 0x811C9DC5
+#define FNV_PRIME  0x01000193
+
+static uint32_t U8HashComponent(uint32_t hash, const char* name, size_t len) {
+    hash = (hash ^ '/') * FNV_PRIME;
+    while (len--)
+        hash = (hash ^ (unsigned char)*name++) * FNV_PRIME;
+
+    return hash;
+}
+
+// Same as strtok(path, "/"), so "/meta//icon.bin" and "meta/icon.bin" hash the same
+static uint32_t U8HashPath(const char* path) {
+    uint32_t hash = FNV_OFFSET;
+
+    while (*path) {
+        while (*path == '/') path++;
+        if (!*path) break;
+
+        size_t len = strcspn(path, "/");
+        hash = U8HashComponent(hash, path, len);
+        path += len;
+    }
+
+    return hash;
+}
+
+// Walk up from the node and match path components from the end
+static bool U8IndexMatch(U8Context* ctx, unsigned int index, const char* path) {
+    const char* end = strchr(path, 0);
+
+    while (true) {
+        while (end > path && end[-1] == '/') end--;
+        if (end == path)
+            return index == 0;
+
+        if (index == 0)
+            return false;
+
+        const char* start = end;
+        while (start > path && start[-1] != '/') start--;
+
+        const char* name = ctx->str_table + U8NodeNameOffset(&ctx->nodes[index]);
+        size_t len = end - start;
+        if (strncmp(name, start, len) || name[len])
+            return false;
+
+        index = ctx->index->parents[index];
+        end = start;
+    }
+}
+
+int U8BuildIndex(U8Context* ctx) {
+    assert(ctx != NULL && ctx->nodes != NULL);
+
+    if (ctx->index)
+        return 0;
+
+    unsigned int slot_count = 16;
+    while (slot_count < ctx->node_count * 2) slot_count <<= 1;
+
+    U8PathIndex* index = malloc(sizeof(U8PathIndex) + (sizeof(uint32_t) * ((ctx->node_count * 2) + slot_count)));
+    if (!index) {
+        ERROR("Failed to allocate path index (%u nodes)", ctx->node_count);
+        return -1;
+    }
+
+    index->mask    = slot_count - 1;
+    index->hashes  = (uint32_t*)(index + 1);
+    index->parents = index->hashes + ctx->node_count;
+    index->slots   = index->parents + ctx->node_count;
+    memset(index->slots, 0, sizeof(uint32_t) * slot_count);
+
+    index->hashes[0]  = FNV_OFFSET;
+    index->parents[0] = 0;
+
+    unsigned int dir = 0;
+    for (unsigned int i = 1; i < ctx->node_count; i++) {
+        U8Node* node = &ctx->nodes[i];
+        const char* name = ctx->str_table + U8NodeNameOffset(node);
+
+        // Climb out of every directory that ended before this node
+        while (dir != 0 && i >= U8NodeSize(&ctx->nodes[dir]))
+            dir = index->parents[dir];
+
+        index->parents[i] = dir;
+        index->hashes[i]  = U8HashComponent(index->hashes[dir], name, strlen(name));
+
+        unsigned int slot = index->hashes[i] & index->mask;
+        while (index->slots[slot])
+            slot = (slot + 1) & index->mask;
+
+        index->slots[slot] = i;
+
+        if (U8NodeType(node) == 0x01)
+            dir = i;
+    }
+
+    ctx->index = index;
+    return 0;
+}
+
+static unsigned int U8IndexLookup(U8Context* ctx, const char* filepath) {
+    U8PathIndex* index = ctx->index;
+    uint32_t hash = U8HashPath(filepath);
+
+    for (unsigned int slot = hash & index->mask; index->slots[slot]; slot = (slot + 1) & index->mask) {
+        unsigned int node = index->slots[slot];
+
+        if (index->hashes[node] == hash && U8IndexMatch(ctx, node, filepath))
+            return node;
     }
 
     return 0;
 }
 
+bool U8NameIsSafe(const char* name) {
+    if (!*name || strchr(name, '/'))
+        return false;
+
+    return strcmp(name, ".") && strcmp(name, "..");
+}
+
+void U8Free(U8Context* ctx) {
+    free(ctx->index);
+    ctx->index = NULL;
+}
+
 int U8OpenFile(U8Context* ctx, const char* filepath, U8File* out) {
     assert(ctx != NULL && filepath != NULL); // out? Eh not so much
 
+    unsigned int index = 0;
+    if (ctx->index) {
+        index = U8IndexLookup(ctx, filepath);
+        if (!index)
+            return -2;
+
+        goto found;
+    }
+
     char* _filepath = strdup(filepath);
     if (!_filepath) //??
         return -1;
 
     char* saveptr;
     char* elem = strtok_r(_filepath, "/", &saveptr);
-    unsigned int index = 0;
 
     if (!elem) {
         ERROR("strtok() came back with nothing on the first run?\n" "'%s' <-- Does this path have a slash?", filepath);
@@ -170,17 +346,164 @@ int U8OpenFile(U8Context* ctx, const char* filepath, U8File* out) {
     if (!index)
         return -2;
 
+found:
     U8Node* node = &ctx->nodes[index];
-    if (node->type != 0x00)
+    if (U8NodeType(node) != 0x00)
         return -3;
 
     if (out) {
         out->ctx    = ctx;
         out->index  = index;
-        out->offset = node->offset;
-        out->ptr    = ctx->ptr + node->offset;
-        out->size   = node->size;
+        out->offset = U8NodeOffset(node);
+        out->ptr    = ctx->ptr + U8NodeOffset(node);
+        out->size   = U8NodeSize(node);
+    }
+
+    return 0;
+}
+
+int U8IterInit(U8Iter* it, U8Context* ctx) {
+    assert(it != NULL && ctx != NULL);
+
+    memset(it, 0, sizeof(U8Iter));
+    it->ctx = ctx;
+    it->max_depth = 16;
+    it->stack = malloc(sizeof(U8IterDir) * it->max_depth);
+    it->path_max = 256;
+    it->path = malloc(it->path_max);
+    if (!it->stack || !it->path) {
+        ERROR("Memory allocation failed");
+        U8IterFree(it);
+        return -1;
+    }
+
+    it->stack[0] = (U8IterDir){ 0, ctx->node_count };
+    *it->path = 0;
+
+    if (ctx->node_count < 2)
+        return 0;
+
+    it->index = 1;
+    return 1;
+}
+
+int U8IterNext(U8Iter* it) {
+    if (!it->index)
+        return 0;
+
+    unsigned int next = U8NextSibling(it->ctx->nodes, it->index);
+    if (next <= it->index || next >= it->stack[it->depth].end)
+        return 0;
+
+    it->index = next;
+    it->path_valid = false;
+    return 1;
+}
+
+int U8IterEnter(U8Iter* it) {
+    U8Node* node = &it->ctx->nodes[it->index];
+
+    if (!it->index || U8NodeType(node) != 0x01 || U8NodeSize(node) <= it->index + 1)
+        return 0;
+
+    if (it->depth + 1 == it->max_depth) {
+        U8IterDir* temp = realloc(it->stack, sizeof(U8IterDir) * it->max_depth * 2);
+        if (!temp) {
+            ERROR("Memory allocation failed (depth %u)", it->depth);
+            return -1;
+        }
+
+        it->stack = temp;
+        it->max_depth *= 2;
+    }
+
+    it->stack[++it->depth] = (U8IterDir){ it->index, U8NodeSize(node) };
+    it->index++;
+    it->path_valid = false;
+    return 1;
+}
+
+int U8IterParent(U8Iter* it) {
+    if (!it->index || !it->depth)
+        return 0;
+
+    it->index = it->stack[it->depth--].index;
+    it->path_valid = false;
+    return 1;
+}
+
+int U8IterWalk(U8Iter* it) {
+    int ret = U8IterEnter(it);
+    if (ret != 0)
+        return ret;
+
+    while (it->index) {
+        ret = U8IterNext(it);
+        if (ret != 0)
+            return ret;
+
+        if (!it->depth) {
+            it->index = 0; // That was the last one
+            return 0;
+        }
+
+        U8IterParent(it);
     }
 
     return 0;
 }
+
+bool U8IterIsLast(U8Iter* it, unsigned int depth) {
+    unsigned int index = (depth == it->depth) ? it->index : it->stack[depth + 1].index;
+
+    return U8NextSibling(it->ctx->nodes, index) >= it->stack[depth].end;
+}
+
+const char* U8IterName(U8Iter* it) {
+    return it->ctx->str_table + U8NodeNameOffset(&it->ctx->nodes[it->index]);
+}
+
+// Walking doesn't need the path, so it only gets formatted for whoever asks
+const char* U8IterPath(U8Iter* it) {
+    U8Context* ctx = it->ctx;
+    size_t len = 0;
+
+    if (it->path_valid)
+        return it->path;
+
+    if (!it->index) {
+        *it->path = 0;
+        return it->path;
+    }
+
+    // stack[1..depth] are the directories leading up to it, then the node itself
+    for (unsigned int depth = 1; depth <= it->depth + 1; depth++) {
+        unsigned int index = (depth <= it->depth) ? it->stack[depth].index : it->index;
+        const char* name = ctx->str_table + U8NodeNameOffset(&ctx->nodes[index]);
+        size_t need = len + strlen(name) + 2;
+
+        if (need > it->path_max) {
+            char* temp = realloc(it->path, need * 2);
+            if (!temp) {
+                ERROR("Memory allocation failed (path length %zu)", need);
+                return NULL;
+            }
+
+            it->path = temp;
+            it->path_max = need * 2;
+        }
+
+        len += sprintf(it->path + len, len ? "/%s" : "%s", name);
+    }
+
+    it->path_valid = true;
+    return it->path;
+}
+
+void U8IterFree(U8Iter* it) {
+    free(it->stack);
+    free(it->path);
+    it->stack = NULL;
+    it->path = NULL;
+    it->index = 0;
+}
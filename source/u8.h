@@ -1,7 +1,13 @@
+#pragma once
 #include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "byteorder.h"
 
 #define U8_MAGIC 0x55AA382D
 
+// Both of these are exactly as they are on disk (big-endian). Go through the accessors below.
 typedef struct U8Header {
     uint32_t magic; // 0x55AA382D
     uint32_t root_node_offset; // Always (usually) 0x20?
@@ -10,20 +16,32 @@ typedef struct U8Header {
 } U8Header;
 
 typedef struct U8Node {
-    uint32_t type: 8; // 0x00: File, 0x01: Directory
-    uint32_t name_offset: 24; // Relative to start of string table
+    uint32_t type_name; // Top 8 bits: Type (0x00: File, 0x01: Directory), rest: Name offset, relative to start of string table
     uint32_t offset; // Relative to the very start of file. Which is, silly. Like, the data offset is up there
     uint32_t size; // Directories: Pointer to end of directory (as in, &nodes[size]), or a pointer to the next child of it's parent directory. For the root node it specifies how many nodes are here
 } U8Node;
 
+// Big-endian <-> host order, it's the same swap both ways
+static inline U8Header U8HeaderSwap(const U8Header* header) {
+    return (U8Header) { be32(header->magic), be32(header->root_node_offset), be32(header->meta_size), be32(header->data_offset) };
+}
+
+static inline unsigned int U8NodeType(const U8Node* node) { return be32(node->type_name) >> 24; }
+static inline unsigned int U8NodeNameOffset(const U8Node* node) { return be32(node->type_name) & 0xFFFFFF; }
+static inline unsigned int U8NodeOffset(const U8Node* node) { return be32(node->offset); }
+static inline unsigned int U8NodeSize(const U8Node* node) { return be32(node->size); }
+
+typedef struct U8PathIndex U8PathIndex;
+
 typedef struct U8Context {
-    U8Header header;
+    U8Header header; // Already swapped to host order
     union { U8Node *nodes, *root_node; };
     unsigned int node_count;
     const char* str_table;
     unsigned int str_table_size; // str_table_end = ptr + root_node_offset + meta_size
     void* ptr;
     size_t fsize;
+    U8PathIndex* index; // Optional, see U8BuildIndex
 } U8Context;
 
 typedef struct U8File {
@@ -34,6 +52,48 @@ typedef struct U8File {
     size_t size;
 } U8File;
 
-int U8Init(void* ptr, U8Context* ctx);
-void U8Examine(U8Context*);
+typedef struct U8IterDir {
+    unsigned int index; // Directory node
+    unsigned int end;   // First node past it
+} U8IterDir;
+
+// Cursor over a U8Context. stack[depth] is the directory holding the current node; stack[0] is the root.
+typedef struct U8Iter {
+    U8Context* ctx;
+    unsigned int index; // Current node. 0: Nothing (empty archive, or walked off the end)
+    unsigned int depth;
+    unsigned int max_depth;
+    U8IterDir* stack;
+    char* path;         // U8IterPath's buffer, only up to date while path_valid
+    size_t path_max;
+    bool path_valid;
+} U8Iter;
+
+// Errors from U8Init
+enum {
+    U8_ERR_MAGIC  = -1,
+    U8_ERR_ROOT   = -2, // Root node isn't a directory, or the node count doesn't fit
+    U8_ERR_TYPE   = -3,
+    U8_ERR_NAME   = -4, // Name offset is past the string table, or the name runs off the end of it
+    U8_ERR_DATA   = -5, // File data is outside of the data section or the buffer
+    U8_ERR_DIR    = -6, // Directory end marker doesn't nest inside its parent
+    U8_ERR_BOUNDS = -7, // Header/node table/string table don't fit in the buffer
+    U8_ERR_NOMEM  = -8, // Only for really deep trees
+};
+
+int U8Init(void* ptr, size_t size, U8Context* ctx); // Checks everything against size, the rest of the U8* functions trust it after that
 int U8OpenFile(U8Context* ctx, const char* filepath, U8File* out);
+int U8BuildIndex(U8Context* ctx); // Full path hash -> node index, so U8OpenFile doesn't have to walk the tree every time. Worth it past a handful of lookups, see u8tool lookup
+void U8Free(U8Context* ctx);
+bool U8NameIsSafe(const char* name); // Not empty, ".", ".." or holding a '/'. Anything extracting to a real directory checks every node with this first
+
+// These return 1 if the cursor moved, 0 if it didn't, < 0 on error.
+int U8IterInit(U8Iter* it, U8Context* ctx); // Starts on the root's first child
+int U8IterNext(U8Iter* it);   // Next sibling
+int U8IterEnter(U8Iter* it);  // First child of the current directory
+int U8IterParent(U8Iter* it); // The directory holding the current node
+int U8IterWalk(U8Iter* it);   // Pre-order: enter, next, or climb up until there is a next
+bool U8IterIsLast(U8Iter* it, unsigned int depth); // Is the node in stack[depth] that leads to the current node the last one in there?
+const char* U8IterName(U8Iter* it); // Of the current node
+const char* U8IterPath(U8Iter* it); // Full path of the current node, no leading slash. Put together on the first call after a move, NULL if out of memory
+void U8IterFree(U8Iter* it);
@@ -0,0 +1,665 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "u8stream.h"
+
+#define ERROR(str, ...) fprintf(stderr, "%s:%i: \n" str "\n", __FILE__, __LINE__, ##__VA_ARGS__)
+
+static int U8StreamFileRead(void* user, void* buf, unsigned int len) {
+    size_t read = fread(buf, 1, len, (FILE*)user);
+    if (read < len && ferror((FILE*)user))
+        return -1;
+
+    return read;
+}
+
+static int U8StreamFileSeek(void* user, unsigned int offset) {
+    return fseek((FILE*)user, offset, SEEK_SET);
+}
+
+const U8StreamIO U8StreamFileIO = { U8StreamFileRead, U8StreamFileSeek };
+
+static int U8StreamMemRead(void* user, void* buf, unsigned int len) {
+    U8StreamMem* mem = user;
+
+    if (mem->pos >= mem->size)
+        return 0;
+
+    if (len > mem->size - mem->pos)
+        len = mem->size - mem->pos;
+
+    memcpy(buf, (const unsigned char*)mem->ptr + mem->pos, len);
+    mem->pos += len;
+    return len;
+}
+
+static int U8StreamMemSeek(void* user, unsigned int offset) {
+    U8StreamMem* mem = user;
+
+    if (offset > mem->size)
+        return -1;
+
+    mem->pos = offset;
+    return 0;
+}
+
+const U8StreamIO U8StreamMemIO = { U8StreamMemRead, U8StreamMemSeek };
+
+static U8StreamBlock* U8StreamFetch(U8Stream* stream, unsigned int offset) {
+    unsigned int block_offset = offset & ~(U8_STREAM_BLOCK_SIZE - 1);
+    U8StreamBlock* victim = &stream->cache[0];
+
+    for (int i = 0; i < U8_STREAM_BLOCK_COUNT; i++) {
+        U8StreamBlock* block = &stream->cache[i];
+
+        if (block->length && block->offset == block_offset) {
+            block->last_use = ++stream->clock;
+            return block;
+        }
+
+        if (!block->length || block->last_use < victim->last_use)
+            victim = block;
+    }
+
+    int ret = stream->io->seek(stream->user, stream->base + block_offset);
+    if (ret < 0) {
+        ERROR("Seek to %#x failed (ret=%i)", stream->base + block_offset, ret);
+        return NULL;
+    }
+
+    ret = stream->io->read(stream->user, victim->data, U8_STREAM_BLOCK_SIZE);
+    if (ret <= 0) {
+        ERROR("Read at %#x failed (ret=%i)", stream->base + block_offset, ret);
+        victim->length = 0;
+        return NULL;
+    }
+
+    victim->offset   = block_offset;
+    victim->length   = ret;
+    victim->last_use = ++stream->clock;
+    return victim;
+}
+
+// Copies out metadata bytes, going through the cache
+static int U8StreamPeek(U8Stream* stream, unsigned int offset, void* out, unsigned int len) {
+    unsigned char* ptr = out;
+
+    if (stream->meta) {
+        unsigned int meta_len = stream->str_table + stream->str_table_size;
+        if (offset > meta_len || len > meta_len - offset) {
+            ERROR("Unexpected end of metadata at %#x", offset);
+            return -2;
+        }
+
+        memcpy(out, stream->meta + offset, len);
+        return 0;
+    }
+
+    while (len) {
+        U8StreamBlock* block = U8StreamFetch(stream, offset);
+        if (!block)
+            return -1;
+
+        unsigned int start = offset - block->offset;
+        if (start >= block->length) {
+            ERROR("Unexpected end of archive at %#x", offset);
+            return -2;
+        }
+
+        unsigned int count = block->length - start;
+        if (count > len)
+            count = len;
+
+        memcpy(ptr, block->data + start, count);
+        ptr += count;
+        offset += count;
+        len -= count;
+    }
+
+    return 0;
+}
+
+int U8StreamInit(U8Stream* stream, const U8StreamIO* io, void* user, unsigned int base, unsigned int size) {
+    assert(stream != NULL && io != NULL);
+
+    memset(stream, 0, sizeof(U8Stream));
+    stream->io   = io;
+    stream->user = user;
+    stream->base = base;
+    stream->size = size ? size : ~0u;
+
+    U8Header header;
+    int ret = U8StreamPeek(stream, 0, &header, sizeof(U8Header));
+    if (ret < 0)
+        return ret;
+
+    stream->header = U8HeaderSwap(&header);
+
+    if (stream->header.magic != U8_MAGIC) {
+        ERROR("U8 header magic is invalid (%#08x != %#08x)", stream->header.magic, U8_MAGIC);
+        return -1;
+    }
+
+    const U8Header* h = &stream->header;
+    if (h->root_node_offset < sizeof(U8Header) || h->root_node_offset % 4 || h->meta_size < sizeof(U8Node)
+    ||  h->root_node_offset > stream->size || h->meta_size > stream->size - h->root_node_offset || h->data_offset > stream->size) {
+        ERROR("Node table is out of bounds (%#x+%#x, data at %#x, archive size %#x)", h->root_node_offset, h->meta_size, h->data_offset, stream->size);
+        return U8_ERR_BOUNDS;
+    }
+
+    U8Node root_node;
+    ret = U8StreamPeek(stream, stream->header.root_node_offset, &root_node, sizeof(U8Node));
+    if (ret < 0)
+        return ret;
+
+    if (U8NodeType(&root_node) != 0x01) {
+        ERROR("Root node is not a directory? What?");
+        return -2;
+    }
+
+    if (U8NodeSize(&root_node) == 0 || U8NodeSize(&root_node) > (stream->header.meta_size - 1) / sizeof(U8Node)) { // And at least one byte of string table
+        ERROR("Node count is out of range (%#x nodes, meta size %#x)", U8NodeSize(&root_node), stream->header.meta_size);
+        return -3;
+    }
+
+    stream->node_count     = U8NodeSize(&root_node);
+    stream->str_table      = stream->header.root_node_offset + (stream->node_count * sizeof(U8Node));
+    stream->str_table_size = stream->header.meta_size - (stream->node_count * sizeof(U8Node));
+
+    return 0;
+}
+
+int U8StreamCacheMeta(U8Stream* stream) {
+    unsigned int meta_len = stream->str_table + stream->str_table_size;
+
+    if (stream->meta || meta_len > U8_STREAM_MAX_META)
+        return 0;
+
+    unsigned char* meta = malloc(meta_len);
+    if (!meta)
+        return -ENOMEM;
+
+    int ret = stream->io->seek(stream->user, stream->base);
+    if (ret < 0) {
+        ERROR("Seek to %#x failed (ret=%i)", stream->base, ret);
+        free(meta);
+        return ret;
+    }
+
+    for (unsigned int pos = 0; pos < meta_len; pos += ret) {
+        ret = stream->io->read(stream->user, meta + pos, meta_len - pos);
+        if (ret <= 0) {
+            ERROR("Read at %#x failed (ret=%i)", stream->base + pos, ret);
+            free(meta);
+            return (ret < 0) ? ret : -2;
+        }
+    }
+
+    stream->meta = meta;
+    return 0;
+}
+
+void U8StreamFree(U8Stream* stream) {
+    free(stream->meta);
+    stream->meta = NULL;
+}
+
+// Everything U8Init checks for a node, except the name's terminator: U8StreamGetName and U8StreamNameEquals stop at the end of the string table.
+// parent_end is where the directory holding it ends
+static int U8StreamCheckNode(U8Stream* stream, unsigned int index, const U8Node* node, unsigned int parent_end) {
+    if (U8NodeType(node) != 0x00 && U8NodeType(node) != 0x01) {
+        ERROR("Node #%u has invalid node type (%#x)", index, U8NodeType(node));
+        return U8_ERR_TYPE;
+    }
+
+    if (U8NodeNameOffset(node) >= stream->str_table_size) {
+        ERROR("Name for node #%u is out of range (%#x, string table size %#x)", index, U8NodeNameOffset(node), stream->str_table_size);
+        return U8_ERR_NAME;
+    }
+
+    if (U8NodeType(node) == 0x00) {
+        if (U8NodeOffset(node) < stream->header.data_offset || U8NodeOffset(node) > stream->size || U8NodeSize(node) > stream->size - U8NodeOffset(node)) {
+            ERROR("Data for file node #%u is out of bounds (%#x+%#x, data at %#x, archive size %#x)", index, U8NodeOffset(node), U8NodeSize(node), stream->header.data_offset, stream->size);
+            return U8_ERR_DATA;
+        }
+    }
+    // Has to end after itself, and no later than whatever it's in
+    else if (U8NodeSize(node) <= index || U8NodeSize(node) > parent_end) {
+        ERROR("End marker for directory node #%u is out of bounds (%#x, parent ends at %#x)", index, U8NodeSize(node), parent_end);
+        return U8_ERR_DIR;
+    }
+
+    return 0;
+}
+
+int U8StreamGetNode(U8Stream* stream, unsigned int index, U8Node* out) {
+    if (index >= stream->node_count) {
+        ERROR("Node #%u is out of range (%u nodes)", index, stream->node_count);
+        return -1;
+    }
+
+    return U8StreamPeek(stream, stream->header.root_node_offset + (index * sizeof(U8Node)), out, sizeof(U8Node));
+}
+
+int U8StreamGetName(U8Stream* stream, const U8Node* node, char* out, size_t size) {
+    unsigned int offset = U8NodeNameOffset(node);
+
+    for (size_t i = 0; i < size; i++, offset++) {
+        if (offset >= stream->str_table_size) {
+            ERROR("Name offset is out of range (%#x >= %#x)", offset, stream->str_table_size);
+            return -1;
+        }
+
+        int ret = U8StreamPeek(stream, stream->str_table + offset, &out[i], 1);
+        if (ret < 0)
+            return ret;
+
+        if (!out[i])
+            return i;
+    }
+
+    out[size - 1] = 0;
+    return -2; // Doesn't fit
+}
+
+static bool U8StreamNameEquals(U8Stream* stream, const U8Node* node, const char* name, size_t len) {
+    char temp[64];
+
+    unsigned int name_offset = U8NodeNameOffset(node);
+    if (name_offset >= stream->str_table_size || stream->str_table_size - name_offset < len + 1)
+        return false;
+
+    unsigned int offset = stream->str_table + name_offset;
+    size_t remaining = len + 1; // Terminator included
+
+    while (remaining) {
+        size_t count = (remaining > sizeof(temp)) ? sizeof(temp) : remaining;
+        bool last = (count == remaining);
+
+        if (U8StreamPeek(stream, offset, temp, count) < 0)
+            return false;
+
+        if (memcmp(temp, name, last ? count - 1 : count))
+            return false;
+
+        if (last)
+            return temp[count - 1] == 0;
+
+        name += count;
+        offset += count;
+        remaining -= count;
+    }
+
+    return false;
+}
+
+int U8StreamOpenFile(U8Stream* stream, const char* filepath, U8StreamFile* out) {
+    assert(stream != NULL && filepath != NULL);
+
+    unsigned int index = 0;
+    U8Node node;
+
+    int ret = U8StreamGetNode(stream, 0, &node);
+    if (ret < 0)
+        return ret;
+
+    while (*filepath) {
+        while (*filepath == '/') filepath++;
+        if (!*filepath) break;
+
+        size_t len = strcspn(filepath, "/");
+        if (U8NodeType(&node) != 0x01)
+            return -2;
+
+        unsigned int dir_cur = index + 1;
+        unsigned int dir_end = U8NodeSize(&node);
+
+        index = 0;
+        while (dir_cur < dir_end) {
+            U8Node child;
+
+            if ((ret = U8StreamGetNode(stream, dir_cur, &child)) < 0
+            ||  (ret = U8StreamCheckNode(stream, dir_cur, &child, dir_end)) < 0)
+                return ret;
+
+            if (U8StreamNameEquals(stream, &child, filepath, len)) {
+                index = dir_cur;
+                node  = child;
+                break;
+            }
+
+            dir_cur = (U8NodeType(&child) == 0x00) ? dir_cur + 1 : U8NodeSize(&child);
+        }
+
+        if (!index)
+            return -2;
+
+        filepath += len;
+    }
+
+    if (!index)
+        return -2;
+
+    if (U8NodeType(&node) != 0x00)
+        return -3;
+
+    if (out) {
+        out->stream = stream;
+        out->index  = index;
+        out->offset = U8NodeOffset(&node);
+        out->size   = U8NodeSize(&node);
+        out->pos    = 0;
+    }
+
+    return 0;
+}
+
+// File data skips the cache and goes straight into buf
+int U8StreamRead(U8StreamFile* file, void* buf, unsigned int len) {
+    U8Stream* stream = file->stream;
+
+    if (file->pos >= file->size)
+        return 0;
+
+    if (len > file->size - file->pos)
+        len = file->size - file->pos;
+
+    int ret = stream->io->seek(stream->user, stream->base + file->offset + file->pos);
+    if (ret < 0) {
+        ERROR("Seek to %#x failed (ret=%i)", stream->base + file->offset + file->pos, ret);
+        return ret;
+    }
+
+    ret = stream->io->read(stream->user, buf, len);
+    if (ret < 0) {
+        ERROR("Read of %#x bytes failed (ret=%i)", len, ret);
+        return ret;
+    }
+
+    file->pos += ret;
+    return ret;
+}
+
+static int U8StreamSubRead(void* user, void* buf, unsigned int len) {
+    return U8StreamRead(user, buf, len);
+}
+
+static int U8StreamSubSeek(void* user, unsigned int offset) {
+    U8StreamFile* file = user;
+
+    if (offset > file->size)
+        return -1;
+
+    file->pos = offset;
+    return 0;
+}
+
+const U8StreamIO U8StreamSubIO = { U8StreamSubRead, U8StreamSubSeek };
+
+// Relative, and every component would pass U8NameIsSafe
+static bool U8DirSinkCheckPath(const char* path) {
+    char name[256];
+
+    do {
+        size_t len = strcspn(path, "/");
+        if (len >= sizeof(name))
+            return false;
+
+        memcpy(name, path, len);
+        name[len] = 0;
+        if (!U8NameIsSafe(name))
+            return false;
+
+        path += len;
+    } while (*path++);
+
+    return true;
+}
+
+static int U8DirSinkDirectory(void* user, const char* path) {
+    U8DirSink* sink = user;
+    char out_path[512];
+
+    if (!U8DirSinkCheckPath(path)) {
+        ERROR("Refusing to create %s", path);
+        return -EINVAL;
+    }
+
+    // Cut short, two files could end up as the same one
+    if (snprintf(out_path, sizeof(out_path), "%s/%s", sink->out_dir, path) >= sizeof(out_path)) {
+        ERROR("Path is too long (%s/%s)", sink->out_dir, path);
+        return -ENAMETOOLONG;
+    }
+
+    if (mkdir(out_path, 0755) < 0 && errno != EEXIST) {
+        ERROR("mkdir(%s) failed (errno=%i)", out_path, errno);
+        return -errno;
+    }
+
+    return 0;
+}
+
+static int U8DirSinkOpen(void* user, const char* path, unsigned int size) {
+    U8DirSink* sink = user;
+    char out_path[512];
+
+    if (!U8DirSinkCheckPath(path)) {
+        ERROR("Refusing to create %s", path);
+        return -EINVAL;
+    }
+
+    // Cut short, two files could end up as the same one
+    if (snprintf(out_path, sizeof(out_path), "%s/%s", sink->out_dir, path) >= sizeof(out_path)) {
+        ERROR("Path is too long (%s/%s)", sink->out_dir, path);
+        return -ENAMETOOLONG;
+    }
+
+    sink->fp = fopen(out_path, "wb");
+    if (!sink->fp) {
+        ERROR("fopen(%s) failed (errno=%i)", out_path, errno);
+        return -errno;
+    }
+
+    return 0;
+}
+
+static int U8DirSinkWrite(void* user, const void* buf, unsigned int len) {
+    U8DirSink* sink = user;
+
+    if (!fwrite(buf, len, 1, sink->fp)) {
+        ERROR("fwrite failed (errno=%i)", errno);
+        return -errno;
+    }
+
+    return 0;
+}
+
+static int U8DirSinkClose(void* user) {
+    U8DirSink* sink = user;
+    int ret = fclose(sink->fp);
+
+    sink->fp = NULL;
+    return (ret == 0) ? 0 : -errno;
+}
+
+const U8Sink U8DirSinkOps = { U8DirSinkDirectory, U8DirSinkOpen, U8DirSinkWrite, U8DirSinkClose };
+
+typedef struct U8ExtractFile {
+    unsigned int index;
+    unsigned int offset;
+    unsigned int size;
+    bool directory;
+    char* path;
+} U8ExtractFile;
+
+// Directories first, in node order so parents come before children. Then files by offset
+static int U8ExtractCompare(const void* a_, const void* b_) {
+    const U8ExtractFile *a = a_, *b = b_;
+
+    if (a->directory != b->directory)
+        return b->directory - a->directory;
+
+    if (a->directory)
+        return (a->index > b->index) - (a->index < b->index);
+
+    return (a->offset > b->offset) - (a->offset < b->offset);
+}
+
+// One pass over the node table for the paths, then one pass over the data region in file offset order.
+// Every name gets checked before the sink sees anything, so a bad node can't leave half an extraction (or a "../") behind
+int U8StreamExtractAll(U8Stream* stream, const U8Sink* sink, void* user, void* chunk, unsigned int chunk_size) {
+    int ret = 0;
+    unsigned int num_files = 0, num_dirs = 0, max_depth = 16, depth = 0;
+    U8ExtractFile* files = malloc(sizeof(U8ExtractFile) * stream->node_count);
+    struct { unsigned int end; size_t path_len; }* stack = malloc(sizeof(*stack) * max_depth);
+    char path[512] = {};
+
+    if (!files || !stack) {
+        ERROR("Memory allocation failed (%u nodes)", stream->node_count);
+        ret = -1;
+        goto out;
+    }
+
+    stack[0].end = stream->node_count;
+    stack[0].path_len = 0;
+
+    for (unsigned int i = 1; i < stream->node_count; i++) {
+        U8Node node;
+        char name[256];
+
+        while (depth > 0 && i >= stack[depth].end)
+            depth--;
+
+        if ((ret = U8StreamGetNode(stream, i, &node)) < 0
+        ||  (ret = U8StreamCheckNode(stream, i, &node, stack[depth].end)) < 0
+        ||  (ret = U8StreamGetName(stream, &node, name, sizeof(name))) < 0)
+            goto out;
+
+        if (!U8NameIsSafe(name)) {
+            ERROR("Node #%u has a name that can't be extracted (\"%s\")", i, name);
+            ret = -2;
+            goto out;
+        }
+
+        size_t len = stack[depth].path_len;
+        if (snprintf(path + len, sizeof(path) - len, len ? "/%s" : "%s", name) >= sizeof(path) - len) {
+            ERROR("Path for node #%u is too long", i);
+            ret = -2;
+            goto out;
+        }
+
+        files[num_files].index     = i;
+        files[num_files].offset    = U8NodeOffset(&node);
+        files[num_files].size      = U8NodeSize(&node);
+        files[num_files].directory = (U8NodeType(&node) != 0x00);
+        files[num_files].path      = strdup(path);
+        if (!files[num_files++].path) {
+            ERROR("Memory allocation failed");
+            ret = -1;
+            goto out;
+        }
+
+        if (U8NodeType(&node) == 0x00)
+            continue;
+
+        num_dirs++;
+        if (U8NodeSize(&node) <= i + 1)
+            continue;
+
+        if (depth + 1 == max_depth) {
+            void* temp = realloc(stack, sizeof(*stack) * max_depth * 2);
+            if (!temp) {
+                ERROR("Memory allocation failed (depth %u)", depth);
+                ret = -1;
+                goto out;
+            }
+
+            stack = temp;
+            max_depth *= 2;
+        }
+
+        depth++;
+        stack[depth].end = U8NodeSize(&node);
+        stack[depth].path_len = strlen(path);
+    }
+
+    qsort(files, num_files, sizeof(U8ExtractFile), U8ExtractCompare);
+
+    for (unsigned int i = 0; i < num_dirs; i++) {
+        ret = sink->directory(user, files[i].path);
+        if (ret < 0)
+            goto out;
+    }
+
+    // Everything from window_start to window_end is sitting in chunk
+    unsigned int window_start = 0, window_end = 0, data_end = 0;
+    for (unsigned int i = num_dirs; i < num_files; i++) {
+        if (files[i].offset + files[i].size > data_end)
+            data_end = files[i].offset + files[i].size;
+    }
+
+    for (unsigned int i = num_dirs; i < num_files; i++) {
+        U8ExtractFile* file = &files[i];
+        unsigned int pos = file->offset, end = file->offset + file->size;
+
+        ret = sink->open(user, file->path, file->size);
+        if (ret < 0)
+            goto out;
+
+        while (pos < end) {
+            if (pos < window_start || pos >= window_end) {
+                unsigned int len = (data_end - pos > chunk_size) ? chunk_size : data_end - pos;
+
+                // Anything that isn't picking up right where we left off needs a seek
+                if (pos != window_end || window_end == 0) {
+                    ret = stream->io->seek(stream->user, stream->base + pos);
+                    if (ret < 0) {
+                        ERROR("Seek to %#x failed (ret=%i)", stream->base + pos, ret);
+                        break;
+                    }
+                }
+
+                ret = stream->io->read(stream->user, chunk, len);
+                if (ret <= 0) {
+                    ERROR("Read of %#x bytes at %#x failed (ret=%i)", len, stream->base + pos, ret);
+                    ret = (ret < 0) ? ret : -3;
+                    break;
+                }
+
+                window_start = pos;
+                window_end = pos + ret;
+            }
+
+            unsigned int count = ((end < window_end) ? end : window_end) - pos;
+            ret = sink->write(user, (unsigned char*)chunk + (pos - window_start), count);
+            if (ret < 0)
+                break;
+
+            pos += count;
+        }
+
+        int close_ret = sink->close(user);
+        if (ret >= 0)
+            ret = close_ret;
+
+        if (ret < 0)
+            goto out;
+    }
+
+    ret = 0;
+
+out:
+    if (files) {
+        for (unsigned int i = 0; i < num_files; i++)
+            free(files[i].path);
+    }
+
+    free(files);
+    free(stack);
+    return ret;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <stdio.h>
+#include <stddef.h>
+
+#include "u8.h"
+
+// Pulls the node table and string table in through a small block cache instead of needing all of it in memory.
+#define U8_STREAM_BLOCK_SIZE  0x200
+#define U8_STREAM_BLOCK_COUNT 4
+#define U8_STREAM_MAX_META    0x100000 // U8StreamCacheMeta won't go past this, bigger ones stay on the block cache
+
+typedef struct U8StreamIO {
+    int (*read)(void* user, void* buf, unsigned int len); // Returns bytes read, < 0 on error. buf is 0x40 aligned when it's the cache asking
+    int (*seek)(void* user, unsigned int offset);         // Absolute. Returns < 0 on error
+} U8StreamIO;
+
+typedef struct U8StreamBlock {
+    unsigned char data[U8_STREAM_BLOCK_SIZE] __attribute__((aligned(0x40)));
+    unsigned int  offset; // Relative to the start of the archive
+    unsigned int  length; // 0: Empty
+    unsigned int  last_use;
+} U8StreamBlock;
+
+typedef struct U8Stream {
+    const U8StreamIO* io;
+    void* user;
+    unsigned int base; // Where the archive starts in the stream
+    unsigned int size; // Of the archive, ~0 if nobody knows
+    U8Header header; // Host order
+    unsigned int node_count;
+    unsigned int str_table; // Relative to the start of the archive
+    unsigned int str_table_size;
+    unsigned int clock;
+    unsigned char* meta; // Header, node table and string table from U8StreamCacheMeta, NULL if they go through the cache
+    U8StreamBlock cache[U8_STREAM_BLOCK_COUNT];
+} U8Stream;
+
+typedef struct U8StreamFile {
+    U8Stream* stream;
+    unsigned int index;
+    unsigned int offset; // Relative to the start of the archive, like U8Node
+    unsigned int size;
+    unsigned int pos;
+} U8StreamFile;
+
+typedef struct U8StreamMem {
+    const void* ptr;
+    size_t size;
+    size_t pos;
+} U8StreamMem;
+
+// Where U8StreamExtractAll puts things. Directories come first, parents before children, then files ordered by offset.
+typedef struct U8Sink {
+    int (*directory)(void* user, const char* path);
+    int (*open)(void* user, const char* path, unsigned int size);
+    int (*write)(void* user, const void* buf, unsigned int len);
+    int (*close)(void* user);
+} U8Sink;
+
+typedef struct U8DirSink {
+    const char* out_dir;
+    FILE* fp;
+} U8DirSink;
+
+extern const U8StreamIO U8StreamFileIO; // user = FILE*
+extern const U8StreamIO U8StreamMemIO;  // user = U8StreamMem*
+extern const U8StreamIO U8StreamSubIO;  // user = U8StreamFile*. For archives inside of archives
+extern const U8Sink U8DirSinkOps;       // user = U8DirSink*. Plain directories, FAT or otherwise
+
+// Nodes get the same checks U8Init does, one at a time as U8StreamOpenFile and U8StreamExtractAll come across them.
+// size is 0 when it isn't known, then file data only has to start past data_offset and not wrap around
+int U8StreamInit(U8Stream* stream, const U8StreamIO* io, void* user, unsigned int base, unsigned int size);
+// Reads all of the metadata in one go after U8StreamInit. For sources that can't seek backwards cheaply (LZ77StreamIO starts over),
+// where the node table and string table taking turns in the cache would mean starting over for nearly every miss
+int U8StreamCacheMeta(U8Stream* stream);
+void U8StreamFree(U8Stream* stream); // Only needed after U8StreamCacheMeta
+int U8StreamGetNode(U8Stream* stream, unsigned int index, U8Node* out); // As it is on disk, use the U8Node* accessors
+int U8StreamGetName(U8Stream* stream, const U8Node* node, char* out, size_t size);
+int U8StreamOpenFile(U8Stream* stream, const char* filepath, U8StreamFile* out);
+int U8StreamRead(U8StreamFile* file, void* buf, unsigned int len);
+int U8StreamExtractAll(U8Stream* stream, const U8Sink* sink, void* user, void* chunk, unsigned int chunk_size); // chunk should be 0x40 aligned
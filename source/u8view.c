@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "u8view.h"
+#include "menu.h"
+#include "video.h"
+#include "pad.h"
+
+static const char
+    dir_skip = 0xb3,
+    dir_child = 0xc3,
+    dir_last_child = 0xc0,
+    dir_start = 0xc2,
+    child = 0xc4;
+
+static void U8PrintLine(U8Iter* it) {
+    U8Node* node = &it->ctx->nodes[it->index];
+    const char* name = U8IterName(it);
+    char string[256];
+    char* ptr = string;
+
+    // Only draw the parts that fit, the rest is going to get cut off anyways
+    for (unsigned int i = 0; i < it->depth && ptr - string < conX; i++)
+        *ptr++ = U8IterIsLast(it, i) ? ' ' : dir_skip;
+
+    *ptr++ = U8IterIsLast(it, it->depth) ? dir_last_child : dir_child;
+    *ptr++ = (U8NodeType(node) == 0x01 && U8NodeSize(node) != it->index + 1) ? dir_start : child;
+
+    if (U8NodeType(node) == 0x00)
+        snprintf(ptr, sizeof(string) - (ptr - string), "%s (%#x)", name, U8NodeSize(node));
+    else
+        snprintf(ptr, sizeof(string) - (ptr - string), "%s/", name);
+
+    printf("%.*s\n", conX - 1, string);
+}
+
+void U8Examine(U8Context* ctx) {
+    U8Iter it;
+    unsigned int start = 0;
+    unsigned int count = ctx->node_count - 1; // One line per node, minus the root
+    unsigned int page  = conY - 6;
+
+    while (true) {
+        print_this_dumb_header();
+        printf("/ (node count=%u) :: Lines %u-%u\n\n", ctx->node_count, start + 1, (start + page < count) ? start + page : count);
+
+        // Skipping ahead without printing anything is cheap, so just start over every time
+        if (U8IterInit(&it, ctx) < 0)
+            return;
+
+        for (unsigned int line = 0; it.index && line < start + page; line++) {
+            if (line >= start)
+                U8PrintLine(&it);
+
+            if (U8IterWalk(&it) < 0)
+                break;
+        }
+
+        U8IterFree(&it);
+
+        switch (wait_button(WPAD_BUTTON_B | WPAD_BUTTON_UP | WPAD_BUTTON_DOWN | WPAD_BUTTON_LEFT | WPAD_BUTTON_RIGHT | WPAD_BUTTON_HOME)) {
+            case WPAD_BUTTON_DOWN: {
+                if (start + page < count)
+                    start++;
+            } break;
+
+            case WPAD_BUTTON_UP: {
+                if (start > 0)
+                    start--;
+            } break;
+
+            case WPAD_BUTTON_RIGHT: {
+                start += page;
+                if (start + page > count)
+                    start = (count > page) ? count - page : 0;
+            } break;
+
+            case WPAD_BUTTON_LEFT: {
+                start = (start > page) ? start - page : 0;
+            } break;
+
+            case WPAD_BUTTON_B:
+            case WPAD_BUTTON_HOME: {
+                return;
+            } break;
+        }
+    }
+}
@@ -0,0 +1,4 @@
+#pragma once
+#include "u8.h"
+
+void U8Examine(U8Context*);
@@ -0,0 +1,488 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "u8write.h"
+
+#define ERROR(str, ...) fprintf(stderr, "%s:%i: \n" str "\n", __FILE__, __LINE__, ##__VA_ARGS__)
+
+#define U8_ALIGN(x, align) (((x) + ((align) - 1)) & ~((align) - 1))
+#define U8_CHUNK_SIZE 0x10000
+
+int U8WriterInit(U8Writer* writer) {
+    assert(writer != NULL);
+
+    memset(writer, 0, sizeof(U8Writer));
+    writer->file_align = 0x20;
+    writer->data_align = 0x40;
+
+    writer->max_entries = 64;
+    writer->entries = calloc(writer->max_entries, sizeof(U8WriteEntry));
+    if (!writer->entries) {
+        ERROR("Failed to allocate entry list");
+        return -1;
+    }
+
+    writer->entries[0].name   = strdup("");
+    writer->entries[0].is_dir = true;
+    writer->num_entries = 1;
+
+    return writer->entries[0].name ? 0 : -1;
+}
+
+void U8WriterFree(U8Writer* writer) {
+    for (unsigned int i = 0; i < writer->num_entries; i++) {
+        free(writer->entries[i].name);
+        free(writer->entries[i].host_path);
+    }
+
+    free(writer->entries);
+    writer->entries = NULL;
+    writer->num_entries = writer->max_entries = 0;
+}
+
+static unsigned int U8WriterFindChild(U8Writer* writer, unsigned int parent, const char* name, size_t len) {
+    for (unsigned int i = writer->entries[parent].first_child; i; i = writer->entries[i].next_sibling) {
+        const char* child_name = writer->entries[i].name;
+
+        if (!strncmp(child_name, name, len) && !child_name[len])
+            return i;
+    }
+
+    return 0;
+}
+
+static int U8WriterNewChild(U8Writer* writer, unsigned int parent, const char* name, size_t len, bool is_dir) {
+    if (writer->num_entries == writer->max_entries) {
+        U8WriteEntry* temp = reallocarray(writer->entries, writer->max_entries * 2, sizeof(U8WriteEntry));
+        if (!temp) {
+            ERROR("Failed to grow entry list (%u entries)", writer->num_entries);
+            return -1;
+        }
+
+        writer->entries = temp;
+        writer->max_entries *= 2;
+    }
+
+    unsigned int index = writer->num_entries;
+    U8WriteEntry* entry = &writer->entries[index];
+
+    memset(entry, 0, sizeof(U8WriteEntry));
+    entry->name = strndup(name, len);
+    if (!entry->name) {
+        ERROR("Failed to allocate name");
+        return -1;
+    }
+
+    entry->parent = parent;
+    entry->is_dir = is_dir;
+    entry->next_sibling = writer->entries[parent].first_child;
+    writer->entries[parent].first_child = index;
+
+    writer->num_entries++;
+    return index;
+}
+
+// Finds or makes every directory along the way. The last component is made as a file or directory.
+static int U8WriterMakePath(U8Writer* writer, const char* path, bool is_dir) {
+    unsigned int index = 0;
+
+    while (*path) {
+        while (*path == '/') path++;
+        if (!*path) break;
+
+        size_t len = strcspn(path, "/");
+        bool last = !path[len + strspn(path + len, "/")];
+
+        if (!writer->entries[index].is_dir) {
+            ERROR("'%.*s' is under a file", (int)len, path);
+            return -2;
+        }
+
+        unsigned int child = U8WriterFindChild(writer, index, path, len);
+        if (child && last && !(is_dir && writer->entries[child].is_dir)) {
+            ERROR("'%.*s' was already added", (int)len, path);
+            return -3;
+        }
+
+        if (!child) {
+            int ret = U8WriterNewChild(writer, index, path, len, last ? is_dir : true);
+            if (ret < 0)
+                return ret;
+
+            child = ret;
+        }
+
+        index = child;
+        path += len;
+    }
+
+    if (!index) {
+        ERROR("Empty path");
+        return -2;
+    }
+
+    return index;
+}
+
+int U8WriterAddDirectory(U8Writer* writer, const char* path) {
+    int ret = U8WriterMakePath(writer, path, true);
+
+    return (ret < 0) ? ret : 0;
+}
+
+int U8WriterAddData(U8Writer* writer, const char* path, const void* data, unsigned int size) {
+    int ret = U8WriterMakePath(writer, path, false);
+    if (ret < 0)
+        return ret;
+
+    writer->entries[ret].data = data;
+    writer->entries[ret].size = size;
+    return 0;
+}
+
+int U8WriterAddFile(U8Writer* writer, const char* path, unsigned int size, U8ReadFn read, void* user) {
+    int ret = U8WriterMakePath(writer, path, false);
+    if (ret < 0)
+        return ret;
+
+    writer->entries[ret].read = read;
+    writer->entries[ret].user = user;
+    writer->entries[ret].size = size;
+    return 0;
+}
+
+struct U8TreeDir {
+    char* host_path;
+    unsigned int index;
+};
+
+int U8WriterAddTree(U8Writer* writer, const char* host_dir, const char* path) {
+    int ret = 0;
+    unsigned int index = 0;
+
+    if (path && *path) {
+        ret = U8WriterMakePath(writer, path, true);
+        if (ret < 0)
+            return ret;
+
+        index = ret;
+    }
+
+    // Directories still to be scanned. Grows as we find more of them
+    struct U8TreeDir* queue = malloc(sizeof(struct U8TreeDir) * 16);
+    unsigned int queue_head = 0, queue_len = 0, queue_max = 16;
+
+    if (!queue || !(queue[0].host_path = strdup(host_dir))) {
+        free(queue);
+        ERROR("Memory allocation failed");
+        return -1;
+    }
+    queue[0].index = index;
+    queue_len = 1;
+
+    while (queue_head < queue_len) {
+        struct U8TreeDir dir = queue[queue_head++];
+        DIR* pdir = opendir(dir.host_path);
+        if (!pdir) {
+            ERROR("opendir(%s) failed (errno=%i)", dir.host_path, errno);
+            free(dir.host_path);
+            ret = -errno;
+            break;
+        }
+
+        struct dirent* pent;
+        while ((pent = readdir(pdir))) {
+            if (!strcmp(pent->d_name, ".") || !strcmp(pent->d_name, ".."))
+                continue;
+
+            char* host_path = malloc(strlen(dir.host_path) + strlen(pent->d_name) + 2);
+            if (!host_path) {
+                ERROR("Memory allocation failed");
+                ret = -1;
+                break;
+            }
+            sprintf(host_path, "%s/%s", dir.host_path, pent->d_name);
+
+            struct stat st;
+            if (stat(host_path, &st) < 0) {
+                ERROR("stat(%s) failed (errno=%i)", host_path, errno);
+                free(host_path);
+                ret = -errno;
+                break;
+            }
+
+            bool is_dir = S_ISDIR(st.st_mode);
+            if (!is_dir && st.st_size > 0xFFFFFFFF) {
+                ERROR("%s is too large for a U8 archive", host_path);
+                free(host_path);
+                ret = -EFBIG;
+                break;
+            }
+
+            ret = U8WriterNewChild(writer, dir.index, pent->d_name, strlen(pent->d_name), is_dir);
+            if (ret < 0) {
+                free(host_path);
+                break;
+            }
+
+            if (!is_dir) {
+                writer->entries[ret].host_path = host_path;
+                writer->entries[ret].size = st.st_size;
+                ret = 0;
+                continue;
+            }
+
+            if (queue_len == queue_max) {
+                struct U8TreeDir* temp = reallocarray(queue, queue_max * 2, sizeof(struct U8TreeDir));
+                if (!temp) {
+                    ERROR("Memory allocation failed");
+                    free(host_path);
+                    ret = -1;
+                    break;
+                }
+
+                queue = temp;
+                queue_max *= 2;
+            }
+
+            queue[queue_len].host_path = host_path;
+            queue[queue_len].index = ret;
+            queue_len++;
+            ret = 0;
+        }
+
+        closedir(pdir);
+        free(dir.host_path);
+        if (ret < 0)
+            break;
+    }
+
+    while (queue_head < queue_len)
+        free(queue[queue_head++].host_path);
+
+    free(queue);
+    return ret;
+}
+
+static int U8WriterCompare(const void* a_, const void* b_) {
+    const U8WriteEntry* const* a = a_;
+    const U8WriteEntry* const* b = b_;
+
+    return strcmp((*b)->name, (*a)->name); // Descending
+}
+
+static int U8WriterPad(U8WriteFn write, void* user, unsigned int count) {
+    static const unsigned char zero[0x40] = {};
+
+    while (count) {
+        unsigned int len = (count > sizeof(zero)) ? sizeof(zero) : count;
+
+        int ret = write(user, zero, len);
+        if (ret < 0)
+            return ret;
+
+        count -= len;
+    }
+
+    return 0;
+}
+
+static int U8WriterCopy(U8WriteEntry* entry, void* chunk, U8WriteFn write, void* user) {
+    int ret = 0;
+    FILE* fp = NULL;
+
+    if (entry->data) {
+        ret = entry->size ? write(user, entry->data, entry->size) : 0;
+        return (ret < 0) ? ret : 0;
+    }
+
+    if (entry->host_path) {
+        fp = fopen(entry->host_path, "rb");
+        if (!fp) {
+            ERROR("fopen(%s) failed (errno=%i)", entry->host_path, errno);
+            return -errno;
+        }
+    }
+
+    unsigned int done = 0;
+    while (done < entry->size) {
+        unsigned int len = (entry->size - done > U8_CHUNK_SIZE) ? U8_CHUNK_SIZE : entry->size - done;
+
+        if (fp)
+            ret = fread(chunk, 1, len, fp);
+        else if (entry->read)
+            ret = entry->read(entry->user, chunk, len);
+        else
+            ret = -1;
+
+        if (ret <= 0) {
+            ERROR("Short read on %s (%#x/%#x)", entry->name, done, entry->size);
+            ret = -EIO;
+            break;
+        }
+
+        len = ret;
+        ret = write(user, chunk, len);
+        if (ret < 0)
+            break;
+
+        done += len;
+    }
+
+    if (fp)
+        fclose(fp);
+
+    return (ret < 0) ? ret : 0;
+}
+
+int U8WriterWrite(U8Writer* writer, U8WriteFn write, void* user) {
+    int ret = 0;
+    unsigned int count = writer->num_entries;
+
+    // Node order (pre-order, children sorted by name), entry -> node index, nodes under each entry
+    unsigned int* order      = malloc(sizeof(unsigned int) * count * 3);
+    unsigned int* node_index = order + count;
+    unsigned int* subtree    = node_index + count;
+    U8WriteEntry** stack     = malloc(sizeof(U8WriteEntry*) * count);
+    U8Node* nodes            = NULL;
+    void* chunk              = NULL;
+
+    if (!order || !stack) {
+        ERROR("Memory allocation failed (%u entries)", count);
+        ret = -1;
+        goto out;
+    }
+
+    unsigned int num_ordered = 0, stack_top = 0;
+    stack[stack_top++] = &writer->entries[0];
+
+    while (stack_top) {
+        U8WriteEntry* entry = stack[--stack_top];
+        unsigned int index = entry - writer->entries;
+
+        node_index[index] = num_ordered;
+        order[num_ordered++] = index;
+        subtree[index] = 1;
+
+        unsigned int first = stack_top;
+        for (unsigned int i = entry->first_child; i; i = writer->entries[i].next_sibling)
+            stack[stack_top++] = &writer->entries[i];
+
+        // Sorted descending so that the first name comes off the stack first
+        qsort(stack + first, stack_top - first, sizeof(U8WriteEntry*), U8WriterCompare);
+    }
+
+    for (unsigned int i = count - 1; i > 0; i--)
+        subtree[writer->entries[order[i]].parent] += subtree[order[i]];
+
+    unsigned int str_table_size = 0;
+    for (unsigned int i = 0; i < count; i++)
+        str_table_size += strlen(writer->entries[i].name) + 1;
+
+    unsigned int meta_size = (count * sizeof(U8Node)) + str_table_size;
+    U8Header header = {
+        .magic            = U8_MAGIC,
+        .root_node_offset = 0x20,
+        .meta_size        = meta_size,
+        .data_offset      = U8_ALIGN(0x20 + meta_size, writer->data_align),
+    };
+    U8Header disk_header = U8HeaderSwap(&header);
+
+    nodes = calloc(1, meta_size);
+    if (!nodes) {
+        ERROR("Memory allocation failed (meta size %#x)", meta_size);
+        ret = -1;
+        goto out;
+    }
+
+    char* str_table = (char*)(nodes + count);
+    unsigned int str_offset = 0, data_offset = header.data_offset;
+
+    for (unsigned int i = 0; i < count; i++) {
+        unsigned int index = order[i];
+        U8WriteEntry* entry = &writer->entries[index];
+        U8Node* node = &nodes[i];
+
+        // name_offset is only 24 bits, the top byte is the type
+        if (str_offset > 0x00FFFFFF) {
+            ERROR("String table too large (%#x bytes at '%s')", str_offset, entry->name);
+            ret = -EFBIG;
+            goto out;
+        }
+
+        node->type_name = be32((entry->is_dir ? 0x01000000 : 0x00000000) | str_offset);
+        str_offset = stpcpy(str_table + str_offset, entry->name) - str_table + 1;
+
+        if (entry->is_dir) {
+            node->offset = be32((index == 0) ? 0 : node_index[entry->parent]);
+            node->size   = be32(i + subtree[index]);
+        } else {
+            uint64_t end = U8_ALIGN((uint64_t)data_offset, (uint64_t)writer->file_align) + entry->size;
+            if (end > UINT32_MAX) {
+                ERROR("Archive too large (%#llx bytes at '%s')", (unsigned long long)end, entry->name);
+                ret = -EFBIG;
+                goto out;
+            }
+
+            data_offset  = U8_ALIGN(data_offset, writer->file_align);
+            node->offset = be32(data_offset);
+            node->size   = be32(entry->size);
+            data_offset += entry->size;
+        }
+    }
+
+    chunk = aligned_alloc(0x40, U8_CHUNK_SIZE);
+    if (!chunk) {
+        ERROR("Memory allocation failed");
+        ret = -1;
+        goto out;
+    }
+
+    if ((ret = write(user, &disk_header, sizeof(disk_header))) < 0
+    ||  (ret = U8WriterPad(write, user, header.root_node_offset - sizeof(header))) < 0
+    ||  (ret = write(user, nodes, meta_size)) < 0)
+        goto out;
+
+    unsigned int pos = header.root_node_offset + meta_size;
+    for (unsigned int i = 0; i < count; i++) {
+        U8WriteEntry* entry = &writer->entries[order[i]];
+        if (entry->is_dir)
+            continue;
+
+        ret = U8WriterPad(write, user, U8NodeOffset(&nodes[i]) - pos);
+        if (ret < 0)
+            goto out;
+
+        ret = U8WriterCopy(entry, chunk, write, user);
+        if (ret < 0)
+            goto out;
+
+        pos = U8NodeOffset(&nodes[i]) + U8NodeSize(&nodes[i]);
+    }
+
+    ret = 0;
+
+out:
+    free(chunk);
+    free(nodes);
+    free(stack);
+    free(order);
+    return ret;
+}
+
+static int U8WriterFileWrite(void* user, const void* buf, unsigned int len) {
+    if (len && !fwrite(buf, len, 1, (FILE*)user))
+        return -errno;
+
+    return 0;
+}
+
+int U8WriterWriteFile(U8Writer* writer, FILE* fp) {
+    return U8WriterWrite(writer, U8WriterFileWrite, fp);
+}
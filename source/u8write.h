@@ -0,0 +1,44 @@
+#pragma once
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "u8.h"
+
+// Builds a U8 archive. Entries are collected first (names and sizes only), then U8WriterWrite lays out
+// the whole node table up front and streams every file's data in one after the other.
+
+typedef int (*U8ReadFn)(void* user, void* buf, unsigned int len);        // Returns bytes read, < 0 on error
+typedef int (*U8WriteFn)(void* user, const void* buf, unsigned int len); // Returns < 0 on error
+
+typedef struct U8WriteEntry {
+    char* name;
+    unsigned int parent;
+    unsigned int first_child, next_sibling; // 0: None. The root is never anyone's child
+    bool is_dir;
+    unsigned int size;
+
+    // Where the data comes from. One of these
+    const void* data;
+    char* host_path;
+    U8ReadFn read;
+    void* user;
+} U8WriteEntry;
+
+typedef struct U8Writer {
+    U8WriteEntry* entries; // [0] is the root
+    unsigned int num_entries;
+    unsigned int max_entries;
+    unsigned int file_align; // 0x20 by default
+    unsigned int data_align; // 0x40 by default
+} U8Writer;
+
+int U8WriterInit(U8Writer* writer);
+void U8WriterFree(U8Writer* writer);
+
+int U8WriterAddDirectory(U8Writer* writer, const char* path);
+int U8WriterAddData(U8Writer* writer, const char* path, const void* data, unsigned int size);
+int U8WriterAddFile(U8Writer* writer, const char* path, unsigned int size, U8ReadFn read, void* user);
+int U8WriterAddTree(U8Writer* writer, const char* host_dir, const char* path);
+
+int U8WriterWrite(U8Writer* writer, U8WriteFn write, void* user);
+int U8WriterWriteFile(U8Writer* writer, FILE* fp);
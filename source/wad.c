@@ -0,0 +1,727 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ogc/es.h>
+#include <mbedtls/md5.h>
+
+#include "common.h"
+#include "wad.h"
+#include "save.h"
+#include "nand.h"
+#include "crypto.h"
+#include "hash.h"
+#include "pipeline.h"
+#include "protect.h"
+
+// Not in libogc
+#define ES_KEY_PRNG   5  // What ES_ExportContentData encrypts with, different on every console
+#define ES_KEY_KOREAN 11
+
+#define WAD_CERT_PATH "/sys/cert.sys"
+
+// What the NAND hands out space in
+#define NAND_CLUSTER_SIZE 0x4000
+
+static const uint8_t zeroes[0x40];
+
+// Whole file, 0x40 aligned and padded
+static void* read_nand_file(const char* path, uint32_t* size) {
+	int   ret, fd;
+	void* data = NULL;
+
+	if ((fd = ret = nand_open(path, NAND_OPEN_READ)) < 0) {
+		print_error("nand_open(%s)", ret, path);
+		return NULL;
+	}
+
+	if ((ret = nand_get_file_size(fd, size)) < 0) {
+		print_error("nand_get_file_size(%s)", ret, path);
+	}
+	else if (!(data = aligned_alloc(0x40, align_up(*size, 0x40)))) {
+		print_error("memory allocation", 0);
+	}
+	else if ((ret = nand_read(fd, data, *size)) != *size) {
+		print_error("nand_read(%s)", ret, path);
+		free(data);
+		data = NULL;
+	}
+	else {
+		memset(data + *size, 0, align_up(*size, 0x40) - *size);
+	}
+
+	nand_close(fd);
+	return data;
+}
+
+static int write_padded(FILE* fp, const void* data, uint32_t size) {
+	if (!fwrite(data, size, 1, fp) || (size % 0x40 && !fwrite(zeroes, 0x40 - (size % 0x40), 1, fp)))
+		return -errno;
+
+	return 0;
+}
+
+// Encrypted with the common key (or the Korean one), title ID for an IV
+static int decrypt_title_key(const signed_blob* s_tik, uint8_t title_key[16]) {
+	const tik* p_tik = SIGNATURE_PAYLOAD(s_tik);
+	uint8_t    common_key_index = ((const uint8_t *)p_tik)[0xB1];
+	uint8_t    iv[16] __attribute__((aligned(0x20))) = {};
+	uint8_t    key[16] __attribute__((aligned(0x20)));
+
+	if (common_key_index > 1) {
+		fprintf(stderr, "Ticket wants common key #%u, which this console doesn't have\n", common_key_index);
+		return -EINVAL;
+	}
+
+	memcpy(iv, &p_tik->titleid, sizeof(p_tik->titleid));
+	memcpy(key, p_tik->cipher_title_key, sizeof(key));
+	int ret = ES_Decrypt(common_key_index ? ES_KEY_KOREAN : ES_KEY_COMMON, iv, key, sizeof(key), key);
+	if (ret < 0) {
+		print_error("ES_Decrypt", ret);
+		return ret;
+	}
+
+	memcpy(title_key, key, sizeof(key));
+	return 0;
+}
+
+static int wad_write_chunk(void* user, const void* data, unsigned int len) {
+	return fwrite(data, len, 1, (FILE *)user) ? 0 : -errno;
+}
+
+// Decrypted out of ES, hashed against the TMD, encrypted again with the title key. The pipeline's thread does the writing
+static int write_content(pipeline* pipe, uint64_t title_id, const tmd_content* con, const uint8_t title_key[16]) {
+	int      ret = 0;
+	uint8_t  iv[16] = { con->index >> 8, con->index };
+	uint8_t  hash[20];
+	sha1_ctx sha;
+
+	int cfd = open_title_content(title_id, con->index);
+	if (cfd < 0)
+		return cfd;
+
+	sha1_init(&sha);
+	for (uint64_t done = 0; done < con->size; ) {
+		unsigned int len = (con->size - done > pipe->buffer_size) ? pipe->buffer_size : con->size - done;
+		unsigned char* buf = pipeline_acquire(pipe);
+		if (!buf) {
+			ret = pipe->error;
+			goto exit;
+		}
+
+		ret = ES_ReadContent(cfd, buf, len);
+		if (ret != len) {
+			print_error("ES_ReadContent(%08x)", ret, con->cid);
+			ret = (ret < 0) ? ret : -EIO;
+			goto exit;
+		}
+
+		sha1_update(&sha, buf, len);
+
+		// Only the last one is ever short. Zeroes to the next AES block, then (unencrypted) to the next 0x40
+		unsigned int len16 = align_up(len, 16);
+		memset(buf + len, 0, align_up(len, 0x40) - len);
+		if ((ret = aes_cbc_encrypt(title_key, iv, buf, len16, buf)) < 0) {
+			print_error("aes_cbc_encrypt", ret);
+			goto exit;
+		}
+
+		if ((ret = pipeline_submit(pipe, align_up(len, 0x40))) < 0)
+			goto exit;
+
+		done += len;
+	}
+
+	sha1_finish(&sha, hash);
+	if (memcmp(hash, con->hash, sizeof(hash))) {
+		fprintf(stderr, "Content %08x doesn't match the hash in its TMD, not much of a backup\n", con->cid);
+		ret = -EIO;
+	}
+
+exit:
+	ES_CloseContent(cfd);
+	return (ret < 0) ? ret : 0;
+}
+
+int export_wad(uint64_t title_id, FILE* fp) {
+	int          ret;
+	char         tik_path[NAND_MAXPATH];
+	uint32_t     cert_size = 0, tik_size = 0, tmd_size = 0;
+	void        *certs = NULL;
+	signed_blob *s_tik = NULL, *s_tmd = NULL;
+	uint8_t      title_key[16];
+	pipeline     pipe;
+	wad_header   header __attribute__((aligned(0x20))) = {
+		.header_size = WAD_HEADER_SIZE,
+		.type        = WAD_TYPE_IS,
+	};
+
+	sprintf(tik_path, "/ticket/%08x/%08x.tik", (uint32_t)(title_id >> 32), (uint32_t)title_id);
+	if (!(certs = read_nand_file(WAD_CERT_PATH, &cert_size)) || !(s_tik = read_nand_file(tik_path, &tik_size))) {
+		ret = -EIO;
+		goto exit;
+	}
+
+	// There could be more than one in there, the first one will do
+	if (tik_size < WAD_TIK_SIZE) {
+		fprintf(stderr, "%s is too small (%#x)\n", tik_path, tik_size);
+		ret = -EINVAL;
+		goto exit;
+	}
+
+	const tik* p_tik = SIGNATURE_PAYLOAD(s_tik);
+	if (p_tik->devicetype)
+		printf("Ticket is tied to this console (%08x), the WAD will only install here\n", p_tik->devicetype);
+
+	if ((ret = decrypt_title_key(s_tik, title_key)) < 0)
+		goto exit;
+
+	ret = ES_GetStoredTMDSize(title_id, &tmd_size);
+	if (ret < 0) {
+		print_error("ES_GetStoredTMDSize", ret);
+		goto exit;
+	}
+
+	if (!(s_tmd = aligned_alloc(0x40, align_up(tmd_size, 0x40)))) {
+		ret = -ENOMEM;
+		goto exit;
+	}
+
+	ret = ES_GetStoredTMD(title_id, s_tmd, tmd_size);
+	if (ret < 0) {
+		print_error("ES_GetStoredTMD", ret);
+		goto exit;
+	}
+
+	// Everything's known up front, so the header goes out first and nothing ever has to be gone back to
+	tmd* p_tmd = SIGNATURE_PAYLOAD(s_tmd);
+	header.cert_size = cert_size;
+	header.tik_size  = WAD_TIK_SIZE;
+	header.tmd_size  = tmd_size;
+	for (int i = 0; i < p_tmd->num_contents; i++)
+		header.data_size += align_up(p_tmd->contents[i].size, 0x40);
+
+	printf("WAD: %u contents, %#x bytes of content data\n", p_tmd->num_contents, header.data_size);
+	if ((ret = write_padded(fp, &header,  sizeof(header))) < 0
+	||  (ret = write_padded(fp, certs,    cert_size))      < 0
+	||  (ret = write_padded(fp, s_tik,    WAD_TIK_SIZE))   < 0
+	||  (ret = write_padded(fp, s_tmd,    tmd_size))       < 0)
+	{
+		print_error("fwrite", ret);
+		goto exit;
+	}
+
+	ret = pipeline_start(&pipe, 3, save_get_chunk_size(SAVE_STAGE_ES), wad_write_chunk, fp);
+	if (ret < 0) {
+		print_error("pipeline_start", ret);
+		goto exit;
+	}
+
+	for (int i = 0; i < p_tmd->num_contents; i++) {
+		const tmd_content* con = &p_tmd->contents[i];
+
+		printf("Processing content %i (%08x, %#llx)%s\n", con->index, con->cid, con->size, (con->type & 0x8000) ? " (shared)" : "");
+		if ((ret = write_content(&pipe, title_id, con, title_key)) < 0)
+			break;
+	}
+
+	int ret2 = pipeline_finish(&pipe);
+	if (ret == 0 && ret2 < 0) {
+		print_error("fwrite", ret2);
+		ret = ret2;
+	}
+
+exit:
+	free(certs);
+	free(s_tik);
+	free(s_tmd);
+	return ret;
+}
+
+// Everything in front of the contents, in memory and checked over
+struct wad_info {
+	wad_header   header __attribute__((aligned(0x20)));
+	void        *certs, *crl;
+	signed_blob *s_tik, *s_tmd;
+	long         data_offset;
+};
+
+static void free_wad_info(struct wad_info* info) {
+	free(info->certs);
+	free(info->crl);
+	free(info->s_tik);
+	free(info->s_tmd);
+}
+
+static void* read_section(FILE* fp, long* offset, uint32_t size) {
+	void* data = aligned_alloc(0x40, align_up(size ?: 1, 0x40));
+	if (!data)
+		return NULL;
+
+	if (fseek(fp, *offset, SEEK_SET) < 0 || (size && !fread(data, size, 1, fp))) {
+		free(data);
+		return NULL;
+	}
+
+	*offset += align_up(size, 0x40);
+	return data;
+}
+
+static int read_wad_info(FILE* fp, struct wad_info* info) {
+	wad_header* header = &info->header;
+	long        offset = align_up(WAD_HEADER_SIZE, 0x40);
+
+	memset(info, 0, sizeof(*info));
+	if (!fread(header, sizeof(*header), 1, fp)) {
+		fprintf(stderr, "Couldn't read the WAD header\n");
+		return -EIO;
+	}
+
+	if (header->header_size != WAD_HEADER_SIZE || (header->type != WAD_TYPE_IS && header->type != WAD_TYPE_IB)) {
+		fprintf(stderr, "Not a WAD (header size %#x, type %#06x)\n", header->header_size, header->type);
+		return -EINVAL;
+	}
+
+	// Nothing in any real WAD comes close
+	if (header->cert_size > 0x10000 || header->crl_size > 0x10000 || header->tik_size < WAD_TIK_SIZE || header->tik_size > 0x10000
+	||  header->tmd_size < sizeof(sig_rsa2048) + sizeof(tmd) || header->tmd_size > sizeof(sig_rsa2048) + sizeof(tmd) + (512 * sizeof(tmd_content)))
+	{
+		fprintf(stderr, "WAD sections are out of range (cert %#x, crl %#x, ticket %#x, TMD %#x)\n",
+		        header->cert_size, header->crl_size, header->tik_size, header->tmd_size);
+		return -EINVAL;
+	}
+
+	if (!(info->certs = read_section(fp, &offset, header->cert_size))
+	||  !(info->crl   = read_section(fp, &offset, header->crl_size))
+	||  !(info->s_tik = read_section(fp, &offset, header->tik_size))
+	||  !(info->s_tmd = read_section(fp, &offset, header->tmd_size)))
+	{
+		fprintf(stderr, "WAD is cut short\n");
+		free_wad_info(info);
+		return -EIO;
+	}
+
+	info->data_offset = offset;
+
+	const tmd* p_tmd = SIGNATURE_PAYLOAD(info->s_tmd);
+	uint64_t   data_size = 0;
+	if (!p_tmd->num_contents || header->tmd_size < sizeof(sig_rsa2048) + sizeof(tmd) + (p_tmd->num_contents * sizeof(tmd_content))) {
+		fprintf(stderr, "TMD is the wrong size for its %u contents\n", p_tmd->num_contents);
+		free_wad_info(info);
+		return -EINVAL;
+	}
+
+	// Some tools don't pad the last one past its last AES block
+	for (int i = 0; i < p_tmd->num_contents; i++)
+		data_size += align_up(p_tmd->contents[i].size, (i == p_tmd->num_contents - 1) ? 16 : 0x40);
+
+	if (data_size > header->data_size) {
+		fprintf(stderr, "WAD is missing content data (%#llx, TMD says %#llx)\n", (unsigned long long)header->data_size, (unsigned long long)data_size);
+		free_wad_info(info);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+// Everything the title's going to take, as if none of it was there yet. Clusters and an inode for every content, plus the TMD and ticket
+static int check_free_space(const tmd* p_tmd) {
+	uint32_t free_bytes, free_inodes;
+	uint64_t need_bytes  = 2 * NAND_CLUSTER_SIZE;
+	uint32_t need_inodes = 4 + p_tmd->num_contents;
+
+	for (int i = 0; i < p_tmd->num_contents; i++)
+		need_bytes += align_up(p_tmd->contents[i].size, NAND_CLUSTER_SIZE);
+
+	int ret = nand_get_free_space(&free_bytes, &free_inodes);
+	if (ret < 0) {
+		print_error("nand_get_free_space", ret);
+		return ret;
+	}
+
+	if (need_bytes > free_bytes || need_inodes > free_inodes) {
+		fprintf(stderr, "Not enough room on the NAND: needs %.2f MiB and %u inodes, %.2f MiB and %u inodes free\n",
+		        need_bytes / 1048576.0, need_inodes, free_bytes / 1048576.0, free_inodes);
+		return -ENOSPC;
+	}
+
+	return 0;
+}
+
+static int check_title(uint64_t title_id) {
+	const char* reason = title_no_touchy(title_id, 0, true);
+	if (reason) {
+		fprintf(stderr, "Not installing %016llx: %s\n", title_id, reason);
+		return -EPERM;
+	}
+
+	return 0;
+}
+
+static int wad_add_chunk(void* user, const void* data, unsigned int len) {
+	int ret = ES_AddContentData(*(int *)user, (u8 *)data, len);
+	if (ret < 0)
+		print_error("ES_AddContentData", ret);
+
+	return ret;
+}
+
+// Main thread reads from SD, the pipeline's thread keeps ES busy
+static int install_content(FILE* fp, long offset, uint64_t title_id, const tmd_content* con) {
+	int      ret, cfd;
+	pipeline pipe;
+	uint32_t size16 = align_up(con->size, 16);
+
+	if (fseek(fp, offset, SEEK_SET) < 0)
+		return -errno;
+
+	ret = cfd = ES_AddContentStart(title_id, con->cid);
+	if (ret < 0) {
+		print_error("ES_AddContentStart(%08x)", ret, con->cid);
+		return ret;
+	}
+
+	ret = pipeline_start(&pipe, 3, save_get_chunk_size(SAVE_STAGE_ES), wad_add_chunk, &cfd);
+	if (ret < 0) {
+		print_error("pipeline_start", ret);
+		return ret;
+	}
+
+	for (uint32_t done = 0; done < size16; ) {
+		unsigned int len = (size16 - done > pipe.buffer_size) ? pipe.buffer_size : size16 - done;
+		void* buf = pipeline_acquire(&pipe);
+		if (!buf)
+			break;
+
+		if (!fread(buf, len, 1, fp)) {
+			ret = ferror(fp) ? -errno : -EIO;
+			fprintf(stderr, "Content %08x is cut short\n", con->cid);
+			break;
+		}
+
+		pipeline_submit(&pipe, len);
+		done += len;
+	}
+
+	int ret2 = pipeline_finish(&pipe);
+	if (ret >= 0)
+		ret = ret2;
+
+	if (ret < 0)
+		return ret;
+
+	ret = ES_AddContentFinish(cfd);
+	if (ret < 0)
+		print_error("ES_AddContentFinish(%08x)", ret, con->cid);
+
+	return ret;
+}
+
+int install_wad(FILE* fp) {
+	int             ret;
+	struct wad_info info;
+
+	if ((ret = read_wad_info(fp, &info)) < 0)
+		return ret;
+
+	const tmd* p_tmd    = SIGNATURE_PAYLOAD(info.s_tmd);
+	uint64_t   title_id = p_tmd->title_id;
+	printf("Title %016llx v%hu, %u contents\n", title_id, p_tmd->title_version, p_tmd->num_contents);
+
+	// All before the ticket goes in, ES keeps that one even if the title doesn't make it
+	if ((ret = check_title(title_id)) < 0)
+		goto exit;
+
+	const tik* p_tik = SIGNATURE_PAYLOAD(info.s_tik);
+	if (p_tik->titleid != title_id) {
+		fprintf(stderr, "Ticket is for another title (%016llx)\n", p_tik->titleid);
+		ret = -EINVAL;
+		goto exit;
+	}
+
+	if ((ret = check_free_space(p_tmd)) < 0)
+		goto exit;
+
+	ret = ES_AddTicket(info.s_tik, info.header.tik_size, info.certs, info.header.cert_size, info.crl, info.header.crl_size);
+	if (ret < 0) {
+		print_error("ES_AddTicket", ret);
+		goto exit;
+	}
+
+	ret = ES_AddTitleStart(info.s_tmd, info.header.tmd_size, info.certs, info.header.cert_size, info.crl, info.header.crl_size);
+	if (ret < 0) {
+		print_error("ES_AddTitleStart", ret);
+		goto exit;
+	}
+
+	long offset = info.data_offset;
+	for (int i = 0; i < p_tmd->num_contents; i++) {
+		const tmd_content* con = &p_tmd->contents[i];
+
+		printf("Installing content %i (%08x, %#llx)\n", con->index, con->cid, con->size);
+		if ((ret = install_content(fp, offset, title_id, con)) < 0)
+			break;
+
+		offset += align_up(con->size, 0x40);
+	}
+
+	if (ret >= 0 && (ret = ES_AddTitleFinish()) < 0)
+		print_error("ES_AddTitleFinish", ret);
+
+	// Whatever made it into /tmp goes away, the title's left as it was
+	if (ret < 0)
+		ES_AddTitleCancel();
+
+exit:
+	free_wad_info(&info);
+	return (ret < 0) ? ret : 0;
+}
+
+// content_header then the icon, both SD encrypted and each with an MD5 of its own
+static int read_content_header(FILE* fp, uint64_t* title_id) {
+	int             ret = 0;
+	uint32_t        iv[4] __attribute__((aligned(0x20)));
+	uint32_t        md5_sum[4];
+	content_header *header = memalign32(sizeof(content_header));
+	void           *icon = NULL;
+
+	if (!header)
+		return -ENOMEM;
+
+	if (!fread(header, sizeof(content_header), 1, fp)) {
+		fprintf(stderr, "Couldn't read the header\n");
+		ret = -EIO;
+		goto exit;
+	}
+
+	memcpy(iv, sd_initial_iv, sizeof(iv));
+	if ((ret = sd_decrypt(iv, header, sizeof(content_header), header)) < 0) {
+		print_error("sd_decrypt", ret);
+		goto exit;
+	}
+
+	memcpy(md5_sum, header->header_md5, sizeof(md5_sum));
+	memcpy(header->header_md5, md5_blanker, sizeof(md5_sum));
+	mbedtls_md5_ret((const unsigned char *)header, sizeof(content_header), (unsigned char *)header->header_md5);
+	if (memcmp(md5_sum, header->header_md5, sizeof(md5_sum))) {
+		fprintf(stderr, "Header MD5 doesn't match, wrong file (or wrong SD key)?\n");
+		ret = -EINVAL;
+		goto exit;
+	}
+
+	// A banner-sized U8 archive, a whole MiB would be something else entirely
+	unsigned icon_size64 = align_up(header->icon_sz, 0x40);
+	if (!header->icon_sz || header->icon_sz > 0x100000) {
+		fprintf(stderr, "icon.bin size is out of range (%#x)\n", header->icon_sz);
+		ret = -EINVAL;
+		goto exit;
+	}
+
+	if (!(icon = aligned_alloc(0x40, icon_size64))) {
+		ret = -ENOMEM;
+		goto exit;
+	}
+
+	if (!fread(icon, icon_size64, 1, fp)) {
+		fprintf(stderr, "Couldn't read icon.bin\n");
+		ret = -EIO;
+		goto exit;
+	}
+
+	memcpy(iv, sd_initial_iv, sizeof(iv));
+	if ((ret = sd_decrypt(iv, icon, icon_size64, icon)) < 0) {
+		print_error("sd_decrypt", ret);
+		goto exit;
+	}
+
+	mbedtls_md5_ret(icon, icon_size64, (unsigned char *)md5_sum);
+	if (memcmp(md5_sum, header->icon_md5, sizeof(md5_sum))) {
+		fprintf(stderr, "icon.bin MD5 doesn't match\n");
+		ret = -EINVAL;
+		goto exit;
+	}
+
+	*title_id = header->title_id;
+
+exit:
+	free(header);
+	free(icon);
+	return ret;
+}
+
+// Out of the console's PRNG key and into the title key. The TMD's hash gets checked before ES is told it's done
+static int import_content_data(FILE* fp, uint64_t title_id, const tmd_content* con, const uint8_t title_key[16]) {
+	int      ret = 0, cfd;
+	uint8_t  prng_iv[16] __attribute__((aligned(0x20))) = { con->index >> 8, con->index };
+	uint8_t  title_iv[16] = { con->index >> 8, con->index };
+	uint8_t  hash[20];
+	uint32_t size64 = align_up(con->size, 0x40), size16 = align_up(con->size, 16);
+	sha1_ctx sha;
+	pipeline pipe;
+
+	ret = cfd = ES_AddContentStart(title_id, con->cid);
+	if (ret < 0) {
+		print_error("ES_AddContentStart(%08x)", ret, con->cid);
+		return ret;
+	}
+
+	ret = pipeline_start(&pipe, 3, save_get_chunk_size(SAVE_STAGE_ES), wad_add_chunk, &cfd);
+	if (ret < 0) {
+		print_error("pipeline_start", ret);
+		return ret;
+	}
+
+	sha1_init(&sha);
+	for (uint32_t done = 0; done < size64; ) {
+		unsigned int len = (size64 - done > pipe.buffer_size) ? pipe.buffer_size : size64 - done;
+		unsigned char* buf = pipeline_acquire(&pipe);
+		if (!buf)
+			break;
+
+		if (!fread(buf, len, 1, fp)) {
+			ret = ferror(fp) ? -errno : -EIO;
+			fprintf(stderr, "Content %08x is cut short\n", con->cid);
+			break;
+		}
+
+		if ((ret = ES_Decrypt(ES_KEY_PRNG, prng_iv, buf, len, buf)) < 0) {
+			print_error("ES_Decrypt", ret);
+			break;
+		}
+
+		// Past the end of the content is padding, which ES doesn't need to see either
+		unsigned int hashed = (con->size - done < len) ? con->size - done : len;
+		unsigned int send   = (size16 - done < len) ? size16 - done : len;
+
+		sha1_update(&sha, buf, hashed);
+		if ((ret = aes_cbc_encrypt(title_key, title_iv, buf, send, buf)) < 0) {
+			print_error("aes_cbc_encrypt", ret);
+			break;
+		}
+
+		pipeline_submit(&pipe, send);
+		done += len;
+	}
+
+	int ret2 = pipeline_finish(&pipe);
+	if (ret >= 0)
+		ret = ret2;
+
+	if (ret < 0)
+		return ret;
+
+	sha1_finish(&sha, hash);
+	if (memcmp(hash, con->hash, sizeof(hash))) {
+		fprintf(stderr, "Content %08x doesn't match the hash in its TMD. Made on another console?\n", con->cid);
+		return -EINVAL;
+	}
+
+	ret = ES_AddContentFinish(cfd);
+	if (ret < 0)
+		print_error("ES_AddContentFinish(%08x)", ret, con->cid);
+
+	return ret;
+}
+
+int import_content(FILE* fp) {
+	int          ret;
+	uint64_t     title_id;
+	uint32_t     device_id, cert_size = 0, tik_size = 0;
+	char         tik_path[NAND_MAXPATH];
+	void        *certs = NULL;
+	signed_blob *s_tik = NULL, *s_tmd = NULL;
+	uint8_t      title_key[16];
+	bk_header    bk_header __attribute__((aligned(0x40)));
+
+	if ((ret = read_content_header(fp, &title_id)) < 0)
+		return ret;
+
+	if (!fread(&bk_header, sizeof(bk_header), 1, fp)) {
+		fprintf(stderr, "Couldn't read the Bk header\n");
+		return -EIO;
+	}
+
+	if (bk_header.magic != BK_HDR_MAGIC || bk_header.header_size != BK_LISTED_SZ || bk_header.title_id != title_id
+	||  bk_header.tmd_size < sizeof(sig_rsa2048) + sizeof(tmd) || bk_header.tmd_size > sizeof(sig_rsa2048) + sizeof(tmd) + (512 * sizeof(tmd_content)))
+	{
+		fprintf(stderr, "Bk header is invalid (%08x, %#x, %016llx, TMD %#x)\n", bk_header.magic, bk_header.header_size, bk_header.title_id, bk_header.tmd_size);
+		return -EINVAL;
+	}
+
+	if ((ret = ES_GetDeviceID(&device_id)) < 0) {
+		print_error("ES_GetDeviceID", ret);
+		return ret;
+	}
+
+	if (bk_header.device_id != device_id) {
+		fprintf(stderr, "This was made on another console (%08x), only that one can import it\n", bk_header.device_id);
+		return -EINVAL;
+	}
+
+	unsigned tmd_size64 = align_up(bk_header.tmd_size, 0x40);
+	if (!(s_tmd = aligned_alloc(0x40, tmd_size64))) {
+		ret = -ENOMEM;
+		goto exit;
+	}
+
+	if (!fread(s_tmd, tmd_size64, 1, fp)) {
+		fprintf(stderr, "Couldn't read the TMD\n");
+		ret = -EIO;
+		goto exit;
+	}
+
+	const tmd* p_tmd = SIGNATURE_PAYLOAD(s_tmd);
+	if (p_tmd->title_id != title_id || bk_header.tmd_size < sizeof(sig_rsa2048) + sizeof(tmd) + (p_tmd->num_contents * sizeof(tmd_content))) {
+		fprintf(stderr, "TMD doesn't go with this title (%016llx, %u contents)\n", p_tmd->title_id, p_tmd->num_contents);
+		ret = -EINVAL;
+		goto exit;
+	}
+
+	printf("Title %016llx v%hu, %u contents\n", title_id, p_tmd->title_version, p_tmd->num_contents);
+
+	// "Move to SD" leaves the ticket behind, there isn't one in here
+	sprintf(tik_path, "/ticket/%08x/%08x.tik", (uint32_t)(title_id >> 32), (uint32_t)title_id);
+	if (!(certs = read_nand_file(WAD_CERT_PATH, &cert_size)) || !(s_tik = read_nand_file(tik_path, &tik_size))) {
+		fprintf(stderr, "No ticket for this title on the NAND, install it from a WAD instead\n");
+		ret = -ENOENT;
+		goto exit;
+	}
+
+	if (tik_size < WAD_TIK_SIZE || (ret = decrypt_title_key(s_tik, title_key)) < 0) {
+		ret = -EINVAL;
+		goto exit;
+	}
+
+	if ((ret = check_title(title_id)) < 0 || (ret = check_free_space(p_tmd)) < 0)
+		goto exit;
+
+	ret = ES_AddTitleStart(s_tmd, bk_header.tmd_size, certs, cert_size, NULL, 0);
+	if (ret < 0) {
+		print_error("ES_AddTitleStart", ret);
+		goto exit;
+	}
+
+	// Only what export_content() put in: everything that isn't shared
+	for (int i = 0; i < p_tmd->num_contents; i++) {
+		const tmd_content* con = &p_tmd->contents[i];
+
+		if (!(bk_header.included_contents[con->index >> 3] & (1 << (con->index & 7))))
+			continue;
+
+		printf("Importing content %i (%08x, %#llx)\n", con->index, con->cid, con->size);
+		if ((ret = import_content_data(fp, title_id, con, title_key)) < 0)
+			break;
+	}
+
+	if (ret >= 0 && (ret = ES_AddTitleFinish()) < 0)
+		print_error("ES_AddTitleFinish", ret);
+
+	if (ret < 0)
+		ES_AddTitleCancel();
+
+exit:
+	free(certs);
+	free(s_tik);
+	free(s_tmd);
+	return (ret < 0) ? ret : 0;
+}
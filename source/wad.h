@@ -0,0 +1,39 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+
+// Installable WADs ("Is"): header, certificate chain, ticket, TMD, then every content encrypted with the title key.
+// Each section starts on a 0x40 boundary.
+
+#define WAD_HEADER_SIZE 0x20
+#define WAD_TYPE_IS     0x4973 // 'Is'
+#define WAD_TYPE_IB     0x6962 // 'ib', boot2
+#define WAD_TIK_SIZE    0x2A4  // One signed ticket
+
+#define WAD_DIR "/title_manager/wad" // Where dumps go and installs come from
+
+typedef struct wad_header {
+	uint32_t header_size;
+	uint16_t type;
+	uint16_t version;
+	uint32_t cert_size;
+	uint32_t crl_size;
+	uint32_t tik_size;
+	uint32_t tmd_size;
+	uint32_t data_size;
+	uint32_t footer_size;
+} wad_header;
+_Static_assert(sizeof(wad_header) == WAD_HEADER_SIZE, "wad_header");
+
+// Ticket from /ticket, TMD from ES, contents read through ES and encrypted again on the way out. One pass, front to back
+int export_wad(uint64_t title_id, FILE* fp);
+
+// Ticket, TMD, then every content streamed from fp into ES. Checks there's room on the NAND first, and cancels on anything going wrong.
+// Nothing title_no_touchy() turns down gets this far, system titles included
+int install_wad(FILE* fp);
+
+// Data Management's "move to SD" format, see export_content(). Installs the same way a WAD does, using the ticket that stayed
+// on the NAND. Only ever works on the console that made it: the contents are encrypted with its PRNG key
+#define CONTENT_BIN_DIR "/private/wii/title"
+
+int import_content(FILE* fp);
@@ -0,0 +1,1277 @@
+#define _XOPEN_SOURCE 700 // nftw
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <ftw.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "common.h"
+#include "save.h"
+#include "crypto.h"
+#include "hash.h"
+#include "byteorder.h"
+#include "nand.h"
+#include "readahead.h"
+#include "savediff.h"
+#include "journal.h"
+#include "pipeline.h"
+#include "filetable.h"
+#include "restore.h"
+#include "tar.h"
+
+static void usage(const char* argv0) {
+	fprintf(stderr,
+		"Usage: %s verify [-j threads] [-q] <sd key> <data.bin or directory>...\n"
+		"       %s diff <sd key> <old data.bin> <new data.bin>\n"
+		"       %s nandbench <file> [usec per call] [usec per KiB read] [usec per KiB written]\n"
+		"       %s journaltest <scratch dir> [KiB per attempt]\n"
+		"       %s pipetest [rounds]\n"
+		"       %s filetable <nand root> <data dir> [rounds]\n"
+		"       %s restoretest <scratch dir> [usec per call] [usec per KiB]\n"
+		"\n"
+		"  verify: Directories are searched for files called data.bin.\n"
+		"          Every file gets a line with its Bk SHA-1, -q only prints the ones that failed.\n"
+		"  diff: Lists files that were added (+), removed (-) or changed (~) between two backups of a save,\n"
+		"        with the ranges of 4KiB blocks that changed. Exits with 1 if there are any, like diff(1).\n"
+		"  nandbench: Reads a file through the NAND stand-in with console-like latency (default 1000us + 400us/KiB),\n"
+		"             one blocking read at a time and then with read-ahead. Every chunk gets encrypted and \"written\"\n"
+		"             (default 250us/KiB) like a save dump does.\n"
+		"  journaltest: Exports a made up title the way export_content() does, with the file size limit set so\n"
+		"               writes start failing after another [KiB per attempt] (default 3000) every attempt, until\n"
+		"               one makes it. Checks the result against an export that never failed.\n"
+		"  pipetest: Runs pipeline.c with a consumer that takes its time at random, checking every buffer\n"
+		"            arrives whole and in order, and that a consumer error stops everything after it.\n"
+		"  filetable: Runs build_file_table() on a data directory under the NAND stand-in (e.g. /title/00010000/xxxxxxxx/data)\n"
+		"             and counts the calls that would have been IPC round trips on a console, per file and per directory.\n"
+		"  restoretest: Makes up a save, then restores it with restore.c onto a NAND stand-in under <scratch dir>/nand\n"
+		"               and checks every file came back. Broken ones have to fail and leave the old save alone.\n"
+		"               Goes through data.bin, an extracted directory and a .tar in turn.\n"
+		"               Latency (default none) is like nandbench, every restore prints its IPC calls and time.\n",
+		argv0, argv0, argv0, argv0, argv0, argv0, argv0);
+}
+
+static double now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef struct file_list {
+	char** paths;
+	size_t count, capacity;
+} file_list;
+
+static int add_file(file_list* list, const char* path) {
+	if (list->count == list->capacity) {
+		size_t capacity = list->capacity ? list->capacity * 2 : 256;
+		char** temp = realloc(list->paths, capacity * sizeof(char *));
+		if (!temp)
+			return -ENOMEM;
+
+		list->paths = temp;
+		list->capacity = capacity;
+	}
+
+	if (!(list->paths[list->count] = strdup(path)))
+		return -ENOMEM;
+
+	list->count++;
+	return 0;
+}
+
+static void free_file_list(file_list* list) {
+	for (size_t i = 0; i < list->count; i++)
+		free(list->paths[i]);
+
+	free(list->paths);
+}
+
+// nftw() has no user pointer
+static file_list* walk_list;
+
+static int walk_file(const char* path, const struct stat* st, int type, struct FTW* ftw) {
+	if (type == FTW_F && strcmp(path + ftw->base, "data.bin") == 0)
+		return add_file(walk_list, path) < 0;
+
+	return 0;
+}
+
+static int collect_files(file_list* list, const char* path) {
+	struct stat st;
+
+	if (stat(path, &st) < 0) {
+		perror(path);
+		return -errno;
+	}
+
+	if (!S_ISDIR(st.st_mode))
+		return add_file(list, path);
+
+	walk_list = list;
+	if (nftw(path, walk_file, 64, FTW_PHYS) != 0) {
+		perror(path);
+		return errno ? -errno : -ENOMEM;
+	}
+
+	return 0;
+}
+
+#define FAIL(...) do { fprintf(stderr, "%s: ", path); fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); return -EINVAL; } while (0)
+
+// Everything export_save() writes that can be checked without the console: header MD5, the file table adding up, and the Bk SHA-1.
+// File data is only hashed, never decrypted; it has nothing else to check it against.
+static int verify_save(const char* path, const uint8_t* data, size_t size, const uint8_t key[16], struct data_bin* save, uint8_t hash[20]) {
+	uint8_t  iv[16];
+	uint32_t md5_sum[4];
+
+	if (size < sizeof(struct data_bin) + sizeof(struct bk_header) + FULL_CERT_SZ)
+		FAIL("Too small to be a data.bin (%#zx)", size);
+
+	memcpy(iv, sd_initial_iv, sizeof(iv));
+	if (aes_cbc_decrypt(key, iv, data, sizeof(struct data_bin), save) != 0)
+		FAIL("Decryption failed");
+
+	memcpy(md5_sum, save->header.md5_sum, sizeof(md5_sum));
+	memcpy(save->header.md5_sum, md5_blanker, sizeof(md5_sum));
+	mbedtls_md5_ret((const unsigned char *)save, sizeof(struct data_bin), (unsigned char *)save->header.md5_sum);
+	if (memcmp(md5_sum, save->header.md5_sum, sizeof(md5_sum)))
+		FAIL("Header MD5 doesn't match (wrong SD key?)");
+
+	uint64_t title_id  = be64(save->header.title_id);
+	uint32_t banner_sz = be32(save->header.banner_sz);
+	if (banner_sz < FULL_BNR_MIN || banner_sz > FULL_BNR_MAX)
+		FAIL("Banner size is out of range (%#x)", banner_sz);
+
+	if (be32(save->banner.header.magic) != WIBN_MAGIC)
+		FAIL("Banner has a bad magic (%08x)", be32(save->banner.header.magic));
+
+	size_t offset = sizeof(struct data_bin);
+	const struct bk_header* bk_header = (const struct bk_header *)(data + offset);
+	if (be32(bk_header->magic) != BK_HDR_MAGIC || be32(bk_header->header_size) != BK_LISTED_SZ)
+		FAIL("Bk header is invalid (%08x, %#x)", be32(bk_header->magic), be32(bk_header->header_size));
+
+	if (be64(bk_header->title_id) != title_id)
+		FAIL("Bk header is for %016llx, the banner is for %016llx", (unsigned long long)be64(bk_header->title_id), (unsigned long long)title_id);
+
+	offset += sizeof(struct bk_header);
+
+	// export_save() counts banner.bin in the table (and total_files_size), but doesn't write its data
+	uint32_t num_files = be32(bk_header->num_files);
+	uint64_t listed_size = 0;
+	for (uint32_t i = 0; i < num_files; i++) {
+		if (size - offset < sizeof(struct file_header) + FULL_CERT_SZ)
+			FAIL("File header #%u is past the end", i);
+
+		const struct file_header* file = (const struct file_header *)(data + offset);
+		if (be32(file->magic) != FILE_HDR_MAGIC)
+			FAIL("File header #%u has a bad magic (%08x)", i, be32(file->magic));
+
+		if (!memchr(file->name, 0, sizeof(file->name)))
+			FAIL("File header #%u has an unterminated name", i);
+
+		if (file->type != 1 && file->type != 2)
+			FAIL("%s has an unknown type (%u)", file->name, file->type);
+
+		size_t data_size = align_up((size_t)be32(file->size), 0x40);
+		listed_size += sizeof(struct file_header) + data_size;
+		offset      += sizeof(struct file_header);
+
+		if (file->type == 2 || strcmp(file->name, "banner.bin") == 0)
+			continue;
+
+		if (size - offset < data_size + FULL_CERT_SZ)
+			FAIL("%s (%#x bytes) runs past the end", file->name, be32(file->size));
+
+		offset += data_size;
+	}
+
+	if (listed_size != be32(bk_header->total_files_size))
+		FAIL("File sizes add up to %#llx, Bk header says %#x", (unsigned long long)listed_size, be32(bk_header->total_files_size));
+
+	if (be32(bk_header->total_size) != be32(bk_header->total_files_size) + FULL_CERT_SZ)
+		FAIL("Bk header total size is off (%#x)", be32(bk_header->total_size));
+
+	if (size - offset != FULL_CERT_SZ)
+		FAIL("%#zx bytes after the file table, expected %#x", size - offset, FULL_CERT_SZ);
+
+	// What the AP signature is over. sect233r1 isn't something mbedtls does, so the hash is as far as this goes
+	sha1_ctx sha;
+	sha1_init(&sha);
+	sha1_update(&sha, data + sizeof(struct data_bin), offset - sizeof(struct data_bin));
+	sha1_finish(&sha, hash);
+
+	return 0;
+}
+
+#undef FAIL
+
+typedef struct verify_job {
+	const file_list* files;
+	const uint8_t*   key;
+	bool             quiet;
+
+	atomic_size_t next;
+	atomic_size_t failed;
+	atomic_ullong bytes;
+} verify_job;
+
+static int verify_path(verify_job* job, const char* path, struct data_bin* save) {
+	uint8_t hash[20];
+	int ret;
+
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		ret = -errno;
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return ret;
+	}
+
+	if (st.st_size == 0) {
+		close(fd);
+		fprintf(stderr, "%s: Empty file\n", path);
+		return -EINVAL;
+	}
+
+	void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		ret = -errno;
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return ret;
+	}
+
+	// One front to back pass, let the kernel read ahead for it
+	posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+	ret = verify_save(path, map, st.st_size, job->key, save, hash);
+	munmap(map, st.st_size);
+
+	atomic_fetch_add(&job->bytes, st.st_size);
+	if (ret < 0) {
+		printf("FAIL %s\n", path);
+		return ret;
+	}
+
+	if (!job->quiet) {
+		char hex[41];
+		for (int i = 0; i < sizeof(hash); i++)
+			sprintf(hex + i * 2, "%02x", hash[i]);
+
+		printf("OK   %s  %s\n", hex, path);
+	}
+
+	return 0;
+}
+
+static void* verify_worker(void* arg) {
+	verify_job* job = arg;
+	struct data_bin* save = aligned_alloc(0x40, align_up(sizeof(struct data_bin), 0x40));
+
+	if (!save) {
+		perror("verify_worker");
+		return NULL;
+	}
+
+	size_t i;
+	while ((i = atomic_fetch_add(&job->next, 1)) < job->files->count) {
+		if (verify_path(job, job->files->paths[i], save) < 0)
+			atomic_fetch_add(&job->failed, 1);
+	}
+
+	free(save);
+	return NULL;
+}
+
+static int verify(const char* argv0, int argc, char* argv[]) {
+	int  threads = sysconf(_SC_NPROCESSORS_ONLN);
+	bool quiet = false;
+	int  opt, ret;
+
+	while ((opt = getopt(argc, argv, "j:q")) != -1) {
+		switch (opt) {
+			case 'j': threads = atoi(optarg); break;
+			case 'q': quiet = true; break;
+			default:  usage(argv0); return -EINVAL;
+		}
+	}
+
+	if (argc - optind < 2) {
+		usage(argv0);
+		return -EINVAL;
+	}
+
+	if (threads < 1)
+		threads = 1;
+
+	uint8_t key[16];
+	FILE* fp = fopen(argv[optind], "rb");
+	if (!fp) {
+		perror(argv[optind]);
+		return -errno;
+	}
+
+	size_t read = fread(key, 1, sizeof(key), fp);
+	fclose(fp);
+	if (read != sizeof(key)) {
+		fprintf(stderr, "%s: SD key should be 16 bytes\n", argv[optind]);
+		return -EINVAL;
+	}
+
+	file_list files = {};
+	for (int i = optind + 1; i < argc; i++) {
+		if ((ret = collect_files(&files, argv[i])) < 0) {
+			free_file_list(&files);
+			return ret;
+		}
+	}
+
+	verify_job job = { .files = &files, .key = key, .quiet = quiet };
+	pthread_t* workers = calloc(threads, sizeof(pthread_t));
+	if (!workers) {
+		free_file_list(&files);
+		return -ENOMEM;
+	}
+
+	double start = now();
+	int started = 0;
+	for (; started < threads && started < files.count; started++) {
+		if ((ret = pthread_create(&workers[started], NULL, verify_worker, &job)) != 0) {
+			fprintf(stderr, "pthread_create: %s\n", strerror(ret));
+			break;
+		}
+	}
+
+	// Couldn't start any, so do it all right here
+	if (started == 0)
+		verify_worker(&job);
+
+	for (int i = 0; i < started; i++)
+		pthread_join(workers[i], NULL);
+
+	double elapsed = now() - start;
+	free(workers);
+
+	size_t failed = atomic_load(&job.failed);
+	unsigned long long bytes = atomic_load(&job.bytes);
+	fprintf(stderr, "%zu files, %zu failed, %#llx bytes in %.3fs on %i threads\n", files.count, failed, bytes, elapsed, started ? started : 1);
+	fprintf(stderr, "  %8.2f MB/s, %8.1f files/s\n", elapsed ? bytes / elapsed / 1e6 : 0.0, elapsed ? files.count / elapsed : 0.0);
+
+	free_file_list(&files);
+	return failed ? -EINVAL : 0;
+}
+
+static int diff(const char* key_path, const char* old_path, const char* new_path) {
+	int                    ret;
+	struct save_diff_stats stats;
+	FILE                  *old_fp = NULL, *new_fp = NULL;
+
+	if ((ret = crypto_load_sd_key(key_path)) < 0) {
+		if (ret != -EINVAL)
+			fprintf(stderr, "%s: %s\n", key_path, strerror(-ret));
+
+		return ret;
+	}
+
+	if (!(old_fp = fopen(old_path, "rb")) || !(new_fp = fopen(new_path, "rb"))) {
+		ret = -errno;
+		perror(old_fp ? new_path : old_path);
+		goto exit;
+	}
+
+	double start = now();
+	ret = save_diff(old_fp, new_fp, &stats);
+	double elapsed = now() - start;
+	if (ret < 0)
+		goto exit;
+
+	fprintf(stderr, "%u added, %u removed, %u changed (%u blocks), %u unchanged. Compared %.2fMB in %.3fs (%.2f MB/s)\n",
+	        stats.added, stats.removed, stats.changed, stats.changed_blocks, stats.unchanged,
+	        stats.bytes_compared / 1e6, elapsed, elapsed > 0 ? stats.bytes_compared / elapsed / 1e6 : 0);
+
+exit:
+	if (old_fp)
+		fclose(old_fp);
+
+	if (new_fp)
+		fclose(new_fp);
+
+	return ret;
+}
+
+static unsigned int usec_per_kib_written;
+
+// What one chunk costs on the other side of the read, same as write_file_table(): encrypt it, then wait on the SD card
+static void encrypt_chunk(void* data, unsigned int len) {
+	static const uint8_t key[16];
+	uint8_t iv[16] = {};
+
+	aes_cbc_encrypt(key, iv, data, align_up(len, 0x40), data);
+
+	unsigned long long usec = (unsigned long long)usec_per_kib_written * len / 1024;
+	if (usec)
+		nanosleep(&(struct timespec){ usec / 1000000, usec % 1000000 * 1000 }, NULL);
+}
+
+static int bench_read(const char* name, uint32_t size, unsigned int buffer_size, unsigned int num_buffers) {
+	int ret;
+
+	int fd = ret = nand_open(name, NAND_OPEN_READ);
+	if (ret < 0) {
+		fprintf(stderr, "%s: %s\n", name, strerror(-ret));
+		return ret;
+	}
+
+	unsigned int ipc_start = nand_ipc_count;
+	double start = now();
+	if (!num_buffers) {
+		unsigned char* buf = aligned_alloc(0x40, buffer_size);
+		if (!buf) {
+			nand_close(fd);
+			return -ENOMEM;
+		}
+
+		for (uint32_t processed = 0; processed < size; processed += ret) {
+			unsigned int read = (size - processed > buffer_size) ? buffer_size : size - processed;
+			if ((ret = nand_read(fd, buf, read)) <= 0)
+				break;
+
+			encrypt_chunk(buf, ret);
+		}
+
+		free(buf);
+	} else {
+		readahead ra;
+		void* chunk;
+
+		if ((ret = readahead_start(&ra, fd, size, num_buffers, buffer_size)) == 0) {
+			while ((ret = readahead_next(&ra, &chunk)) > 0)
+				encrypt_chunk(chunk, ret);
+
+			readahead_finish(&ra);
+		}
+	}
+	double elapsed = now() - start;
+	nand_close(fd);
+
+	if (ret < 0) {
+		fprintf(stderr, "%s: Read failed (ret=%i)\n", name, ret);
+		return ret;
+	}
+
+	char label[32];
+	if (num_buffers)
+		sprintf(label, "read-ahead x%u", num_buffers);
+	else
+		strcpy(label, "blocking");
+
+	printf("  %-14s %8.2f MB/s  %7.3fs  %u calls\n", label, size / elapsed / 1e6, elapsed, nand_ipc_count - ipc_start);
+	return 0;
+}
+
+static int nandbench(const char* path, unsigned int usec_per_call, unsigned int usec_per_kib) {
+	struct stat st;
+	char dir[4096];
+	const unsigned int buffer_size = 0x10000;
+	int ret;
+
+	if (stat(path, &st) < 0) {
+		perror(path);
+		return -errno;
+	}
+
+	// The stand-in wants NAND style paths, so the file's directory becomes the root
+	const char* name = strrchr(path, '/');
+	if (name) {
+		snprintf(dir, sizeof(dir), "%.*s", (int)(name - path), path);
+		nand_set_root(dir);
+	} else {
+		name = path - 1;
+	}
+
+	char nand_path[NAND_MAXPATH];
+	if (snprintf(nand_path, sizeof(nand_path), "/%s", name + 1) >= sizeof(nand_path)) {
+		fprintf(stderr, "%s: Name is too long\n", path);
+		return -ENAMETOOLONG;
+	}
+
+	nand_set_latency(usec_per_call, usec_per_kib);
+	printf("%s: %#llx bytes, %#x byte chunks, reads %uus per call + %uus per KiB, writes %uus per KiB\n",
+		path, (unsigned long long)st.st_size, buffer_size, usec_per_call, usec_per_kib, usec_per_kib_written);
+
+	for (unsigned int num_buffers = 0; num_buffers <= READAHEAD_MAX_BUFFERS; num_buffers++) {
+		if (num_buffers == 1)
+			continue;
+
+		if ((ret = bench_read(nand_path, st.st_size, buffer_size, num_buffers)) < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+// Stand-in for ES_ExportContentData: the same bytes for a content every time, and only front to back
+struct journal_content {
+	uint32_t index, size;
+	uint32_t pos;
+	uint64_t total_read; // Across every attempt
+};
+
+static const uint32_t journal_content_sizes[] = { 0x512345, 0x40, 0x11, 0x900001 };
+#define JOURNAL_NUM_CONTENTS (sizeof(journal_content_sizes) / sizeof(*journal_content_sizes))
+#define JOURNAL_HEADER_SIZE  0x1740 // Everything export_content() writes before the journal takes over
+
+static uint8_t journal_content_byte(uint32_t index, uint32_t pos) {
+	return (uint8_t)((pos * 31) ^ (pos >> 9) ^ (index * 0x55));
+}
+
+static int journal_content_read(void* user, void* buf, unsigned int len) {
+	struct journal_content* con = user;
+	uint8_t* ptr = buf;
+
+	for (unsigned int i = 0; i < len; i++, con->pos++)
+		ptr[i] = (con->pos < con->size) ? journal_content_byte(con->index, con->pos) : 0;
+
+	con->total_read += len;
+	return len;
+}
+
+// One go at it, like dump_title_content() then export_content(). Fails wherever the file size limit says
+static int journal_attempt(const char* out_path, const char* journal_path, struct journal_content* con, const uint8_t tmd_sha1[20]) {
+	static unsigned char buffer[0x10000] __attribute__((aligned(0x40)));
+	journal jr;
+	bool    done = false;
+	int     ret;
+
+	FILE* fp = fopen(out_path, "r+b");
+	if (!fp)
+		fp = fopen(out_path, "wb");
+
+	if (!fp)
+		return -errno;
+
+	for (unsigned int i = 0; i < JOURNAL_HEADER_SIZE; i++)
+		buffer[i] = journal_content_byte(~0u, i);
+
+	if (!fwrite(buffer, JOURNAL_HEADER_SIZE, 1, fp)) {
+		ret = -errno;
+		goto exit;
+	}
+
+	if ((ret = journal_open(&jr, journal_path, fp, 0x00010001DEADBEEF, tmd_sha1)) < 0)
+		goto exit;
+
+	if (ret == 0) {
+		sha1_update(&jr.state.sha, buffer, JOURNAL_HEADER_SIZE);
+		jr.state.file_offset = ftell(fp);
+		printf("  from the top\n");
+	} else {
+		printf("  picking up from content %u, offset %#x (file offset %#llx)\n", jr.state.content, jr.state.content_offset, (unsigned long long)jr.state.file_offset);
+	}
+
+	for (uint32_t i = jr.state.content; i < JOURNAL_NUM_CONTENTS; i++) {
+		con->index = i;
+		con->size  = journal_content_sizes[i];
+		con->pos   = 0;
+		if ((ret = journal_copy(&jr, i, con->size, journal_content_read, con, buffer, sizeof(buffer))) < 0)
+			break;
+	}
+
+	// The signature's stand-in
+	if (ret >= 0) {
+		uint8_t hash[20];
+
+		sha1_finish(&jr.state.sha, hash);
+		if (!fwrite(hash, sizeof(hash), 1, fp) || fflush(fp) != 0)
+			ret = -errno;
+	}
+
+	done = (ret >= 0);
+	journal_close(&jr, journal_path, done);
+
+exit:
+	if (fclose(fp) != 0 && ret >= 0)
+		ret = -errno;
+
+	return ret;
+}
+
+static int journaltest(const char* dir, unsigned int kib_per_attempt) {
+	char            out_path[4096], journal_path[4096];
+	uint8_t         tmd_sha1[20] = { 0x12, 0x34 };
+	struct rlimit   limit;
+	struct journal_content con = {};
+	int             ret = -1, attempts = 0;
+	uint64_t        expected_size = JOURNAL_HEADER_SIZE + 20;
+
+	snprintf(out_path, sizeof(out_path), "%s/content.bin", dir);
+	snprintf(journal_path, sizeof(journal_path), "%s/content.jnl", dir);
+	remove(out_path);
+	remove(journal_path);
+
+	for (int i = 0; i < JOURNAL_NUM_CONTENTS; i++)
+		expected_size += align_up(journal_content_sizes[i], 0x40);
+
+	// Past the limit, write() fails with EFBIG instead of the process getting killed. Close enough to a full card
+	signal(SIGXFSZ, SIG_IGN);
+	getrlimit(RLIMIT_FSIZE, &limit);
+
+	while (ret < 0 && attempts < 100) {
+		struct rlimit fail_at = { (rlim_t)++attempts * kib_per_attempt * 1024, limit.rlim_max };
+
+		printf("Attempt %i, writes fail past %#llx:\n", attempts, (unsigned long long)fail_at.rlim_cur);
+		setrlimit(RLIMIT_FSIZE, &fail_at);
+		ret = journal_attempt(out_path, journal_path, &con, tmd_sha1);
+		setrlimit(RLIMIT_FSIZE, &limit);
+		if (ret < 0)
+			printf("  failed (%s)\n", strerror(-ret));
+
+		// Once, a journal that got mangled. That has to start over, not pick up garbage
+		if (attempts == 2 && ret < 0) {
+			FILE* fp = fopen(journal_path, "r+b");
+			if (fp) {
+				fseek(fp, offsetof(struct export_journal, file_offset), SEEK_SET);
+				fputc(0x5A, fp);
+				fclose(fp);
+				puts("  (journal corrupted)");
+			}
+		}
+	}
+
+	if (ret < 0) {
+		fprintf(stderr, "Never finished\n");
+		return ret;
+	}
+
+	// What it should have come out as, in one go
+	FILE*    fp = fopen(out_path, "rb");
+	sha1_ctx sha;
+	uint8_t  hash[20], got[20];
+	unsigned char buf[0x1000];
+	uint64_t mismatch = ~0ull, pos = 0;
+
+	if (!fp) {
+		perror(out_path);
+		return -errno;
+	}
+
+	sha1_init(&sha);
+	for (unsigned int i = 0; i < JOURNAL_HEADER_SIZE; i++, pos++) {
+		buf[0] = journal_content_byte(~0u, i);
+		sha1_update(&sha, buf, 1);
+		if (fgetc(fp) != buf[0] && mismatch == ~0ull)
+			mismatch = pos;
+	}
+
+	for (int i = 0; i < JOURNAL_NUM_CONTENTS; i++) {
+		for (uint32_t j = 0; j < align_up(journal_content_sizes[i], 0x40); j++, pos++) {
+			buf[0] = (j < journal_content_sizes[i]) ? journal_content_byte(i, j) : 0;
+			sha1_update(&sha, buf, 1);
+			if (fgetc(fp) != buf[0] && mismatch == ~0ull)
+				mismatch = pos;
+		}
+	}
+
+	sha1_finish(&sha, hash);
+	bool hash_ok = fread(got, sizeof(got), 1, fp) && !memcmp(hash, got, sizeof(hash));
+	bool size_ok = (fseek(fp, 0, SEEK_END) == 0 && ftell(fp) == expected_size);
+	fclose(fp);
+
+	printf("%i attempts, %#llx bytes read from the contents for %#llx bytes of them\n", attempts,
+	       (unsigned long long)con.total_read, (unsigned long long)(expected_size - JOURNAL_HEADER_SIZE - 20));
+
+	if (mismatch != ~0ull || !hash_ok || !size_ok || !access(journal_path, F_OK)) {
+		fprintf(stderr, "FAILED: %s%s%s%s\n", (mismatch != ~0ull) ? "contents differ, " : "", hash_ok ? "" : "hash is wrong, ",
+		        size_ok ? "" : "size is wrong, ", access(journal_path, F_OK) ? "" : "journal was left behind");
+		if (mismatch != ~0ull)
+			fprintf(stderr, "First difference at %#llx\n", (unsigned long long)mismatch);
+
+		return -EIO;
+	}
+
+	puts("OK: same as an export that never failed");
+	return 0;
+}
+
+struct pipe_check {
+	unsigned int next;       // Sequence number the next buffer should have
+	unsigned int fail_at;    // Consumer returns an error on this one, ~0: never
+	unsigned int calls;
+	unsigned int seed;
+	bool         bad;
+};
+
+// Every buffer is its sequence number, then its length, then bytes worked out from both
+static void pipe_fill(unsigned char* buf, unsigned int seq, unsigned int len) {
+	memcpy(buf, &seq, 4);
+	memcpy(buf + 4, &len, 4);
+	for (unsigned int i = 8; i < len; i++)
+		buf[i] = (unsigned char)(seq * 7 + i);
+}
+
+static int pipe_consume(void* user, const void* data, unsigned int len) {
+	struct pipe_check* check = user;
+	const unsigned char* buf = data;
+	unsigned int seq, len_in;
+
+	memcpy(&seq, buf, 4);
+	memcpy(&len_in, buf + 4, 4);
+	check->calls++;
+
+	if (seq != check->next || len_in != len) {
+		fprintf(stderr, "  got buffer %u (%#x bytes), expected %u (%#x)\n", seq, len, check->next, len_in);
+		check->bad = true;
+	}
+
+	for (unsigned int i = 8; i < len && !check->bad; i++) {
+		if (buf[i] != (unsigned char)(seq * 7 + i)) {
+			fprintf(stderr, "  buffer %u is wrong at %#x\n", seq, i);
+			check->bad = true;
+		}
+	}
+
+	// Sometimes slower than the producer, sometimes faster
+	if (rand_r(&check->seed) % 4 == 0)
+		nanosleep(&(struct timespec){ 0, (rand_r(&check->seed) % 200) * 1000 }, NULL);
+
+	check->next = seq + 1;
+	return (seq == check->fail_at) ? -EIO : 0;
+}
+
+static int pipetest(int rounds) {
+	const unsigned int buffer_size = 0x1000;
+	unsigned int seed = 1;
+	int failures = 0;
+
+	for (int round = 0; round < rounds; round++) {
+		unsigned int num_buffers = 2 + round % (PIPELINE_MAX_BUFFERS - 1);
+		unsigned int count = 1 + rand_r(&seed) % 200;
+		struct pipe_check check = { 0, (round % 2) ? rand_r(&seed) % count : ~0u, 0, round, false };
+		unsigned int submitted = 0, stopped_at = ~0u;
+		pipeline pipe;
+
+		int ret = pipeline_start(&pipe, num_buffers, buffer_size, pipe_consume, &check);
+		if (ret < 0) {
+			fprintf(stderr, "pipeline_start failed (ret=%i)\n", ret);
+			return ret;
+		}
+
+		for (unsigned int i = 0; i < count; i++) {
+			unsigned char* buf = pipeline_acquire(&pipe);
+			if (!buf) {
+				stopped_at = i;
+				break;
+			}
+
+			unsigned int len = 8 + rand_r(&seed) % (buffer_size - 7);
+			pipe_fill(buf, i, len);
+			submitted++;
+			if (pipeline_submit(&pipe, len) < 0) {
+				stopped_at = i + 1;
+				break;
+			}
+		}
+
+		ret = pipeline_finish(&pipe);
+
+		// A failure has to come back out of finish, with nothing handed to the consumer after it, and the producer
+		// can't have gotten more than a queue's worth past it (unless it ran out of things to submit first)
+		bool ok = !check.bad;
+		if (check.fail_at == ~0u)
+			ok = ok && ret == 0 && check.calls == count && submitted == count;
+		else
+			ok = ok && ret == -EIO && check.calls == check.fail_at + 1 && ((stopped_at != ~0u) ? stopped_at : count) <= check.fail_at + num_buffers;
+
+		if (!ok) {
+			fprintf(stderr, "Round %i (%u buffers, %u submits, fail at %d): ret=%i, consumer called %u times, producer stopped at %d\n",
+			        round, num_buffers, count, (int)check.fail_at, ret, check.calls, (int)stopped_at);
+			failures++;
+		}
+	}
+
+	if (failures) {
+		fprintf(stderr, "FAILED: %i of %i rounds\n", failures, rounds);
+		return -EIO;
+	}
+
+	printf("OK: %i rounds, every buffer in order, errors stop the pipeline\n", rounds);
+	return 0;
+}
+
+static int filetable(const char* root, const char* data_path, int rounds) {
+	struct file_table table;
+	unsigned int files = 0, dirs = 0, ipc_calls = 0;
+	int ret;
+
+	nand_set_root(root);
+	double start = now();
+	for (int i = 0; i < rounds; i++) {
+		unsigned int ipc_start = nand_ipc_count;
+
+		if ((ret = build_file_table(data_path, &table)) < 0) {
+			fprintf(stderr, "%s%s: build_file_table failed (ret=%i)\n", root, data_path, ret);
+			return ret;
+		}
+
+		ipc_calls = nand_ipc_count - ipc_start;
+		if (i + 1 < rounds)
+			free_file_table(&table);
+	}
+	double elapsed = now() - start;
+
+	for (unsigned int i = 0; i < table.num_entries; i++) {
+		if (table.entries[i].type == 2)
+			dirs++;
+		else
+			files++;
+	}
+
+	// GetAttr + Open + GetFileStats + Close for a file, GetAttr + Open + ReadDir for a directory, one more ReadDir for the top.
+	// Directories with more than 128 names take two more ReadDirs
+	printf("%s: %u files, %u directories, %u IPC calls (%u without big directories), %.1fus per walk\n",
+		data_path, files, dirs, ipc_calls, files * 4 + dirs * 3 + 1, elapsed * 1e6 / rounds);
+
+	free_file_table(&table);
+	return 0;
+}
+
+// What restoretest's made up save has in it. File data comes from restore_byte()
+struct restore_file {
+	const char* path;
+	uint32_t    size;
+	uint8_t     type; // 1: File, 2: Directory
+};
+
+static const struct restore_file restore_files[] = {
+	{ "banner.bin", FULL_BNR_MIN, 1 },
+	{ "empty",      0,            1 },
+	{ "one",        1,            1 },
+	{ "chunk",      0x10000,      1 },
+	{ "chunk+1",    0x10001,      1 },
+	{ "sub",        0,            2 },
+	{ "sub/big",    200000,       1 },
+	{ "sub/deep",   0,            2 },
+	{ "sub/deep/x", 0x40,         1 },
+};
+#define RESTORE_NUM_FILES (sizeof(restore_files) / sizeof(*restore_files))
+#define RESTORE_TITLE_ID  0x0001000052535445ULL // RSTE
+#define RESTORE_MAX_SIZE  0x31000 // Biggest file, rounded up
+
+static const uint8_t restore_sd_key[16] = { 0xAB, 0x01, 0xB9, 0xD8, 0xE1, 0x62, 0x2B, 0x08, 0xAF, 0xBA, 0xD8, 0x4D, 0xBF, 0xC2, 0xA5, 0x5D };
+
+static uint8_t restore_byte(unsigned int index, uint32_t pos) {
+	return (uint8_t)((pos * 13) ^ (pos >> 8) ^ (index * 0x3B));
+}
+
+static void restore_fill(unsigned int index, void* buf, uint32_t size) {
+	uint8_t* ptr = buf;
+
+	for (uint32_t i = 0; i < size; i++)
+		ptr[i] = restore_byte(index, i);
+}
+
+// Laid out like export_save() does it. bad_name puts a file outside the data directory
+static int restore_write_data_bin(FILE* fp, bool bad_name) {
+	static struct data_bin save __attribute__((aligned(0x40)));
+	static unsigned char buf[RESTORE_MAX_SIZE] __attribute__((aligned(0x40)));
+	struct bk_header bk_header = {};
+	uint32_t iv[4];
+	uint32_t total_files_size = 0;
+
+	memset(&save, 0, sizeof(save));
+	save.header.title_id    = be64(RESTORE_TITLE_ID);
+	save.header.banner_sz   = be32(FULL_BNR_MIN);
+	save.header.permissions = 0x3C;
+	restore_fill(0, &save.banner, FULL_BNR_MIN);
+
+	memcpy(save.header.md5_sum, md5_blanker, sizeof(save.header.md5_sum));
+	mbedtls_md5_ret((const unsigned char *)&save, sizeof(save), (unsigned char *)save.header.md5_sum);
+	memcpy(iv, sd_initial_iv, sizeof(iv));
+	if (sd_encrypt(iv, &save, sizeof(save), &save) < 0 || !fwrite(&save, sizeof(save), 1, fp))
+		return -EIO;
+
+	for (int i = 0; i < RESTORE_NUM_FILES; i++)
+		total_files_size += sizeof(struct file_header) + align_up(restore_files[i].size, 0x40);
+
+	bk_header.header_size      = be32(BK_LISTED_SZ);
+	bk_header.magic            = be32(BK_HDR_MAGIC);
+	bk_header.num_files        = be32(RESTORE_NUM_FILES);
+	bk_header.total_files_size = be32(total_files_size);
+	bk_header.total_size       = be32(total_files_size + FULL_CERT_SZ);
+	bk_header.title_id         = be64(RESTORE_TITLE_ID);
+	if (!fwrite(&bk_header, sizeof(bk_header), 1, fp))
+		return -EIO;
+
+	for (int i = 0; i < RESTORE_NUM_FILES; i++) {
+		const struct restore_file* rf = &restore_files[i];
+		struct file_header file = {};
+
+		file.magic       = be32(FILE_HDR_MAGIC);
+		file.size        = be32(rf->size);
+		file.permissions = 0x3C;
+		file.type        = rf->type;
+		file.iv[0]       = i * 0x01010101;
+		strcpy(file.name, (bad_name && i == RESTORE_NUM_FILES - 1) ? "sub/../../x" : rf->path);
+		if (!fwrite(&file, sizeof(file), 1, fp))
+			return -EIO;
+
+		if (rf->type != 1 || i == 0)
+			continue;
+
+		unsigned int size = align_up(rf->size, 0x40);
+		memset(buf, 0, size);
+		restore_fill(i, buf, rf->size);
+		memcpy(iv, file.iv, sizeof(iv));
+		if (sd_encrypt(iv, buf, size, buf) < 0 || (size && !fwrite(buf, size, 1, fp)))
+			return -EIO;
+	}
+
+	// Signature and certificates, nobody checks them
+	memset(buf, 0, FULL_CERT_SZ);
+	return fwrite(buf, FULL_CERT_SZ, 1, fp) ? 0 : -EIO;
+}
+
+// Whatever is in the title's data directory now, against restore_files (or just the old save)
+static bool restore_check(const char* nand_root, bool old_save) {
+	static unsigned char buf[RESTORE_MAX_SIZE] __attribute__((aligned(0x40)));
+	char data_path[NAND_MAXPATH], path[4096];
+	struct file_table table;
+	bool ok = true;
+
+	nand_get_data_dir(RESTORE_TITLE_ID, data_path);
+	if (build_file_table(data_path, &table) < 0)
+		return false;
+
+	if (old_save) {
+		ok = (table.num_entries == 1 && !strcmp(table.entries[0].relative_path, "old"));
+		if (!ok)
+			fprintf(stderr, "  the old save isn't there anymore\n");
+	}
+	else if (table.num_entries != RESTORE_NUM_FILES) {
+		fprintf(stderr, "  %u files and directories, expected %zu\n", table.num_entries, RESTORE_NUM_FILES);
+		ok = false;
+	}
+
+	for (int i = 0; i < RESTORE_NUM_FILES && !old_save; i++) {
+		const struct restore_file* rf = &restore_files[i];
+		const struct file_entry* entry = NULL;
+
+		for (unsigned int j = 0; j < table.num_entries && !entry; j++) {
+			if (!strcmp(table.entries[j].relative_path, rf->path))
+				entry = &table.entries[j];
+		}
+
+		if (!entry || entry->type != rf->type || (rf->type == 1 && entry->file_size != rf->size)) {
+			fprintf(stderr, "  %s: %s\n", rf->path, entry ? "wrong type or size" : "missing");
+			ok = false;
+			continue;
+		}
+
+		if (rf->type != 1)
+			continue;
+
+		snprintf(path, sizeof(path), "%s/%s", data_path, rf->path);
+		int fd = nand_open(path, NAND_OPEN_READ);
+		int ret = (fd < 0) ? fd : nand_read(fd, buf, rf->size);
+		if (fd >= 0)
+			nand_close(fd);
+
+		bool same = (ret == rf->size);
+		for (uint32_t pos = 0; same && pos < rf->size; pos++)
+			same = (buf[pos] == restore_byte(i, pos));
+
+		if (!same) {
+			fprintf(stderr, "  %s: contents differ\n", rf->path);
+			ok = false;
+		}
+	}
+
+	free_file_table(&table);
+
+	// Nothing left lying around in /tmp either
+	if (snprintf(path, sizeof(path), "%s/tmp/%08x", nand_root, (uint32_t)RESTORE_TITLE_ID) < sizeof(path) && !access(path, F_OK)) {
+		fprintf(stderr, "  %s was left behind\n", path);
+		ok = false;
+	}
+
+	return ok;
+}
+
+// The title's save before every restore: one file that isn't in restore_files
+static int restore_reset(void) {
+	char data_path[NAND_MAXPATH], path[NAND_MAXPATH];
+	static const char* const dirs[] = { "/tmp", "/title", "/title/00010000", "/title/00010000/52535445" };
+	static char old[0x40] __attribute__((aligned(0x40))) = "the old save";
+
+	for (int i = 0; i < sizeof(dirs) / sizeof(*dirs); i++)
+		nand_create_dir(dirs[i], 0, 0x3F);
+
+	nand_get_data_dir(RESTORE_TITLE_ID, data_path);
+	nand_delete(data_path);
+	if (snprintf(path, sizeof(path), "%s/old", data_path) >= sizeof(path))
+		return -ENAMETOOLONG;
+
+	int ret = nand_create_dir(data_path, 0, 0x3C);
+	if (ret < 0 || (ret = nand_create_file(path, 0, 0x3C)) < 0)
+		return ret;
+
+	int fd = ret = nand_open(path, NAND_OPEN_WRITE);
+	if (fd < 0)
+		return ret;
+
+	ret = nand_write(fd, old, sizeof(old));
+	nand_close(fd);
+	return (ret == sizeof(old)) ? 0 : -EIO;
+}
+
+static int restore_data_bin(const char* scratch, bool bad_name, bool wrong_key) {
+	char path[4096];
+	int  ret;
+
+	snprintf(path, sizeof(path), "%s/data.bin", scratch);
+	FILE* fp = fopen(path, "w+b");
+	if (!fp) {
+		perror(path);
+		return -errno;
+	}
+
+	if ((ret = restore_write_data_bin(fp, bad_name)) == 0) {
+		uint8_t key[16];
+
+		memcpy(key, restore_sd_key, sizeof(key));
+		key[0] ^= wrong_key;
+		crypto_set_sd_key(key);
+		rewind(fp);
+		ret = import_save(RESTORE_TITLE_ID, fp);
+		crypto_set_sd_key(restore_sd_key);
+	}
+
+	fclose(fp);
+	return ret;
+}
+
+static int remove_one(const char* path, const struct stat* st, int type, struct FTW* ftw) {
+	return remove(path);
+}
+
+// Like "Dump save data (extract)" left it on SD. bad_name makes one name too long for the NAND
+static int restore_save_dir(const char* scratch, bool bad_name) {
+	static unsigned char buf[RESTORE_MAX_SIZE];
+	char dir_path[4096], path[4096 + NAND_MAXPATH];
+	int  ret = 0;
+
+	snprintf(dir_path, sizeof(dir_path), "%s/save", scratch);
+	nftw(dir_path, remove_one, 16, FTW_DEPTH | FTW_PHYS);
+	if (mkdir(dir_path, 0755) < 0) {
+		perror(dir_path);
+		return -errno;
+	}
+
+	for (int i = 0; i < RESTORE_NUM_FILES && ret == 0; i++) {
+		const struct restore_file* rf = &restore_files[i];
+
+		snprintf(path, sizeof(path), "%s/%s", dir_path, (bad_name && i == RESTORE_NUM_FILES - 1) ? "sub/deep/thirteen_char" : rf->path);
+		if (rf->type == 2) {
+			ret = mkdir(path, 0755);
+			continue;
+		}
+
+		FILE* fp = fopen(path, "wb");
+		if (!fp) {
+			ret = -1;
+			break;
+		}
+
+		restore_fill(i, buf, rf->size);
+		if (rf->size && !fwrite(buf, rf->size, 1, fp))
+			ret = -1;
+
+		if (fclose(fp) != 0)
+			ret = -1;
+	}
+
+	if (ret < 0) {
+		perror(path);
+		return -errno;
+	}
+
+	return import_save_dir(RESTORE_TITLE_ID, dir_path);
+}
+
+// Like "Dump save data (.tar)" wrote it, but with "./" in front like "tar -C save ." would. bad_name has a ".." in it
+static int restore_save_tar(const char* scratch, bool bad_name) {
+	static unsigned char buf[RESTORE_MAX_SIZE], staging[0x10000];
+	char       path[4096], pax[128];
+	tar_writer tar;
+	int        ret;
+
+	snprintf(path, sizeof(path), "%s/save.tar", scratch);
+	FILE* fp = fopen(path, "wb");
+	if (!fp) {
+		perror(path);
+		return -errno;
+	}
+
+	int len = tar_pax_record(pax, sizeof(pax), SAVE_PAX_ATTRIBUTES, "0");
+	tar_pax_record(pax + len, sizeof(pax) - len, SAVE_PAX_PERMISSIONS, "0x3c");
+
+	tar_init(&tar, fp, staging, sizeof(staging));
+	ret = tar_add(&tar, &(tar_entry){ ".", 0, 0755, TAR_TYPE_DIRECTORY });
+	for (int i = 0; i < RESTORE_NUM_FILES && ret >= 0; i++) {
+		const struct restore_file* rf = &restore_files[i];
+		char name[NAND_MAXPATH + 2];
+
+		snprintf(name, sizeof(name), "./%s", (bad_name && i == RESTORE_NUM_FILES - 1) ? "sub/../../x" : rf->path);
+		ret = tar_add(&tar, &(tar_entry){ name, rf->size, (rf->type == 2) ? 0755 : 0644, (rf->type == 2) ? TAR_TYPE_DIRECTORY : TAR_TYPE_FILE, pax });
+		if (ret >= 0 && rf->type == 1) {
+			restore_fill(i, buf, rf->size);
+			ret = tar_write(&tar, buf, rf->size);
+		}
+	}
+
+	if (ret >= 0)
+		ret = tar_finish(&tar);
+
+	if (fclose(fp) != 0 && ret >= 0)
+		ret = -errno;
+
+	if (ret < 0) {
+		fprintf(stderr, "%s: Couldn't write it (ret=%i)\n", path, ret);
+		return ret;
+	}
+
+	return import_save_tar(RESTORE_TITLE_ID, path);
+}
+
+enum restore_from {
+	RESTORE_DATA_BIN,
+	RESTORE_DIR,
+	RESTORE_TAR,
+};
+
+static int restoretest(const char* scratch, unsigned int usec_per_call, unsigned int usec_per_kib) {
+	struct {
+		const char*       name;
+		enum restore_from from;
+		bool              should_fail;
+		bool              bad_name, wrong_key;
+	} cases[] = {
+		{ "data.bin",                   RESTORE_DATA_BIN, false },
+		{ "data.bin, name with ..",     RESTORE_DATA_BIN, true, true, false },
+		{ "data.bin, wrong SD key",     RESTORE_DATA_BIN, true, false, true },
+		{ "directory",                  RESTORE_DIR,      false },
+		{ "directory, name too long",   RESTORE_DIR,      true, true },
+		{ ".tar",                       RESTORE_TAR,      false },
+		{ ".tar, name with ..",         RESTORE_TAR,      true, true },
+	};
+	char nand_root[4096];
+	int  failed = 0;
+
+	snprintf(nand_root, sizeof(nand_root), "%s/nand", scratch);
+	if (mkdir(nand_root, 0755) < 0 && errno != EEXIST) {
+		perror(nand_root);
+		return -errno;
+	}
+
+	nand_set_root(nand_root);
+	crypto_set_sd_key(restore_sd_key);
+
+	for (int i = 0; i < sizeof(cases) / sizeof(*cases); i++) {
+		int ret = restore_reset();
+		if (ret < 0) {
+			fprintf(stderr, "%s: Couldn't set up the old save (%s)\n", nand_root, strerror(-ret));
+			return ret;
+		}
+
+		printf("%s:\n", cases[i].name);
+		nand_set_latency(usec_per_call, usec_per_kib);
+		unsigned int ipc_start = nand_ipc_count;
+		double start = now();
+
+		switch (cases[i].from) {
+			case RESTORE_DATA_BIN: ret = restore_data_bin(scratch, cases[i].bad_name, cases[i].wrong_key); break;
+			case RESTORE_DIR:      ret = restore_save_dir(scratch, cases[i].bad_name); break;
+			case RESTORE_TAR:      ret = restore_save_tar(scratch, cases[i].bad_name); break;
+		}
+
+		double elapsed = now() - start;
+		unsigned int ipc_calls = nand_ipc_count - ipc_start;
+		nand_set_latency(0, 0);
+
+		bool ok = ((ret < 0) == cases[i].should_fail) && restore_check(nand_root, cases[i].should_fail);
+		printf("  %s (ret=%i, %u IPC calls, %.3fs)\n", ok ? "OK" : "FAILED", ret, ipc_calls, elapsed);
+		failed += !ok;
+	}
+
+	if (failed) {
+		fprintf(stderr, "%i of %zu restores went wrong\n", failed, sizeof(cases) / sizeof(*cases));
+		return -EIO;
+	}
+
+	puts("OK: every restore came back whole, and the broken ones left the old save alone");
+	return 0;
+}
+
+int main(int argc, char* argv[]) {
+	int ret;
+
+	if (argc < 2) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (!strcmp(argv[1], "verify")) {
+		ret = verify(argv[0], argc - 1, argv + 1);
+	}
+	else if (!strcmp(argv[1], "diff") && argc == 5) {
+		ret = diff(argv[2], argv[3], argv[4]);
+		if (ret >= 0)
+			return ret;
+	}
+	else if (!strcmp(argv[1], "nandbench") && argc >= 3 && argc <= 6) {
+		unsigned int usec_per_call = (argc > 3) ? strtoul(argv[3], NULL, 0) : 1000;
+		unsigned int usec_per_kib  = (argc > 4) ? strtoul(argv[4], NULL, 0) : 400;
+		usec_per_kib_written       = (argc > 5) ? strtoul(argv[5], NULL, 0) : 250;
+
+		ret = nandbench(argv[2], usec_per_call, usec_per_kib);
+	}
+	else if (!strcmp(argv[1], "journaltest") && (argc == 3 || argc == 4)) {
+		unsigned int kib = (argc > 3) ? strtoul(argv[3], NULL, 0) : 3000;
+
+		ret = journaltest(argv[2], kib ? kib : 1);
+	}
+	else if (!strcmp(argv[1], "pipetest") && argc <= 3) {
+		int rounds = (argc > 2) ? atoi(argv[2]) : 200;
+
+		ret = pipetest((rounds > 0) ? rounds : 1);
+	}
+	else if (!strcmp(argv[1], "filetable") && (argc == 4 || argc == 5)) {
+		int rounds = (argc > 4) ? atoi(argv[4]) : 100;
+
+		ret = filetable(argv[2], argv[3], (rounds > 0) ? rounds : 1);
+	}
+	else if (!strcmp(argv[1], "restoretest") && argc >= 3 && argc <= 5) {
+		unsigned int usec_per_call = (argc > 3) ? strtoul(argv[3], NULL, 0) : 0;
+		unsigned int usec_per_kib  = (argc > 4) ? strtoul(argv[4], NULL, 0) : 0;
+
+		ret = restoretest(argv[2], usec_per_call, usec_per_kib);
+	}
+	else {
+		usage(argv[0]);
+		return 1;
+	}
+
+	return (ret < 0) ? 1 : 0;
+}
@@ -0,0 +1,217 @@
+// Throws whatever it's given at U8Init, the U8Stream reader and the LZ77 decoder, the way u8tool and the console use them.
+// "make fuzz" builds it for libFuzzer (clang). "make fuzz-standalone" builds it with a small driver of its own instead:
+//   ./fuzz <file>...                       Runs each file once
+//   ./fuzz -m <rounds> <seed file>         Mutates the seed that many times, running every result
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "u8.h"
+#include "u8stream.h"
+#include "lz77.h"
+
+// Same as the console's staging buffer, just smaller so more of the window logic gets hit
+static unsigned char chunk[0x1000] __attribute__((aligned(0x40)));
+
+static int null_directory(void* user, const char* path) {
+	return 0;
+}
+
+// Anything that made it past the name checks had better be safe to put on a disk
+static int null_open(void* user, const char* path, unsigned int size) {
+	char name[256];
+
+	do {
+		size_t len = strcspn(path, "/");
+		if (len >= sizeof(name))
+			abort();
+
+		memcpy(name, path, len);
+		name[len] = 0;
+		if (!U8NameIsSafe(name))
+			abort();
+
+		path += len;
+	} while (*path++);
+
+	return 0;
+}
+
+static int null_write(void* user, const void* buf, unsigned int len) {
+	*(unsigned int *)user += len;
+	return 0;
+}
+
+static int null_close(void* user) {
+	return 0;
+}
+
+static const U8Sink null_sink = { null_directory, null_open, null_write, null_close };
+
+static void fuzz_u8(void* data, size_t size) {
+	U8Context ctx;
+	U8Iter    it;
+
+	if (U8Init(data, size, &ctx) < 0)
+		return;
+
+	// Every path twice: walking the tree, then through the index
+	for (int pass = 0; pass < 2; pass++) {
+		if (pass == 1 && U8BuildIndex(&ctx) < 0)
+			break;
+
+		int ret = U8IterInit(&it, &ctx);
+		while (ret >= 0 && it.index) {
+			U8File file;
+
+			const char* path = U8IterPath(&it);
+
+			if (path && U8OpenFile(&ctx, path, &file) == 0 && file.size)
+				(void)*(volatile const char *)(file.ptr + file.size - 1);
+
+			ret = U8IterWalk(&it);
+		}
+
+		U8IterFree(&it);
+	}
+
+	U8Free(&ctx);
+}
+
+static void fuzz_u8stream(const U8StreamIO* io, void* user, unsigned int size, bool cache_meta) {
+	U8Stream*    stream = aligned_alloc(0x40, sizeof(U8Stream));
+	U8StreamFile file;
+	unsigned int total = 0;
+
+	if (!stream)
+		return;
+
+	if (U8StreamInit(stream, io, user, 0, size) == 0 && (!cache_meta || U8StreamCacheMeta(stream) == 0)) {
+		if (U8StreamOpenFile(stream, "/meta/icon.bin", &file) == 0)
+			while (U8StreamRead(&file, chunk, sizeof(chunk)) > 0);
+
+		U8StreamExtractAll(stream, &null_sink, &total, chunk, sizeof(chunk));
+	}
+
+	U8StreamFree(stream);
+	free(stream);
+}
+
+static void fuzz_lz77(const void* data, size_t size) {
+	U8StreamMem mem = { data, size };
+	LZ77Stream* lz77 = aligned_alloc(0x40, sizeof(LZ77Stream));
+
+	if (!lz77)
+		return;
+
+	// Like extract_inner_archive()
+	if (LZ77StreamInit(lz77, &U8StreamMemIO, &mem, 0) == 0) {
+		fuzz_u8stream(&LZ77StreamIO, lz77, (lz77->out_size != ~0u) ? lz77->out_size : 0, true);
+		LZ77StreamVerify(lz77);
+	}
+
+	LZ77StreamFree(lz77);
+	free(lz77);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+	// A copy of its own, so ASan sees exactly where the input ends
+	void* copy = malloc(size ? size : 1);
+	if (!copy)
+		return 0;
+
+	memcpy(copy, data, size);
+	fuzz_u8(copy, size);
+
+	U8StreamMem mem = { copy, size };
+	fuzz_u8stream(&U8StreamMemIO, &mem, size, false);
+	fuzz_lz77(copy, size);
+
+	free(copy);
+	return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+static void* read_file(const char* path, size_t* size) {
+	FILE* fp = fopen(path, "rb");
+	void* data = NULL;
+
+	if (!fp) {
+		perror(path);
+		return NULL;
+	}
+
+	fseek(fp, 0, SEEK_END);
+	*size = ftell(fp);
+	rewind(fp);
+	if ((data = malloc(*size ? *size : 1)) && fread(data, 1, *size, fp) != *size) {
+		free(data);
+		data = NULL;
+	}
+
+	fclose(fp);
+	return data;
+}
+
+// Mostly the header and node table, that's where the interesting numbers are
+static void mutate(uint8_t* data, size_t size) {
+	int count = 1 + rand() % 8;
+
+	while (count--) {
+		size_t pos = (rand() % 4) ? rand() % (size < 0x400 ? size : 0x400) : rand() % size;
+
+		switch (rand() % 4) {
+			case 0: data[pos] ^= 1 << (rand() % 8); break;
+			case 1: data[pos] = rand(); break;
+			case 2: data[pos] = (rand() % 2) ? 0xFF : 0x00; break;
+			case 3: if (pos + 4 <= size) memcpy(data + pos, &(uint32_t){ be32(rand() % (size * 2)) }, 4); break;
+		}
+	}
+}
+
+int main(int argc, char* argv[]) {
+	if (argc == 4 && !strcmp(argv[1], "-m")) {
+		long   rounds = atol(argv[2]);
+		size_t size;
+		void*  seed = read_file(argv[3], &size);
+		void*  data = seed ? malloc(size) : NULL;
+
+		if (!data || !size)
+			return 1;
+
+		// Every rejected input says why, that's a lot of noise
+		freopen("/dev/null", "w", stderr);
+		srand(1);
+		for (long i = 0; i < rounds; i++) {
+			memcpy(data, seed, size);
+			mutate(data, size);
+			LLVMFuzzerTestOneInput(data, size);
+		}
+
+		printf("%ld rounds OK\n", rounds);
+		free(data);
+		free(seed);
+		return 0;
+	}
+
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s <file>...\n       %s -m <rounds> <seed file>\n", argv[0], argv[0]);
+		return 1;
+	}
+
+	for (int i = 1; i < argc; i++) {
+		size_t size;
+		void*  data = read_file(argv[i], &size);
+
+		if (!data)
+			return 1;
+
+		LLVMFuzzerTestOneInput(data, size);
+		free(data);
+	}
+
+	return 0;
+}
+#endif
@@ -0,0 +1,731 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "u8.h"
+#include "u8write.h"
+#include "lz77.h"
+
+typedef struct archive {
+	void*  map;
+	size_t map_size;
+	void*  data;      // Either the mapping, or what it decompressed to
+	size_t data_size;
+	U8Context ctx;
+} archive;
+
+static void usage(const char* argv0) {
+	fprintf(stderr,
+		"Usage: %s list    <archive>\n"
+		"       %s extract <archive> <output dir>\n"
+		"       %s pack    <input dir> <archive>\n"
+		"       %s check   <archive> [rounds]\n"
+		"       %s bench   <IMD5/LZ77 file> [rounds]\n"
+		"       %s lookup  <archive> [rounds]\n"
+		"       %s synth   <archive> [files]\n"
+		"       %s packbench <input dir> [rounds]\n"
+		"       %s slist   <archive>\n"
+		"       %s sextract <archive> <output dir>\n"
+		"       %s scat    <archive> <path>\n"
+		"\n"
+		"slist, sextract and scat go through U8Stream like the console does, a block at a time.\n"
+		"sextract writes directories first, then files ordered by offset.\n"
+		"packbench packs the tree into a byte counter, so only reading and layout are timed.\n",
+		argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0);
+}
+
+static bool is_compressed(const void* ptr, size_t size) {
+	const unsigned char* data = ptr;
+
+	return size >= 4 && (be32(*(const uint32_t *)data) == IMD5_MAGIC || be32(*(const uint32_t *)data) == LZ77_MAGIC || data[0] == 0x10 || data[0] == 0x11);
+}
+
+// The whole thing goes through the same streaming decoder the console uses, just into one big buffer
+static int decompress(const void* ptr, size_t size, void** out, size_t* out_size) {
+	U8StreamMem mem = { ptr, size };
+	LZ77Stream* lz77 = malloc(sizeof(LZ77Stream));
+	size_t cap = 0, len = 0;
+	unsigned char* buf = NULL;
+	int ret;
+
+	if (!lz77)
+		return -ENOMEM;
+
+	ret = LZ77StreamInit(lz77, &U8StreamMemIO, &mem, 0);
+	while (ret >= 0) {
+		if (len == cap) {
+			cap = cap ? cap * 2 : ((lz77->out_size != ~0u) ? lz77->out_size + 1 : 0x10000);
+			unsigned char* temp = realloc(buf, cap);
+			if (!temp) {
+				ret = -ENOMEM;
+				break;
+			}
+
+			buf = temp;
+		}
+
+		ret = LZ77StreamRead(lz77, buf + len, cap - len);
+		if (ret <= 0)
+			break;
+
+		len += ret;
+	}
+
+	if (ret == 0)
+		ret = LZ77StreamVerify(lz77);
+
+	LZ77StreamFree(lz77);
+	free(lz77);
+	if (ret < 0) {
+		free(buf);
+		return ret;
+	}
+
+	*out = buf;
+	*out_size = len;
+	return 0;
+}
+
+static int open_archive(const char* path, archive* arc) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		perror(path);
+		return -errno;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		perror(path);
+		close(fd);
+		return -errno;
+	}
+
+	arc->map_size = st.st_size;
+	arc->map = mmap(NULL, arc->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (arc->map == MAP_FAILED) {
+		perror(path);
+		return -errno;
+	}
+
+	arc->data = arc->map;
+	arc->data_size = arc->map_size;
+
+	// banner.bin, icon.bin and friends
+	if (is_compressed(arc->map, arc->map_size)) {
+		int ret = decompress(arc->map, arc->map_size, &arc->data, &arc->data_size);
+		if (ret < 0) {
+			fprintf(stderr, "%s: Decompression failed (ret=%i)\n", path, ret);
+			munmap(arc->map, arc->map_size);
+			return ret;
+		}
+	}
+
+	// Banners (opening.bnr, content #0) have an IMET header first
+	static const size_t offsets[] = { 0, 0x600, 0x640 };
+	for (int i = 0; i < sizeof(offsets) / sizeof(*offsets); i++) {
+		if (offsets[i] + sizeof(U8Header) > arc->data_size)
+			break;
+
+		const U8Header* header = arc->data + offsets[i];
+		if (be32(header->magic) != U8_MAGIC)
+			continue;
+
+		if (U8Init(arc->data + offsets[i], arc->data_size - offsets[i], &arc->ctx) < 0)
+			break;
+
+		return 0;
+	}
+
+	fprintf(stderr, "%s: Not a U8 archive\n", path);
+	if (arc->data != arc->map)
+		free(arc->data);
+
+	munmap(arc->map, arc->map_size);
+	return -1;
+}
+
+static void close_archive(archive* arc) {
+	U8Free(&arc->ctx);
+	if (arc->data != arc->map)
+		free(arc->data);
+
+	munmap(arc->map, arc->map_size);
+}
+
+// Calls func for every node under the root with its full path (no leading slash)
+static int walk_archive(archive* arc, int (*func)(archive*, unsigned int, const char*, void*), void* user) {
+	U8Iter it;
+
+	int ret = U8IterInit(&it, &arc->ctx);
+	while (ret >= 0 && it.index) {
+		const char* path = U8IterPath(&it);
+		if (!path) {
+			ret = -ENOMEM;
+			break;
+		}
+
+		ret = func(arc, it.index, path, user);
+		if (ret < 0)
+			break;
+
+		ret = U8IterWalk(&it);
+	}
+
+	U8IterFree(&it);
+	return ret;
+}
+
+static int list_node(archive* arc, unsigned int index, const char* path, void* user) {
+	U8Node* node = &arc->ctx.nodes[index];
+
+	if (U8NodeType(node) == 0x01)
+		printf("%5u  %-10s  %-10s  %s/\n", index, "", "", path);
+	else
+		printf("%5u  %#-10x  %#-10x  %s\n", index, U8NodeOffset(node), U8NodeSize(node), path);
+
+	return 0;
+}
+
+// Names go straight into paths on the PC, so all of them get looked at before anything's made
+static int check_node_name(archive* arc, unsigned int index, const char* path, void* user) {
+	const char* name = arc->ctx.str_table + U8NodeNameOffset(&arc->ctx.nodes[index]);
+
+	if (!U8NameIsSafe(name)) {
+		fprintf(stderr, "Node %u has a name that can't be extracted (\"%s\")\n", index, name);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int extract_node(archive* arc, unsigned int index, const char* path, void* user) {
+	U8Node* node = &arc->ctx.nodes[index];
+	const char* out_dir = user;
+	char out_path[4096];
+
+	if (snprintf(out_path, sizeof(out_path), "%s/%s", out_dir, path) >= sizeof(out_path)) {
+		fprintf(stderr, "%s/%s: Path is too long\n", out_dir, path);
+		return -ENAMETOOLONG;
+	}
+
+	if (U8NodeType(node) == 0x01) {
+		if (mkdir(out_path, 0755) < 0 && errno != EEXIST) {
+			perror(out_path);
+			return -errno;
+		}
+
+		return 0;
+	}
+
+	size_t offset = U8NodeOffset(node), size = U8NodeSize(node); // U8Init made sure these fit
+
+	int fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(out_path);
+		return -errno;
+	}
+
+	// Straight out of the mapping (or the decompressed copy)
+	const char* data = arc->ctx.ptr + offset;
+	while (size) {
+		ssize_t ret = write(fd, data, size);
+		if (ret < 0) {
+			perror(out_path);
+			close(fd);
+			return -errno;
+		}
+
+		data += ret;
+		size -= ret;
+	}
+
+	close(fd);
+	puts(path);
+	return 0;
+}
+
+static double now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Same read size the console uses for its staging buffer
+static int bench(const char* path, int rounds) {
+	static unsigned char chunk[0x10000] __attribute__((aligned(0x40)));
+	archive arc = {};
+	int ret = 0;
+	size_t out_size = 0;
+
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		perror(path);
+		if (fd >= 0)
+			close(fd);
+		return -errno;
+	}
+
+	arc.map_size = st.st_size;
+	arc.map = mmap(NULL, arc.map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (arc.map == MAP_FAILED) {
+		perror(path);
+		return -errno;
+	}
+
+	double start = now();
+	for (int i = 0; i < rounds && ret >= 0; i++) {
+		U8StreamMem mem = { arc.map, arc.map_size };
+		LZ77Stream lz77;
+
+		out_size = 0;
+		ret = LZ77StreamInit(&lz77, &U8StreamMemIO, &mem, 0);
+		while (ret >= 0 && (ret = LZ77StreamRead(&lz77, chunk, sizeof(chunk))) > 0)
+			out_size += ret;
+
+		if (ret == 0)
+			ret = LZ77StreamVerify(&lz77);
+
+		LZ77StreamFree(&lz77);
+	}
+	double elapsed = now() - start;
+
+	munmap(arc.map, arc.map_size);
+	if (ret < 0) {
+		fprintf(stderr, "%s: Decompression failed (ret=%i)\n", path, ret);
+		return ret;
+	}
+
+	printf("%s: %#zx -> %#zx bytes, %i rounds in %.3fs\n", path, arc.map_size, out_size, rounds, elapsed);
+	printf("  in:  %8.2f MB/s\n", arc.map_size * (double)rounds / elapsed / 1e6);
+	printf("  out: %8.2f MB/s\n", out_size * (double)rounds / elapsed / 1e6);
+	return 0;
+}
+
+// Validation on its own, over and over
+static int check(archive* arc, int rounds) {
+	void*  ptr  = arc->ctx.ptr;
+	size_t size = arc->ctx.fsize;
+	int    ret  = 0;
+
+	double start = now();
+	for (int i = 0; i < rounds && ret >= 0; i++)
+		ret = U8Init(ptr, size, NULL);
+	double elapsed = now() - start;
+
+	if (ret < 0)
+		return ret;
+
+	unsigned int meta_size = arc->ctx.header.meta_size;
+	printf("OK: %u nodes, %#x bytes of node/string table\n", arc->ctx.node_count, meta_size);
+	printf("  %.3f us per archive, %.2f ns per node, %.2f MB/s of node table\n",
+	       elapsed / rounds * 1e6, elapsed / rounds / arc->ctx.node_count * 1e9, meta_size * (double)rounds / elapsed / 1e6);
+	return 0;
+}
+
+typedef struct stream_archive {
+	FILE*       fp;
+	LZ77Stream* lz77; // NULL if it isn't compressed
+	U8Stream*   stream;
+} stream_archive;
+
+static void close_stream(stream_archive* sa) {
+	if (sa->stream)
+		U8StreamFree(sa->stream);
+
+	if (sa->lz77)
+		LZ77StreamFree(sa->lz77);
+
+	free(sa->lz77);
+	free(sa->stream);
+	if (sa->fp)
+		fclose(sa->fp);
+}
+
+// Same guesses as open_archive(), except nothing gets read until U8Stream asks for it
+static int open_stream(const char* path, stream_archive* sa) {
+	static const unsigned int offsets[] = { 0, 0x600, 0x640 };
+	unsigned char magic[4];
+	int ret = -1;
+
+	memset(sa, 0, sizeof(stream_archive));
+	if (!(sa->fp = fopen(path, "rb"))) {
+		perror(path);
+		return -errno;
+	}
+
+	fseek(sa->fp, 0, SEEK_END);
+	long size = ftell(sa->fp);
+	rewind(sa->fp);
+
+	// Both have 0x40 aligned members
+	if (!(sa->stream = aligned_alloc(0x40, sizeof(U8Stream)))) {
+		close_stream(sa);
+		return -ENOMEM;
+	}
+
+	sa->stream->meta = NULL;
+	if (fread(magic, 4, 1, sa->fp) && is_compressed(magic, sizeof(magic))) {
+		if (!(sa->lz77 = aligned_alloc(0x40, sizeof(LZ77Stream)))) {
+			close_stream(sa);
+			return -ENOMEM;
+		}
+
+		if ((ret = LZ77StreamInit(sa->lz77, &U8StreamFileIO, sa->fp, 0)) == 0
+		&&  (ret = U8StreamInit(sa->stream, &LZ77StreamIO, sa->lz77, 0, (sa->lz77->out_size != ~0u) ? sa->lz77->out_size : 0)) == 0)
+			ret = U8StreamCacheMeta(sa->stream);
+	}
+	else for (int i = 0; i < sizeof(offsets) / sizeof(*offsets); i++) {
+		if (offsets[i] + sizeof(U8Header) > size)
+			break;
+
+		if (fseek(sa->fp, offsets[i], SEEK_SET) < 0 || !fread(magic, 4, 1, sa->fp) || be32(*(const uint32_t *)magic) != U8_MAGIC)
+			continue;
+
+		ret = U8StreamInit(sa->stream, &U8StreamFileIO, sa->fp, offsets[i], size - offsets[i]);
+		break;
+	}
+
+	if (ret < 0) {
+		fprintf(stderr, "%s: Not a U8 archive (ret=%i)\n", path, ret);
+		close_stream(sa);
+	}
+
+	return ret;
+}
+
+static int list_directory(void* user, const char* path) {
+	printf("%-10s  %s/\n", "", path);
+	return 0;
+}
+
+static int list_open(void* user, const char* path, unsigned int size) {
+	printf("%#-10x  %s\n", size, path);
+	return 0;
+}
+
+static int list_write(void* user, const void* buf, unsigned int len) {
+	return 0;
+}
+
+static int list_close(void* user) {
+	return 0;
+}
+
+static const U8Sink list_sink = { list_directory, list_open, list_write, list_close };
+
+static int stream_command(const char* cmd, const char* path, const char* arg) {
+	static unsigned char chunk[0x10000] __attribute__((aligned(0x40)));
+	stream_archive sa;
+	int ret;
+
+	if ((ret = open_stream(path, &sa)) < 0)
+		return ret;
+
+	if (!strcmp(cmd, "slist")) {
+		printf("%-10s  %s\n", "Size", "Path");
+		ret = U8StreamExtractAll(sa.stream, &list_sink, NULL, chunk, sizeof(chunk));
+	}
+	else if (!strcmp(cmd, "sextract")) {
+		U8DirSink sink = { arg };
+
+		if (mkdir(arg, 0755) < 0 && errno != EEXIST) {
+			perror(arg);
+			ret = -errno;
+		} else {
+			ret = U8StreamExtractAll(sa.stream, &U8DirSinkOps, &sink, chunk, sizeof(chunk));
+		}
+	}
+	else {
+		U8StreamFile file;
+
+		ret = U8StreamOpenFile(sa.stream, arg, &file);
+		if (ret < 0)
+			fprintf(stderr, "%s: %s\n", arg, (ret == -2) ? "No such file" : (ret == -3) ? "Is a directory" : "Read failed");
+
+		while (ret >= 0 && (ret = U8StreamRead(&file, chunk, sizeof(chunk))) > 0) {
+			if (!fwrite(chunk, ret, 1, stdout)) {
+				ret = -errno;
+				break;
+			}
+		}
+	}
+
+	if (ret < 0)
+		fprintf(stderr, "%s: %s failed (ret=%i)\n", path, cmd, ret);
+	// Compressed ones have an MD5 to check at the end
+	else if (sa.lz77 && (ret = LZ77StreamVerify(sa.lz77)) < 0)
+		fprintf(stderr, "%s: IMD5 checksum doesn't match\n", path);
+
+	close_stream(&sa);
+	return ret;
+}
+
+typedef struct path_list {
+	char**       paths;
+	unsigned int count;
+} path_list;
+
+static int collect_path(archive* arc, unsigned int index, const char* path, void* user) {
+	path_list* list = user;
+
+	if (U8NodeType(&arc->ctx.nodes[index]) != 0x00)
+		return 0;
+
+	char** temp = realloc(list->paths, sizeof(char*) * (list->count + 1));
+	if (!temp || !(temp[list->count] = strdup(path)))
+		return -ENOMEM;
+
+	list->paths = temp;
+	list->count++;
+	return 0;
+}
+
+// Looks up every file in the archive, walking the tree and then through U8BuildIndex()'s table
+static int lookup(archive* arc, int rounds) {
+	path_list    list = {};
+	unsigned int* found = NULL;
+	double       walk = 0, build = 0, indexed = 0;
+	int          ret = walk_archive(arc, collect_path, &list);
+
+	if (ret < 0 || !list.count || !(found = malloc(sizeof(unsigned int) * list.count))) {
+		fprintf(stderr, ret < 0 ? "Couldn't list the archive (ret=%i)\n" : "No files to look up\n", ret);
+		ret = -1;
+		goto exit;
+	}
+
+	double start = now();
+	for (int i = 0; i < rounds; i++) {
+		for (unsigned int j = 0; j < list.count; j++) {
+			U8File file;
+
+			if ((ret = U8OpenFile(&arc->ctx, list.paths[j], &file)) < 0)
+				goto exit;
+
+			found[j] = file.index;
+		}
+	}
+	walk = now() - start;
+
+	start = now();
+	if ((ret = U8BuildIndex(&arc->ctx)) < 0)
+		goto exit;
+	build = now() - start;
+
+	start = now();
+	for (int i = 0; i < rounds; i++) {
+		for (unsigned int j = 0; j < list.count; j++) {
+			U8File file;
+
+			if ((ret = U8OpenFile(&arc->ctx, list.paths[j], &file)) < 0)
+				goto exit;
+
+			if (file.index != found[j]) {
+				fprintf(stderr, "%s: Index says node %u, walking the tree says %u\n", list.paths[j], file.index, found[j]);
+				ret = -1;
+				goto exit;
+			}
+		}
+	}
+	indexed = now() - start;
+
+	double lookups = (double)rounds * list.count;
+	printf("%u nodes, %u files, %i rounds\n", arc->ctx.node_count, list.count, rounds);
+	printf("  walking: %10.1f ns per lookup\n", walk / lookups * 1e9);
+	printf("  index:   %10.1f ns per lookup, %.3f ms to build\n", indexed / lookups * 1e9, build * 1e3);
+
+exit:
+	for (unsigned int i = 0; i < list.count; i++)
+		free(list.paths[i]);
+
+	free(list.paths);
+	free(found);
+	return ret;
+}
+
+// Lots of small files spread over a few directories, plus what a banner has
+static int synth(const char* path, unsigned int num_files) {
+	static const char data[0x40] = "synthetic";
+	U8Writer writer;
+	char     name[64];
+	int      ret;
+
+	if ((ret = U8WriterInit(&writer)) < 0)
+		return ret;
+
+	static const char* const meta[] = { "meta/banner.bin", "meta/icon.bin", "meta/sound.bin" };
+	for (int i = 0; i < 3 && ret == 0; i++)
+		ret = U8WriterAddData(&writer, meta[i], data, sizeof(data));
+
+	for (unsigned int i = 0; i < num_files && ret == 0; i++) {
+		sprintf(name, "dir%02u/sub%u/file%05u.bin", i % 32, (i / 32) % 4, i);
+		ret = U8WriterAddData(&writer, name, data, 1 + i % sizeof(data));
+	}
+
+	if (ret == 0) {
+		FILE* fp = fopen(path, "wb");
+		if (!fp) {
+			perror(path);
+			ret = -errno;
+		} else {
+			ret = U8WriterWriteFile(&writer, fp);
+			if (fclose(fp) != 0 && ret == 0)
+				ret = -errno;
+		}
+	}
+
+	U8WriterFree(&writer);
+	return ret;
+}
+
+static int count_write(void* user, const void* buf, unsigned int len) {
+	(void)buf;
+	*(unsigned long long*)user += len;
+	return 0;
+}
+
+// Whole pack each round: walking the host tree, layout, and reading every file
+static int packbench(const char* dir, int rounds) {
+	unsigned long long out_size = 0;
+	unsigned int num_files = 0;
+	int ret = 0;
+
+	double start = now();
+	for (int i = 0; i < rounds && ret == 0; i++) {
+		U8Writer writer;
+
+		if ((ret = U8WriterInit(&writer)) < 0)
+			break;
+
+		out_size = 0;
+		ret = U8WriterAddTree(&writer, dir, NULL);
+		if (ret == 0)
+			ret = U8WriterWrite(&writer, count_write, &out_size);
+
+		num_files = 0;
+		for (unsigned int j = 0; j < writer.num_entries; j++)
+			num_files += !writer.entries[j].is_dir;
+
+		U8WriterFree(&writer);
+	}
+	double elapsed = now() - start;
+
+	if (ret < 0)
+		return ret;
+
+	printf("%s: %u files, %llu bytes, %i rounds\n", dir, num_files, out_size, rounds);
+	printf("  %.3f ms per pack, %.1f MB/s, %.0f files/s\n", elapsed / rounds * 1e3,
+		(double)out_size * rounds / elapsed / 1e6, (double)num_files * rounds / elapsed);
+	return 0;
+}
+
+int main(int argc, char* argv[]) {
+	int ret;
+	archive arc = {};
+
+	if (argc < 3) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (!strcmp(argv[1], "list") && argc == 3) {
+		if (open_archive(argv[2], &arc) < 0)
+			return 1;
+
+		printf("%5s  %-10s  %-10s  %s\n", "Node", "Offset", "Size", "Path");
+		ret = walk_archive(&arc, list_node, NULL);
+		close_archive(&arc);
+	}
+	else if (!strcmp(argv[1], "extract") && argc == 4) {
+		if (open_archive(argv[2], &arc) < 0)
+			return 1;
+
+		ret = walk_archive(&arc, check_node_name, NULL);
+		if (ret == 0 && mkdir(argv[3], 0755) < 0 && errno != EEXIST) {
+			perror(argv[3]);
+			ret = -errno;
+		}
+
+		if (ret == 0)
+			ret = walk_archive(&arc, extract_node, argv[3]);
+
+		close_archive(&arc);
+	}
+	else if (!strcmp(argv[1], "slist") && argc == 3) {
+		ret = stream_command(argv[1], argv[2], NULL);
+	}
+	else if ((!strcmp(argv[1], "sextract") || !strcmp(argv[1], "scat")) && argc == 4) {
+		ret = stream_command(argv[1], argv[2], argv[3]);
+	}
+	else if (!strcmp(argv[1], "pack") && argc == 4) {
+		U8Writer writer;
+
+		if (U8WriterInit(&writer) < 0)
+			return 1;
+
+		ret = U8WriterAddTree(&writer, argv[2], NULL);
+		if (ret == 0) {
+			FILE* fp = fopen(argv[3], "wb");
+			if (!fp) {
+				perror(argv[3]);
+				ret = -errno;
+			} else {
+				ret = U8WriterWriteFile(&writer, fp);
+				if (fclose(fp) != 0 && ret == 0)
+					ret = -errno;
+			}
+		}
+
+		U8WriterFree(&writer);
+	}
+	else if (!strcmp(argv[1], "check") && (argc == 3 || argc == 4)) {
+		int rounds = (argc == 4) ? atoi(argv[3]) : 1000;
+
+		// open_archive() already did the first (and failing) round
+		if (open_archive(argv[2], &arc) < 0)
+			return 1;
+
+		ret = check(&arc, (rounds > 0) ? rounds : 1);
+		close_archive(&arc);
+	}
+	else if (!strcmp(argv[1], "bench") && (argc == 3 || argc == 4)) {
+		int rounds = (argc == 4) ? atoi(argv[3]) : 100;
+
+		ret = bench(argv[2], (rounds > 0) ? rounds : 1);
+	}
+	else if (!strcmp(argv[1], "lookup") && (argc == 3 || argc == 4)) {
+		int rounds = (argc == 4) ? atoi(argv[3]) : 100;
+
+		if (open_archive(argv[2], &arc) < 0)
+			return 1;
+
+		ret = lookup(&arc, (rounds > 0) ? rounds : 1);
+		close_archive(&arc);
+	}
+	else if (!strcmp(argv[1], "synth") && (argc == 3 || argc == 4)) {
+		unsigned int files = (argc == 4) ? strtoul(argv[3], NULL, 0) : 5000;
+
+		ret = synth(argv[2], files);
+	}
+	else if (!strcmp(argv[1], "packbench") && (argc == 3 || argc == 4)) {
+		int rounds = (argc == 4) ? atoi(argv[3]) : 10;
+
+		ret = packbench(argv[2], (rounds > 0) ? rounds : 1);
+	}
+	else {
+		usage(argv[0]);
+		return 1;
+	}
+
+	return (ret < 0) ? 1 : 0;
+}